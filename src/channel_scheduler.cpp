@@ -0,0 +1,237 @@
+// self
+#include "channel_scheduler.hpp"
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+// worker index of the calling thread, -1 outside of any scheduler
+static thread_local ChannelScheduler *s_current_scheduler = nullptr;
+static thread_local int s_current_worker = -1;
+
+
+
+ChannelStrand::ChannelStrand(ChannelScheduler &scheduler)
+    : m_scheduler(scheduler)
+    , m_scheduled(false)
+{
+}
+
+
+void ChannelStrand::post(std::function<void()> task)
+{
+    bool need_schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        if (!m_scheduled) {
+            m_scheduled = true;
+            need_schedule = true;
+        }
+    }
+
+    if (need_schedule) {
+        m_scheduler.schedule(shared_from_this());
+    }
+}
+
+
+void ChannelStrand::run()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tasks.empty()) {
+            m_scheduled = false;
+            return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+    }
+
+    task();
+    task = nullptr;
+
+    bool need_schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tasks.empty()) {
+            m_scheduled = false;
+        }
+        else {
+            need_schedule = true;
+        }
+    }
+
+    // go to the back of the deque so other channels get their turn
+    if (need_schedule) {
+        m_scheduler.schedule(shared_from_this());
+    }
+}
+
+
+size_t ChannelStrand::pending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+
+
+ChannelScheduler::ChannelScheduler(int workers)
+    : m_pending(0)
+    , m_stop(false)
+    , m_next_worker(0)
+    , m_executed(0)
+    , m_steals(0)
+{
+    if (workers <= 0) {
+        workers = (int)std::thread::hardware_concurrency();
+    }
+    if (workers <= 0) {
+        workers = 1;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        m_workers.emplace_back(new Worker());
+    }
+    for (int i = 0; i < workers; i++) {
+        m_workers[i]->thread = std::thread(&ChannelScheduler::work, this, i);
+    }
+
+    SPDLOG_INFO("channel scheduler started with {} workers", workers);
+}
+
+
+ChannelScheduler::~ChannelScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_idle_mutex);
+        m_stop.store(true);
+    }
+    m_idle_cv.notify_all();
+
+    for (auto &worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    SPDLOG_INFO("channel scheduler stopped, executed: {}, steals: {}", m_executed.load(), m_steals.load());
+}
+
+
+std::shared_ptr<ChannelStrand> ChannelScheduler::make_strand()
+{
+    return std::make_shared<ChannelStrand>(*this);
+}
+
+
+void ChannelScheduler::schedule(std::shared_ptr<ChannelStrand> strand)
+{
+    // keep work local to the current worker, spread work posted from outside
+    size_t index = 0;
+    if (s_current_scheduler == this && s_current_worker >= 0) {
+        index = (size_t)s_current_worker;
+    }
+    else {
+        index = m_next_worker.fetch_add(1) % m_workers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->strands.push_back(std::move(strand));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_idle_mutex);
+        m_pending.fetch_add(1);
+    }
+    m_idle_cv.notify_one();
+}
+
+
+int ChannelScheduler::workers()
+{
+    return (int)m_workers.size();
+}
+
+
+size_t ChannelScheduler::executed()
+{
+    return m_executed.load();
+}
+
+
+size_t ChannelScheduler::steals()
+{
+    return m_steals.load();
+}
+
+
+void ChannelScheduler::work(int index)
+{
+    s_current_scheduler = this;
+    s_current_worker = index;
+
+    while (true) {
+        std::shared_ptr<ChannelStrand> strand = pop(index);
+        if (nullptr == strand) {
+            strand = steal(index);
+        }
+
+        if (strand != nullptr) {
+            m_pending.fetch_sub(1);
+            strand->run();
+            m_executed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idle_mutex);
+        m_idle_cv.wait(lock, [this]() { return m_stop.load() || m_pending.load() > 0; });
+        if (m_stop.load() && 0 == m_pending.load()) {
+            break;
+        }
+    }
+
+    s_current_scheduler = nullptr;
+    s_current_worker = -1;
+}
+
+
+std::shared_ptr<ChannelStrand> ChannelScheduler::pop(int index)
+{
+    Worker *worker = m_workers[index].get();
+
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->strands.empty()) {
+        return nullptr;
+    }
+
+    // fifo for the owner, every runnable channel gets a turn
+    std::shared_ptr<ChannelStrand> strand = std::move(worker->strands.front());
+    worker->strands.pop_front();
+    return strand;
+}
+
+
+std::shared_ptr<ChannelStrand> ChannelScheduler::steal(int index)
+{
+    for (size_t i = 1; i < m_workers.size(); i++) {
+        Worker *victim = m_workers[(index + i) % m_workers.size()].get();
+
+        std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim->strands.empty()) {
+            continue;
+        }
+
+        // thieves take from the other end to stay away from the owner
+        std::shared_ptr<ChannelStrand> strand = std::move(victim->strands.back());
+        victim->strands.pop_back();
+        m_steals.fetch_add(1, std::memory_order_relaxed);
+        return strand;
+    }
+
+    return nullptr;
+}
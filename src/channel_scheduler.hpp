@@ -0,0 +1,83 @@
+#pragma once
+
+// c
+#include <stdint.h>
+
+// c++
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+class ChannelScheduler;
+
+
+// serial executor, tasks posted to one strand never run concurrently and keep their order
+// a channel owns one strand per stage, the scheduler multiplexes all strands onto its workers
+class ChannelStrand : public std::enable_shared_from_this<ChannelStrand> {
+public:
+    ChannelStrand(ChannelScheduler &scheduler);
+    ChannelStrand(const ChannelStrand &other) = delete;
+
+    void post(std::function<void()> task);
+
+    // run one task, requeue the strand if more are pending
+    void run();
+
+    size_t pending();
+
+
+private:
+    ChannelScheduler &m_scheduler;
+
+    std::mutex m_mutex;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_scheduled;
+};
+
+
+// fixed set of worker threads, each with its own deque of runnable strands
+// idle workers steal from the others, so cost grows with workers and not with channels
+class ChannelScheduler {
+public:
+    ChannelScheduler(int workers);
+    ChannelScheduler(const ChannelScheduler &other) = delete;
+    ~ChannelScheduler();
+
+    std::shared_ptr<ChannelStrand> make_strand();
+
+    void schedule(std::shared_ptr<ChannelStrand> strand);
+
+    int workers();
+    size_t executed();
+    size_t steals();
+
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<ChannelStrand>> strands;
+        std::thread thread;
+    };
+
+    void work(int index);
+    std::shared_ptr<ChannelStrand> pop(int index);
+    std::shared_ptr<ChannelStrand> steal(int index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_idle_mutex;
+    std::condition_variable m_idle_cv;
+    std::atomic<int64_t> m_pending;
+    std::atomic<bool> m_stop;
+
+    std::atomic<size_t> m_next_worker;
+    std::atomic<size_t> m_executed;
+    std::atomic<size_t> m_steals;
+};
@@ -0,0 +1,106 @@
+// self
+#include "codec_thread_budget.hpp"
+
+// c++
+#include <algorithm>
+#include <cmath>
+
+// fmt
+#include <fmt/format.h>
+
+
+
+// past this libavcodec's frame threads add more delay than speed
+static const int k_max_codec_threads = 16;
+
+
+
+CodecThreadBudget &CodecThreadBudget::instance()
+{
+    static CodecThreadBudget budget;
+    return budget;
+}
+
+
+CodecThreadBudget::CodecThreadBudget()
+    : m_cores(0)
+    , m_channels(0)
+    , m_peak_channels(0)
+    , m_codecs(0)
+    , m_threads(0)
+    , m_max_threads(0)
+{
+}
+
+
+void CodecThreadBudget::set_cores(int cores)
+{
+    m_cores.store(std::max(cores, 0));
+}
+
+
+int CodecThreadBudget::cores()
+{
+    return m_cores.load();
+}
+
+
+void CodecThreadBudget::add_channels(int channels)
+{
+    int running = m_channels.fetch_add(channels) + channels;
+
+    int peak = m_peak_channels.load();
+    while (running > peak && !m_peak_channels.compare_exchange_weak(peak, running)) {
+    }
+}
+
+
+void CodecThreadBudget::remove_channels(int channels)
+{
+    m_channels.fetch_sub(channels);
+}
+
+
+int CodecThreadBudget::threads(double stage_cost, double channel_cost)
+{
+    int threads = 1;
+
+    int cores = m_cores.load();
+    if (cores > 0 && stage_cost > 0.0 && channel_cost >= stage_cost) {
+        int channels = std::max(m_channels.load(), 1);
+        double share = (double)cores / channels * stage_cost / channel_cost;
+        threads = std::min(std::max((int)std::floor(share + 0.5), 1), k_max_codec_threads);
+    }
+
+    m_codecs.fetch_add(1);
+    m_threads.fetch_add(threads);
+
+    int max_threads = m_max_threads.load();
+    while (threads > max_threads && !m_max_threads.compare_exchange_weak(max_threads, threads)) {
+    }
+
+    return threads;
+}
+
+
+double CodecThreadBudget::decode_cost(bool hevc, int width, int height)
+{
+    return (double)width * height * (hevc ? 1.5 : 1.0);
+}
+
+
+double CodecThreadBudget::encode_cost(bool hevc, int width, int height)
+{
+    return (double)width * height * (hevc ? 4.0 : 2.0);
+}
+
+
+std::string CodecThreadBudget::stats()
+{
+    uint64_t codecs = m_codecs.load();
+
+    return fmt::format(
+        "codec thread budget, cores: {}, peak channels: {}, codecs: {}, threads avg: {:.2f}, max: {}",
+        m_cores.load(), m_peak_channels.load(), codecs, codecs > 0 ? (double)m_threads.load() / codecs : 0.0, m_max_threads.load()
+    );
+}
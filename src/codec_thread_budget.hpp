@@ -0,0 +1,49 @@
+#pragma once
+
+// c
+#include <stdint.h>
+
+// c++
+#include <atomic>
+#include <string>
+
+
+
+// process wide split of the cores among the codec threads of all running channels
+// every codec asks for its share when it opens, from the cores, the channels running then and what its stage costs
+// relative to the rest of its channel, libavcodec fixes the thread count at open so changes reach codecs opened afterwards
+class CodecThreadBudget {
+public:
+    static CodecThreadBudget &instance();
+
+    // cores shared by every codec, 0 keeps every decoder and encoder at 1 thread
+    void set_cores(int cores);
+    int cores();
+
+    // channels started or finished, the shares of codecs opened afterwards follow the new count
+    void add_channels(int channels);
+    void remove_channels(int channels);
+
+    // threads for a stage costing stage_cost out of its channel's channel_cost, at least 1
+    int threads(double stage_cost, double channel_cost);
+
+    // relative cost per frame, decoding a picture runs about half the ultrafast encode of it, hevc costs more for both
+    static double decode_cost(bool hevc, int width, int height);
+    static double encode_cost(bool hevc, int width, int height);
+
+    std::string stats();
+
+
+private:
+    CodecThreadBudget();
+    CodecThreadBudget(const CodecThreadBudget &other) = delete;
+
+    std::atomic<int> m_cores;
+    std::atomic<int> m_channels;
+
+    // statics
+    std::atomic<int> m_peak_channels;
+    std::atomic<uint64_t> m_codecs;
+    std::atomic<uint64_t> m_threads;
+    std::atomic<int> m_max_threads;
+};
@@ -0,0 +1,187 @@
+// self
+#include "decode_benchmark.hpp"
+
+// c
+#include <math.h>
+
+// c++
+#include <algorithm>
+#include <deque>
+
+// project
+#include "ffmpeg_demux.hpp"
+#include "math_utils.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+// per decoder timing of one run
+struct DecodeTiming {
+    Percentile percentile;
+    double total_ms = 0.0;
+    size_t decoded = 0;
+
+    // time of sends that completed no picture yet, charged to the next picture out
+    double pending_ms = 0.0;
+};
+
+
+// one packet in, every picture it completes out, nullptr flushes and drains what the decoder still holds
+static bool decode_timed(FFmpegDecode &decoder, FFmpegPacket *packet, std::deque<FFmpegFrame> &frames, DecodeTiming &timing)
+{
+    TimeIt ti_step;
+
+    if (packet != nullptr ? !decoder.send_packet(*packet) : !decoder.flush()) {
+        return false;
+    }
+
+    while (true) {
+        FFmpegFrame frame = decoder.receive_frame();
+        if (frame.does_need_more() || decoder.eof()) {
+            timing.pending_ms += ti_step.elapsed_microseconds() / 1000.0;
+            return true;
+        }
+        if (frame.is_null()) {
+            return false;
+        }
+
+        double elapsed_ms = timing.pending_ms + ti_step.elapsed_microseconds() / 1000.0;
+        timing.pending_ms = 0.0;
+        timing.total_ms += elapsed_ms;
+        timing.percentile.add(elapsed_ms);
+        timing.decoded++;
+        ti_step.reset();
+
+        frames.push_back(std::move(frame));
+    }
+}
+
+
+// mean squared error back from psnr_u8, 0 for identical planes
+static double psnr_to_mse(double psnr)
+{
+    return isinf(psnr) ? 0.0 : 255.0 * 255.0 / pow(10.0, psnr / 10.0);
+}
+
+
+static double mse_to_psnr(double mse)
+{
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+
+
+DecodeBenchmark::DecodeBenchmark(std::string input_url, int frames, bool fast_probe)
+    : m_input_url(input_url)
+    , m_limit_frames(frames)
+    , m_fast_probe(fast_probe)
+{
+}
+
+
+bool DecodeBenchmark::setup()
+{
+    FFmpegDemux demux(m_input_url, m_fast_probe);
+    if (!demux.setup()) {
+        return false;
+    }
+
+    m_codec_name = demux.codec_name();
+    m_packets = demux.read_some_frames(m_limit_frames);
+    if (m_packets.empty()) {
+        SPDLOG_ERROR("decode benchmark, no packets read from {}", m_input_url);
+        return false;
+    }
+
+    SPDLOG_INFO("decode benchmark, packets: {}, codec: {}, {}x{}", m_packets.size(), m_codec_name, demux.width(), demux.height());
+    return true;
+}
+
+
+bool DecodeBenchmark::run(DecodeTier tier)
+{
+    FFmpegDecode reference(m_codec_name);
+    FFmpegDecode decoder(m_codec_name);
+    decoder.set_tier(tier);
+    if (!reference.setup() || !decoder.setup()) {
+        return false;
+    }
+
+    std::deque<FFmpegFrame> reference_frames;
+    std::deque<FFmpegFrame> frames;
+    DecodeTiming reference_timing;
+    DecodeTiming timing;
+
+    size_t compared = 0;
+    double mse[3] = { 0.0, 0.0, 0.0 };
+    double worst_psnr_y = INFINITY;
+    int width = 0;
+    int height = 0;
+
+    // both decoders output in the same order, with the same delay
+    auto compare = [&]() {
+        while (!reference_frames.empty() && !frames.empty()) {
+            AVFrame *ref = reference_frames.front().raw_ptr();
+            AVFrame *dst = frames.front().raw_ptr();
+            width = ref->width;
+            height = ref->height;
+
+            // 8 bit planar yuv only
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)ref->format);
+            if (desc != nullptr && 8 == desc->comp[0].depth && desc->nb_components >= 3 && 0 == (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+                for (int p = 0; p < 3; p++) {
+                    int shift_w = p > 0 ? desc->log2_chroma_w : 0;
+                    int shift_h = p > 0 ? desc->log2_chroma_h : 0;
+                    int plane_width = (ref->width + (1 << shift_w) - 1) >> shift_w;
+                    int plane_height = (ref->height + (1 << shift_h) - 1) >> shift_h;
+                    double psnr = psnr_u8(dst->data[p], dst->linesize[p], ref->data[p], ref->linesize[p], plane_width, plane_height);
+                    mse[p] += psnr_to_mse(psnr);
+                    if (0 == p) {
+                        worst_psnr_y = std::min(worst_psnr_y, psnr);
+                    }
+                }
+                compared++;
+            }
+
+            reference_frames.pop_front();
+            frames.pop_front();
+        }
+    };
+
+    for (FFmpegPacket &packet : m_packets) {
+        if (!decode_timed(reference, &packet, reference_frames, reference_timing) || !decode_timed(decoder, &packet, frames, timing)) {
+            return false;
+        }
+        compare();
+    }
+
+    // the pictures still held by the decoders' delay, timed and compared like the others
+    if (!decode_timed(reference, nullptr, reference_frames, reference_timing) || !decode_timed(decoder, nullptr, frames, timing)) {
+        return false;
+    }
+    compare();
+
+    if (0 == timing.decoded || 0 == reference_timing.decoded) {
+        SPDLOG_ERROR("decode benchmark, {} decoded no frames", DecodeTierCvt::to_string(tier));
+        return false;
+    }
+
+    SPDLOG_INFO(
+        "decode benchmark {} {}x{}, {:<11} avg: {:.2f} ms/frame (full {:.2f}), p90: {:.2f} ms (full {:.2f}), frames compared: {}, "
+        "psnr drift vs full y: {:.2f}, u: {:.2f}, v: {:.2f} dB, worst frame y: {:.2f} dB",
+        m_codec_name, width, height, DecodeTierCvt::to_string(tier), timing.total_ms / timing.decoded, reference_timing.total_ms / reference_timing.decoded,
+        timing.percentile.calc(0.9), reference_timing.percentile.calc(0.9), compared,
+        mse_to_psnr(compared > 0 ? mse[0] / compared : 0.0), mse_to_psnr(compared > 0 ? mse[1] / compared : 0.0),
+        mse_to_psnr(compared > 0 ? mse[2] / compared : 0.0), worst_psnr_y
+    );
+
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// c++
+#include <string>
+#include <vector>
+
+// project
+#include "ffmpeg_decode.hpp"
+#include "ffmpeg_types.hpp"
+
+
+
+// every decode tier against a full decoder fed the same packets, single threaded
+// drift is the psnr of the tier's pictures against the full decode, errors carried by references included
+class DecodeBenchmark {
+public:
+    DecodeBenchmark(std::string input_url, int frames, bool fast_probe = false);
+    DecodeBenchmark(const DecodeBenchmark &other) = delete;
+
+    // read the packets every run decodes
+    bool setup();
+
+    bool run(DecodeTier tier);
+
+
+private:
+    std::string m_input_url;
+    int m_limit_frames;
+    bool m_fast_probe;
+
+    std::string m_codec_name;
+    std::vector<FFmpegPacket> m_packets;
+};
@@ -0,0 +1,592 @@
+// self
+#include "ffmpeg_annexb.hpp"
+
+// c
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANNEXB_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ANNEXB_NEON 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// project
+#include "ffmpeg_utils.hpp"
+#include "h26x_utils.hpp"
+#include "string_utils.hpp"
+#include "system_utils.hpp"
+#include "math_utils.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/mem.h>
+#include <libavutil/rational.h>
+#include <libavcodec/avcodec.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+static const uint8_t *find_start_code_scalar(const uint8_t *p, const uint8_t *end)
+{
+	for (; p + 3 <= end; p++) {
+		if (0 == p[0] && 0 == p[1] && 1 == p[2]) {
+			return p;
+		}
+	}
+	return end;
+}
+
+
+#if ANNEXB_SSE2
+static inline int lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+
+const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end)
+{
+	// 16 candidates per step, a candidate needs p[i + 2] so the last one reads p[17]
+#if ANNEXB_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	while (p + 18 <= end) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 1));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)));
+		while (mask != 0) {
+			int i = lowest_bit(mask);
+			if (1 == p[i + 2]) {
+				return p + i;
+			}
+			mask &= mask - 1;
+		}
+		p += 16;
+	}
+#elif ANNEXB_NEON
+	const uint8x16_t zero = vdupq_n_u8(0);
+	while (p + 18 <= end) {
+		uint8x16_t a = vld1q_u8(p);
+		uint8x16_t b = vld1q_u8(p + 1);
+		if (vmaxvq_u8(vandq_u8(vceqq_u8(a, zero), vceqq_u8(b, zero))) != 0) {
+			const uint8_t *found = find_start_code_scalar(p, p + 18);
+			if (found < p + 16) {
+				return found;
+			}
+		}
+		p += 16;
+	}
+#endif
+	return find_start_code_scalar(p, end);
+}
+
+
+// what a nal unit means for access unit boundaries
+struct NalInfo {
+	bool vcl;
+	bool first_slice;
+	bool starts_unit;
+	bool key;
+};
+
+
+static NalInfo classify_nal(int codec_id, const uint8_t *nal, const uint8_t *end)
+{
+	NalInfo info = { false, false, false, false };
+
+	if (AV_CODEC_ID_H264 == codec_id) {
+		if (nal + 2 > end) {
+			return info;
+		}
+
+		int type = nal[0] & 0x1f;
+		info.vcl = type >= 1 && type <= 5;
+		// first_mb_in_slice is ue(v), a leading 1 bit means 0
+		info.first_slice = info.vcl && (nal[1] & 0x80) != 0;
+		// sei, sps, pps, aud, 14-18
+		info.starts_unit = (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+		info.key = 5 == type;
+	}
+	else {
+		if (nal + 3 > end) {
+			return info;
+		}
+
+		int type = (nal[0] >> 1) & 0x3f;
+		info.vcl = type <= 31;
+		// first_slice_segment_in_pic_flag
+		info.first_slice = info.vcl && (nal[2] & 0x80) != 0;
+		// vps, sps, pps, aud, prefix sei, 41-44, 48-55
+		info.starts_unit = (type >= 32 && type <= 35) || 39 == type || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+		// bla, idr, cra
+		info.key = type >= 16 && type <= 23;
+	}
+
+	return info;
+}
+
+
+static void free_mapping(void *opaque, uint8_t *data)
+{
+	delete (MappedFile *)opaque;
+}
+
+
+
+FFmpegAnnexBFile::FFmpegAnnexBFile(std::string input_url, int limit_packets)
+	: m_input_url(input_url)
+	, m_limit_packets(limit_packets)
+	, m_mapping(nullptr)
+	, m_last(nullptr)
+	, m_codec_params(nullptr)
+	, m_codec_id(AV_CODEC_ID_NONE)
+	, m_width(-1)
+	, m_height(-1)
+	, m_fps(25.0)
+	, m_reorder_frames(1)
+{
+}
+
+
+FFmpegAnnexBFile::~FFmpegAnnexBFile()
+{
+	teardown();
+}
+
+
+bool FFmpegAnnexBFile::is_annexb(const std::string &input_url)
+{
+	return endswith(input_url, ".264") || endswith(input_url, ".h264") || endswith(input_url, ".avc")
+		|| endswith(input_url, ".265") || endswith(input_url, ".h265") || endswith(input_url, ".hevc");
+}
+
+
+bool FFmpegAnnexBFile::setup()
+{
+	if (m_mapping != nullptr) {
+		return true;
+	}
+
+	TimeIt ti;
+
+	do {
+		if (endswith(m_input_url, ".264") || endswith(m_input_url, ".h264") || endswith(m_input_url, ".avc")) {
+			m_codec_id = AV_CODEC_ID_H264;
+		}
+		else if (endswith(m_input_url, ".265") || endswith(m_input_url, ".h265") || endswith(m_input_url, ".hevc")) {
+			m_codec_id = AV_CODEC_ID_HEVC;
+		}
+		else {
+			SPDLOG_ERROR("not an annex-b elementary stream, m_input_url: {}", m_input_url);
+			break;
+		}
+
+		MappedFile *file = new MappedFile();
+		if (!file->open(m_input_url)) {
+			delete file;
+			break;
+		}
+
+		// packets are never written, the flag only documents it
+		m_mapping = av_buffer_create((uint8_t *)file->data(), file->size(), free_mapping, file, AV_BUFFER_FLAG_READONLY);
+		if (nullptr == m_mapping) {
+			SPDLOG_ERROR("av_buffer_create error, m_input_url: {}", m_input_url);
+			delete file;
+			break;
+		}
+
+		if (!split()) {
+			break;
+		}
+
+		if (!probe()) {
+			break;
+		}
+
+		if (!fill_codec_parameters()) {
+			break;
+		}
+
+		SPDLOG_INFO(
+			"annex-b input: {}, codec: {}, width: {}, height: {}, fps: {:.2f}, access units: {}, bytes: {}, setup: {:.2f} ms",
+			m_input_url, codec_name(), m_width, m_height, m_fps, m_units.size(), m_mapping->size, ti.elapsed_milliseconds()
+		);
+
+		return true;
+	} while (false);
+
+	teardown();
+
+	return false;
+}
+
+
+void FFmpegAnnexBFile::teardown()
+{
+	av_buffer_unref(&m_mapping);
+	av_buffer_unref(&m_last);
+	avcodec_parameters_free(&m_codec_params);
+	m_units.clear();
+}
+
+
+bool FFmpegAnnexBFile::split()
+{
+	const uint8_t *begin = m_mapping->data;
+	const uint8_t *end = begin + m_mapping->size;
+
+	bool has_unit = false;
+	bool seen_vcl = false;
+	AccessUnit unit = { 0, 0, false };
+
+	const uint8_t *p = find_start_code(begin, end);
+	while (p < end) {
+		const uint8_t *nal = p + 3;
+		const uint8_t *next = find_start_code(nal, end);
+
+		// the leading zero of a 4 byte start code belongs to this nal
+		size_t nal_offset = p - begin;
+		if (nal_offset > 0 && 0 == p[-1]) {
+			nal_offset--;
+		}
+
+		NalInfo info = classify_nal(m_codec_id, nal, next);
+
+		// a new picture starts at the first parameter set, sei, delimiter or slice after the previous picture's slices
+		if (seen_vcl && (info.starts_unit || info.first_slice)) {
+			unit.size = nal_offset - unit.offset;
+			m_units.push_back(unit);
+			has_unit = false;
+			seen_vcl = false;
+
+			if ((int64_t)m_units.size() >= m_limit_packets) {
+				break;
+			}
+		}
+
+		if (!has_unit) {
+			unit.offset = nal_offset;
+			unit.key = false;
+			has_unit = true;
+		}
+		if (info.vcl) {
+			unit.key = unit.key || info.key;
+			seen_vcl = true;
+		}
+
+		p = next;
+	}
+
+	if (has_unit && seen_vcl && (int64_t)m_units.size() < m_limit_packets) {
+		unit.size = m_mapping->size - unit.offset;
+		m_units.push_back(unit);
+	}
+
+	if (m_units.empty()) {
+		SPDLOG_ERROR("no access unit found, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	// decoders may read a little past the end, copy the last unit so it gets zeroed padding
+	const AccessUnit &last = m_units.back();
+	m_last = av_buffer_allocz(last.size + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (nullptr == m_last) {
+		SPDLOG_ERROR("av_buffer_allocz error, size: {}", last.size);
+		return false;
+	}
+	memcpy(m_last->data, begin + last.offset, last.size);
+
+	return true;
+}
+
+
+bool FFmpegAnnexBFile::probe()
+{
+	// parameter sets come first, they also carry the frame rate
+	for (size_t i = 0; i < m_units.size() && i < 16; i++) {
+		H26xStreamInfo info = { 0, 0, 0.0, 0 };
+		if (h26x_find_stream_info(m_codec_id, unit_data(i), m_units[i].size, info)) {
+			m_width = info.width;
+			m_height = info.height;
+			m_reorder_frames = info.reorder_frames;
+			if (info.fps > 0.0) {
+				m_fps = info.fps;
+			}
+			return true;
+		}
+	}
+
+	AVCodecParserContext *parser = av_parser_init(m_codec_id);
+	AVCodecContext *codec_context = avcodec_alloc_context3(nullptr);
+
+	do {
+		if (nullptr == parser || nullptr == codec_context) {
+			SPDLOG_ERROR("av_parser_init or avcodec_alloc_context3 error, codec: {}", codec_name());
+			break;
+		}
+
+		// every buffer is a whole access unit, the parser only reads headers
+		parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+
+		for (size_t i = 0; i < m_units.size() && i < 16; i++) {
+			uint8_t *out_data = nullptr;
+			int out_size = 0;
+			av_parser_parse2(parser, codec_context, &out_data, &out_size, unit_data(i), (int)m_units[i].size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+
+			if (parser->width > 0 && parser->height > 0) {
+				m_width = parser->width;
+				m_height = parser->height;
+				break;
+			}
+		}
+	} while (false);
+
+	if (parser != nullptr) {
+		av_parser_close(parser);
+	}
+	avcodec_free_context(&codec_context);
+
+	if (m_width <= 0 || m_height <= 0) {
+		SPDLOG_ERROR("can't find picture size in the first access units, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool FFmpegAnnexBFile::fill_codec_parameters()
+{
+	m_codec_params = avcodec_parameters_alloc();
+	if (nullptr == m_codec_params) {
+		SPDLOG_ERROR("avcodec_parameters_alloc error, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	m_codec_params->codec_type = AVMEDIA_TYPE_VIDEO;
+	m_codec_params->codec_id = (AVCodecID)m_codec_id;
+	m_codec_params->width = m_width;
+	m_codec_params->height = m_height;
+	m_codec_params->bit_rate = bit_rate();
+	m_codec_params->video_delay = m_reorder_frames;
+
+	// muxers turn annex-b extradata into avcC / hvcC themselves
+	std::vector<uint8_t> extradata;
+	for (size_t i = 0; i < m_units.size() && i < 16; i++) {
+		if (h26x_parameter_sets(m_codec_id, unit_data(i), m_units[i].size, extradata)) {
+			break;
+		}
+	}
+	if (extradata.empty()) {
+		SPDLOG_WARN("no parameter set in the first access units, the stream can't be remuxed, m_input_url: {}", m_input_url);
+		return true;
+	}
+
+	m_codec_params->extradata = (uint8_t *)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (nullptr == m_codec_params->extradata) {
+		SPDLOG_ERROR("av_mallocz error, size: {}", extradata.size());
+		return false;
+	}
+	memcpy(m_codec_params->extradata, extradata.data(), extradata.size());
+	m_codec_params->extradata_size = (int)extradata.size();
+
+	return true;
+}
+
+
+const uint8_t *FFmpegAnnexBFile::unit_data(size_t index)
+{
+	if (index + 1 == m_units.size()) {
+		return m_last->data;
+	}
+	return m_mapping->data + m_units[index].offset;
+}
+
+
+size_t FFmpegAnnexBFile::size()
+{
+	return m_units.size();
+}
+
+
+bool FFmpegAnnexBFile::packet(size_t index, FFmpegPacket &packet)
+{
+	AVPacket *pkt = packet.raw_ptr();
+	if (nullptr == pkt || index >= m_units.size()) {
+		return false;
+	}
+
+	av_packet_unref(pkt);
+
+	pkt->buf = av_buffer_ref(index + 1 == m_units.size() ? m_last : m_mapping);
+	if (nullptr == pkt->buf) {
+		SPDLOG_ERROR("av_buffer_ref error");
+		return false;
+	}
+
+	// decode order numbers, display order is only known after decoding so pts stays unset
+	// and the decoder and the sinks number what comes out
+	pkt->data = (uint8_t *)unit_data(index);
+	pkt->size = (int)m_units[index].size;
+	pkt->pts = AV_NOPTS_VALUE;
+	pkt->dts = (int64_t)index;
+	pkt->duration = 1;
+	if (m_units[index].key) {
+		pkt->flags |= AV_PKT_FLAG_KEY;
+	}
+
+	return true;
+}
+
+
+int FFmpegAnnexBFile::codec_id()
+{
+	return m_codec_id;
+}
+
+
+std::string FFmpegAnnexBFile::codec_name()
+{
+	return avcodec_get_name((AVCodecID)m_codec_id);
+}
+
+
+int FFmpegAnnexBFile::width()
+{
+	return m_width;
+}
+
+
+int FFmpegAnnexBFile::height()
+{
+	return m_height;
+}
+
+
+double FFmpegAnnexBFile::fps()
+{
+	return m_fps;
+}
+
+
+std::pair<int, int> FFmpegAnnexBFile::time_base()
+{
+	AVRational time_base = av_inv_q(av_d2q(m_fps, 1001000));
+	return std::make_pair(time_base.num, time_base.den);
+}
+
+
+int64_t FFmpegAnnexBFile::bit_rate()
+{
+	if (m_units.empty()) {
+		return 0;
+	}
+
+	int64_t bytes = 0;
+	for (const AccessUnit &unit : m_units) {
+		bytes += (int64_t)unit.size;
+	}
+	return (int64_t)(bytes * 8 * m_fps / m_units.size());
+}
+
+
+const AVCodecParameters *FFmpegAnnexBFile::codec_parameters()
+{
+	return m_codec_params;
+}
+
+
+
+FFmpegAnnexBSource::FFmpegAnnexBSource(std::shared_ptr<FFmpegAnnexBFile> file)
+	: m_file(file)
+	, m_index(0)
+{
+}
+
+
+bool FFmpegAnnexBSource::setup()
+{
+	m_index = 0;
+	return !m_current.is_null() && m_file->size() > 0;
+}
+
+
+void FFmpegAnnexBSource::teardown()
+{
+	m_current.free();
+}
+
+
+FFmpegPacket *FFmpegAnnexBSource::next()
+{
+	if (m_index >= m_file->size() || !m_file->packet(m_index, m_current)) {
+		return nullptr;
+	}
+
+	m_index++;
+	return &m_current;
+}
+
+
+bool FFmpegAnnexBSource::ready(std::function<void()> on_ready)
+{
+	return true;
+}
+
+
+int64_t FFmpegAnnexBSource::size()
+{
+	return (int64_t)m_file->size();
+}
+
+
+int64_t FFmpegAnnexBSource::bit_rate()
+{
+	return m_file->bit_rate();
+}
+
+
+double FFmpegAnnexBSource::fps()
+{
+	return m_file->fps();
+}
+
+
+std::pair<int, int> FFmpegAnnexBSource::time_base()
+{
+	return m_file->time_base();
+}
+
+
+const AVCodecParameters *FFmpegAnnexBSource::codec_parameters()
+{
+	return m_file->codec_parameters();
+}
+
+
+bool FFmpegAnnexBSource::has_pts()
+{
+	return false;
+}
+
+
+std::string FFmpegAnnexBSource::stats()
+{
+	return "";
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// c
+#include <limits.h>
+#include <stdint.h>
+
+// c++
+#include <memory>
+#include <string>
+#include <vector>
+
+// project
+#include "ffmpeg_demux.hpp"
+#include "ffmpeg_types.hpp"
+
+// ffmpeg
+struct AVBufferRef;
+struct AVCodecParameters;
+
+
+
+// first byte of the next 00 00 01 start code in [begin, end), end when there is none
+const uint8_t *find_start_code(const uint8_t *begin, const uint8_t *end);
+
+
+// raw h264/h265 annex-b file mapped into memory and split into access units once, shared read only by every channel
+// packets point straight into the mapping, so there is no probe and no per packet copy
+class FFmpegAnnexBFile {
+public:
+	FFmpegAnnexBFile(std::string input_url, int limit_packets = INT_MAX);
+	FFmpegAnnexBFile(const FFmpegAnnexBFile &other) = delete;
+	~FFmpegAnnexBFile();
+
+	// .264/.h264/.avc or .265/.h265/.hevc
+	static bool is_annexb(const std::string &input_url);
+
+	bool setup();
+	void teardown();
+
+	// access units
+	size_t size();
+
+	// make packet reference access unit index, the packet keeps the mapping alive
+	bool packet(size_t index, FFmpegPacket &packet);
+
+	int codec_id();
+	std::string codec_name();
+	int width();
+	int height();
+	double fps();
+
+	// access units carry no timestamps, packets get their decode order number as dts, 1 / fps
+	std::pair<int, int> time_base();
+
+	// from the access unit sizes at fps
+	int64_t bit_rate();
+
+	// codec, size, the parameter sets of the first access units as annex-b extradata, and the sps reorder depth as video_delay
+	const AVCodecParameters *codec_parameters();
+
+
+private:
+	struct AccessUnit {
+		size_t offset;
+		size_t size;
+		bool key;
+	};
+
+	bool split();
+	bool probe();
+	bool fill_codec_parameters();
+	const uint8_t *unit_data(size_t index);
+
+	std::string m_input_url;
+	int m_limit_packets;
+
+	AVBufferRef *m_mapping;
+
+	// the last access unit copied with padding, nothing readable follows it in the mapping
+	AVBufferRef *m_last;
+
+	std::vector<AccessUnit> m_units;
+
+	AVCodecParameters *m_codec_params;
+
+	int m_codec_id;
+	int m_width;
+	int m_height;
+	double m_fps;
+	int m_reorder_frames;
+};
+
+
+// one channel's cursor over a shared FFmpegAnnexBFile
+class FFmpegAnnexBSource : public FFmpegPacketSource {
+public:
+	FFmpegAnnexBSource(std::shared_ptr<FFmpegAnnexBFile> file);
+
+	bool setup() override;
+	void teardown() override;
+
+	FFmpegPacket *next() override;
+	bool ready(std::function<void()> on_ready) override;
+	int64_t size() override;
+	int64_t bit_rate() override;
+	double fps() override;
+	std::pair<int, int> time_base() override;
+	const AVCodecParameters *codec_parameters() override;
+	bool has_pts() override;
+	std::string stats() override;
+
+
+private:
+	std::shared_ptr<FFmpegAnnexBFile> m_file;
+	size_t m_index;
+	FFmpegPacket m_current;
+};
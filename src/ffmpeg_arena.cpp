@@ -0,0 +1,115 @@
+// self
+#include "ffmpeg_arena.hpp"
+
+// c
+#include <string.h>
+
+// c++
+#include <algorithm>
+
+// ffmpeg
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/macros.h>
+#include <libavcodec/avcodec.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+// every payload starts on a cache line
+static const size_t k_packet_alignment = 64;
+
+
+
+FFmpegPacketArena::FFmpegPacketArena(size_t chunk_size)
+    : m_chunk_size(chunk_size)
+    , m_chunk(nullptr)
+    , m_offset(0)
+    , m_chunks(0)
+    , m_bytes(0)
+    , m_packets(0)
+{
+}
+
+
+FFmpegPacketArena::~FFmpegPacketArena()
+{
+    av_buffer_unref(&m_chunk);
+}
+
+
+bool FFmpegPacketArena::store(FFmpegPacket &packet)
+{
+    AVPacket *pkt = packet.raw_ptr();
+    if (nullptr == pkt || pkt->size <= 0) {
+        return false;
+    }
+
+    // decoders may read past the end, keep the zeroed padding they expect
+    size_t need = FFALIGN((size_t)pkt->size + AV_INPUT_BUFFER_PADDING_SIZE, k_packet_alignment);
+    if (nullptr == m_chunk || m_offset + need > m_chunk->size) {
+        if (!grow(need)) {
+            return false;
+        }
+    }
+
+    AVBufferRef *view = av_buffer_ref(m_chunk);
+    if (nullptr == view) {
+        SPDLOG_ERROR("av_buffer_ref error");
+        return false;
+    }
+
+    uint8_t *data = m_chunk->data + m_offset;
+    memcpy(data, pkt->data, pkt->size);
+    memset(data + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    av_buffer_unref(&pkt->buf);
+    pkt->buf = view;
+    pkt->data = data;
+
+    m_offset += need;
+    m_bytes += pkt->size;
+    m_packets++;
+
+    return true;
+}
+
+
+size_t FFmpegPacketArena::chunks()
+{
+    return m_chunks;
+}
+
+
+size_t FFmpegPacketArena::bytes()
+{
+    return m_bytes;
+}
+
+
+size_t FFmpegPacketArena::packets()
+{
+    return m_packets;
+}
+
+
+bool FFmpegPacketArena::grow(size_t min_size)
+{
+    // packets already stored keep the old chunk alive
+    av_buffer_unref(&m_chunk);
+    m_offset = 0;
+
+    // av_malloc aligns the chunk itself
+    size_t size = std::max(m_chunk_size, min_size);
+    m_chunk = av_buffer_alloc(size);
+    if (nullptr == m_chunk) {
+        SPDLOG_ERROR("av_buffer_alloc error, size: {}", size);
+        return false;
+    }
+
+    m_chunks++;
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// c
+#include <stddef.h>
+
+// project
+#include "ffmpeg_types.hpp"
+
+// ffmpeg
+struct AVBufferRef;
+
+
+
+// copies packet payloads back to back into large chunks, every packet keeps a refcounted view of its chunk
+// a chunk is released once the arena and all packets in it are gone
+class FFmpegPacketArena {
+public:
+    FFmpegPacketArena(size_t chunk_size = 64 * 1024 * 1024);
+    FFmpegPacketArena(const FFmpegPacketArena &other) = delete;
+    ~FFmpegPacketArena();
+
+    // move the payload of packet into the arena, packet references the arena afterwards
+    bool store(FFmpegPacket &packet);
+
+    size_t chunks();
+    size_t bytes();
+    size_t packets();
+
+
+private:
+    bool grow(size_t min_size);
+
+    size_t m_chunk_size;
+    AVBufferRef *m_chunk;
+    size_t m_offset;
+
+    // statics
+    size_t m_chunks;
+    size_t m_bytes;
+    size_t m_packets;
+};
@@ -1,6 +1,9 @@
 // self
 #include "ffmpeg_decode.hpp"
 
+// c++
+#include <algorithm>
+
 // project
 #include "ffmpeg_utils.hpp"
 #include "ffmpeg_types.hpp"
@@ -12,15 +15,70 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// fmt
+#include <fmt/ranges.h>
+
 // spdlog
 #include <spdlog/spdlog.h>
 
 
 
+std::map<std::string, DecodeTier> DecodeTierCvt::s_map_string_to_enum{
+    { "full", DecodeTier::Full },
+    { "fast_nonref", DecodeTier::FastNonRef },
+    { "fast_all", DecodeTier::FastAll },
+};
+
+
+std::map<DecodeTier, std::string> DecodeTierCvt::s_map_enum_to_string{
+    { DecodeTier::Full, "full" },
+    { DecodeTier::FastNonRef, "fast_nonref" },
+    { DecodeTier::FastAll, "fast_all" },
+};
+
+
+DecodeTier DecodeTierCvt::from_string(std::string s)
+{
+    auto iter = s_map_string_to_enum.find(s);
+    if (iter != s_map_string_to_enum.end()) {
+        return iter->second;
+    }
+    return DecodeTier::Invalid;
+}
+
+
+std::string DecodeTierCvt::to_string(DecodeTier e)
+{
+    auto iter = s_map_enum_to_string.find(e);
+    if (iter != s_map_enum_to_string.end()) {
+        return iter->second;
+    }
+    return "";
+}
+
+
+std::string DecodeTierCvt::support_list()
+{
+    std::vector<std::string> result;
+    for (auto e = (uint8_t)DecodeTier::Invalid + 1; e <= (uint8_t)DecodeTier::FastAll; e++) {
+        result.push_back(to_string((DecodeTier)e));
+    }
+    return fmt::to_string(fmt::join(result, ", "));
+}
+
+
+
 FFmpegDecode::FFmpegDecode(std::string codec_name, int pixel_format)
     : m_codec_name(codec_name)
     , m_codec_context(nullptr)
     , m_pixel_format(pixel_format)
+    , m_skip_frame(AVDISCARD_DEFAULT)
+    , m_tier(DecodeTier::Full)
+    , m_threads(1)
+    , m_packet_time_base(0, 1)
+    , m_eof(false)
+    , m_packets_in(0)
+    , m_frames_out(0)
 {
 }
 
@@ -42,10 +100,35 @@ bool FFmpegDecode::setup() {
             break;
         }
 
+        m_codec_context->raw_ptr()->skip_frame = (enum AVDiscard)m_skip_frame;
+        if (m_packet_time_base.first > 0 && m_packet_time_base.second > 0) {
+            m_codec_context->raw_ptr()->pkt_timebase = AVRational{ m_packet_time_base.first, m_packet_time_base.second };
+        }
+
+        if (m_tier == DecodeTier::FastNonRef || m_tier == DecodeTier::FastAll) {
+            enum AVDiscard discard = m_tier == DecodeTier::FastAll ? AVDISCARD_ALL : AVDISCARD_NONREF;
+            m_codec_context->raw_ptr()->skip_loop_filter = discard;
+            m_codec_context->raw_ptr()->skip_idct = discard;
+        }
+        // codec wide, reference pictures would be touched too
+        if (m_tier == DecodeTier::FastAll) {
+            m_codec_context->raw_ptr()->flags2 |= AV_CODEC_FLAG2_FAST;
+        }
+
+        bool hardware = endswith(m_codec_name, "_qsv") || endswith(m_codec_name, "_cuvid") || endswith(m_codec_name, "_amf");
+        // h264 and hevc streams mostly carry 1 slice per picture, only frame threads scale
+        if (!hardware && m_threads > 1) {
+            m_codec_context->raw_ptr()->thread_type = FF_THREAD_FRAME;
+        }
+
         int code = 0;
         std::map<std::string, std::string> options;
+        if (!hardware) {
+            options.insert(std::make_pair("threads", std::to_string(m_threads)));
+        }
+
         if (m_codec_name == "libx264") {
-            options.insert(std::make_pair("threads", "1"));
+
         }
         else if (m_codec_name == "libx265") {
 
@@ -94,15 +177,45 @@ bool FFmpegDecode::send_packet(FFmpegPacket &packet) {
         SPDLOG_WARN("avcodec_send_packet error, code: {}, msg: {}", code, ffmpeg_error_str(code));
         return false;
     }
+    m_packets_in++;
+
+    return true;
+}
+
+
+bool FFmpegDecode::flush() {
+    int code = avcodec_send_packet(m_codec_context->raw_ptr(), nullptr);
+    if (code < 0 && code != AVERROR_EOF) {
+        SPDLOG_WARN("avcodec_send_packet(flush) error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        return false;
+    }
 
     return true;
 }
 
 
+bool FFmpegDecode::eof()
+{
+    return m_eof;
+}
+
+
+size_t FFmpegDecode::packets_in()
+{
+    return m_packets_in;
+}
+
+
+size_t FFmpegDecode::frames_out()
+{
+    return m_frames_out;
+}
+
+
 FFmpegFrame FFmpegDecode::receive_frame() {
     int code = 0;
     while (code >= 0) {
-        FFmpegFrame frame;
+        FFmpegFrame frame = m_frame_pool != nullptr ? m_frame_pool->acquire() : FFmpegFrame();
         if (frame.is_null()) {
             code = AVERROR(ENOMEM);
             return frame;
@@ -113,9 +226,15 @@ FFmpegFrame FFmpegDecode::receive_frame() {
             frame.need_more();
         }
         else if (code == AVERROR_EOF) {
+            m_eof = true;
+            frame.free();
         }
         else if (code < 0) {
             SPDLOG_WARN("avcodec_receive_frame error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+            frame.free();
+        }
+        else {
+            m_frames_out++;
         }
 
         return frame;
@@ -125,6 +244,36 @@ FFmpegFrame FFmpegDecode::receive_frame() {
 }
 
 
+void FFmpegDecode::set_frame_pool(std::shared_ptr<FFmpegFramePool> frame_pool)
+{
+    m_frame_pool = frame_pool;
+}
+
+
+void FFmpegDecode::set_skip_frame(int skip_frame)
+{
+    m_skip_frame = skip_frame;
+}
+
+
+void FFmpegDecode::set_tier(DecodeTier tier)
+{
+    m_tier = tier;
+}
+
+
+void FFmpegDecode::set_packet_time_base(std::pair<int, int> time_base)
+{
+    m_packet_time_base = time_base;
+}
+
+
+void FFmpegDecode::set_threads(int threads)
+{
+    m_threads = std::max(threads, 1);
+}
+
+
 int FFmpegDecode::pixel_format()
 {
     return m_codec_context->pixel_format();
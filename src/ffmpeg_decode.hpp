@@ -1,6 +1,11 @@
 #pragma once
 
+// c
+#include <stdint.h>
+
 // c++
+#include <map>
+#include <memory>
 #include <string>
 
 // project
@@ -8,6 +13,30 @@
 
 
 
+// how much of the reconstruction the decoder may skip: fast_nonref drops the loop filter and idct of non-reference pictures,
+// fast_all of every picture and also allows the decoder's non spec compliant speedups
+enum class DecodeTier : uint8_t {
+	Invalid,
+	Full,
+	FastNonRef,
+	FastAll,
+};
+
+
+class DecodeTierCvt {
+public:
+	static DecodeTier from_string(std::string s);
+	static std::string to_string(DecodeTier e);
+	static std::string support_list();
+
+
+private:
+	static std::map<std::string, DecodeTier> s_map_string_to_enum;
+	static std::map<DecodeTier, std::string> s_map_enum_to_string;
+};
+
+
+
 class FFmpegDecode {
 public:
 	FFmpegDecode(std::string codec_name, int pixel_format = 0);
@@ -17,8 +46,33 @@ public:
 	void teardown();
 
 	bool send_packet(FFmpegPacket &packet);
+
+	// one frame per call, call again until it needs more input, a packet may leave several frames behind
 	FFmpegFrame receive_frame();
 
+	// end of input, receive_frame then hands out every frame the decoder still holds until eof
+	bool flush();
+	bool eof();
+
+	// packets sent and frames received, equal after a flush unless frames were skipped
+	size_t packets_in();
+	size_t frames_out();
+
+	// received frames come from and go back to this pool
+	void set_frame_pool(std::shared_ptr<FFmpegFramePool> frame_pool);
+
+	// an AVDiscard set before setup, AVDISCARD_NONKEY decodes keyframes only
+	void set_skip_frame(int skip_frame);
+
+	// set before setup, fast_nonref only degrades pictures nothing references so errors don't propagate
+	void set_tier(DecodeTier tier);
+
+	// unit of the packet timestamps, set before setup so frames carry best effort timestamps in it
+	void set_packet_time_base(std::pair<int, int> time_base);
+
+	// software decoders only, set before setup, more than 1 decodes that many frames in parallel at that many frames of delay
+	void set_threads(int threads);
+
 	int pixel_format();
 	std::pair<int, int> pixel_aspect();
 	std::pair<int, int> time_base();
@@ -28,7 +82,18 @@ private:
 	std::string m_codec_name;
 
 	int m_pixel_format;
+	int m_skip_frame;
+	DecodeTier m_tier;
+	int m_threads;
+	std::pair<int, int> m_packet_time_base;
+	bool m_eof;
+
+	// statics
+	size_t m_packets_in;
+	size_t m_frames_out;
 
 	FFmpegCodecContext *m_codec_context;
+
+	std::shared_ptr<FFmpegFramePool> m_frame_pool;
 };
 
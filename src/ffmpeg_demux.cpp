@@ -1,9 +1,16 @@
 // self
 #include "ffmpeg_demux.hpp"
 
+// c
+#include <string.h>
+
+// c++
+#include <algorithm>
+
 // project
 #include "ffmpeg_utils.hpp"
 #include "ffmpeg_types.hpp"
+#include "h26x_utils.hpp"
 
 // ffmpeg
 extern "C" {
@@ -16,11 +23,18 @@ extern "C" {
 
 
 
-FFmpegDemux::FFmpegDemux(std::string input_url)
+// give up on the fast probe when no parameter set shows up in this many packets
+static const int k_fast_probe_packets = 64;
+
+
+
+FFmpegDemux::FFmpegDemux(std::string input_url, bool fast_probe)
 	: m_input_url(input_url)
+	, m_fast_probe(fast_probe)
 	, m_video_stream_index(-1)
 	, m_video_stream(nullptr)
 	, m_format_context(nullptr)
+	, m_codec_params(nullptr)
 	, m_codec_id(-1)
 	, m_width(-1)
 	, m_height(-1)
@@ -37,54 +51,32 @@ FFmpegDemux::~FFmpegDemux()
 
 bool FFmpegDemux::setup() {
 	int code = 0;
+	TimeIt ti;
 
 	do {
 		AVDictionary *options = 0;
 		av_dict_set(&options, "rtsp_transport", "tcp", 0);
 
 		code = avformat_open_input(&m_format_context, m_input_url.c_str(), NULL, &options);
+		av_dict_free(&options);
 		if (code < 0) {
 			SPDLOG_ERROR("avformat_open_input error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
 			break;
 		}
 
-		code = avformat_find_stream_info(m_format_context, NULL);
-		if (code < 0) {
-			SPDLOG_ERROR("avformat_find_stream_info error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
+		bool fast = m_fast_probe && fast_probe();
+		if (!fast && !full_probe()) {
 			break;
 		}
 
-		code = av_find_best_stream(m_format_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-		if (code < 0) {
-			SPDLOG_ERROR("av_find_best_stream error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
+		if (!copy_codec_parameters()) {
 			break;
 		}
 
-		m_video_stream_index = code;
-		m_video_stream = m_format_context->streams[m_video_stream_index];
-
-		AVCodecParameters *codec_params = m_video_stream->codecpar;
-		m_codec_id = (int)codec_params->codec_id;
-		m_width = codec_params->width;
-		m_height = codec_params->height;
-
-		if (m_video_stream->avg_frame_rate.num > 0 && m_video_stream->avg_frame_rate.den > 0) {
-			// fps
-			m_fps = av_q2d(m_video_stream->avg_frame_rate);
-		}
-		else if (m_video_stream->r_frame_rate.num > 0 && m_video_stream->r_frame_rate.den > 0) {
-			// tbr
-			m_fps = av_q2d(m_video_stream->r_frame_rate);
-		}
-		else if (m_video_stream->time_base.num > 0 && m_video_stream->time_base.den > 0) {
-			// tbn
-			m_fps = 1.0 / av_q2d(m_video_stream->time_base);
-		}
-		else {
-			// default
-			m_fps = 25.0;
-			SPDLOG_WARN("can't find fps from frame_rate and timebase, set default to 25.0");
-		}
+		SPDLOG_INFO(
+			"probe input: {}, fast: {}, codec: {}, width: {}, height: {}, fps: {:.2f}, probe: {:.2f} ms",
+			m_input_url, fast, codec_name(), m_width, m_height, m_fps, ti.elapsed_milliseconds()
+		);
 
 		return true;
 	} while (false);
@@ -95,20 +87,184 @@ bool FFmpegDemux::setup() {
 }
 
 
+bool FFmpegDemux::full_probe() {
+	int code = avformat_find_stream_info(m_format_context, NULL);
+	if (code < 0) {
+		SPDLOG_ERROR("avformat_find_stream_info error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
+		return false;
+	}
+
+	code = av_find_best_stream(m_format_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (code < 0) {
+		SPDLOG_ERROR("av_find_best_stream error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
+		return false;
+	}
+
+	m_video_stream_index = code;
+	m_video_stream = m_format_context->streams[m_video_stream_index];
+
+	AVCodecParameters *codec_params = m_video_stream->codecpar;
+	m_codec_id = (int)codec_params->codec_id;
+	m_width = codec_params->width;
+	m_height = codec_params->height;
+
+	if (m_video_stream->avg_frame_rate.num > 0 && m_video_stream->avg_frame_rate.den > 0) {
+		// fps
+		m_fps = av_q2d(m_video_stream->avg_frame_rate);
+	}
+	else if (m_video_stream->r_frame_rate.num > 0 && m_video_stream->r_frame_rate.den > 0) {
+		// tbr
+		m_fps = av_q2d(m_video_stream->r_frame_rate);
+	}
+	else if (m_video_stream->time_base.num > 0 && m_video_stream->time_base.den > 0) {
+		// tbn
+		m_fps = 1.0 / av_q2d(m_video_stream->time_base);
+	}
+	else {
+		// default
+		m_fps = 25.0;
+		SPDLOG_WARN("can't find fps from frame_rate and timebase, set default to 25.0");
+	}
+
+	return true;
+}
+
+
+bool FFmpegDemux::fast_probe() {
+	// streams that only show up while reading, like in ps, need the full probe
+	int code = av_find_best_stream(m_format_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (code < 0) {
+		SPDLOG_INFO("fast probe found no video stream, fall back to the full probe, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	AVStream *stream = m_format_context->streams[code];
+	AVCodecParameters *codec_params = stream->codecpar;
+	if (codec_params->codec_id != AV_CODEC_ID_H264 && codec_params->codec_id != AV_CODEC_ID_HEVC) {
+		SPDLOG_INFO("fast probe supports h264 and hevc only, fall back to the full probe, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	m_video_stream_index = code;
+	m_video_stream = stream;
+
+	H26xStreamInfo info = { codec_params->width, codec_params->height, 0.0, 0 };
+	bool found = info.width > 0 && info.height > 0;
+
+	// sdp sprop parameter sets end up in annex-b extradata
+	if (!found && codec_params->extradata != nullptr) {
+		found = h26x_find_stream_info(codec_params->codec_id, codec_params->extradata, codec_params->extradata_size, info);
+	}
+
+	// otherwise wait for the first in band parameter set, read packets are kept for read_frame
+	for (int i = 0; !found && i < k_fast_probe_packets; i++) {
+		FFmpegPacket packet = read_frame();
+		if (packet.is_null()) {
+			break;
+		}
+
+		found = h26x_find_stream_info(codec_params->codec_id, packet.raw_ptr()->data, packet.raw_ptr()->size, info);
+		m_probe_packets.push_back(std::move(packet));
+	}
+
+	if (!found) {
+		SPDLOG_INFO("fast probe found no parameter set in {} packets, fall back to the full probe, m_input_url: {}", m_probe_packets.size(), m_input_url);
+		m_video_stream_index = -1;
+		m_video_stream = nullptr;
+		return false;
+	}
+
+	m_codec_id = (int)codec_params->codec_id;
+	m_width = info.width;
+	m_height = info.height;
+
+	if (info.fps > 0.0) {
+		// vui timing
+		m_fps = info.fps;
+	}
+	else if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+		m_fps = av_q2d(stream->avg_frame_rate);
+	}
+	else if (stream->r_frame_rate.num > 0 && stream->r_frame_rate.den > 0) {
+		m_fps = av_q2d(stream->r_frame_rate);
+	}
+	else {
+		m_fps = 25.0;
+		SPDLOG_WARN("can't find fps in the parameter sets or stream, set default to 25.0");
+	}
+
+	return true;
+}
+
+
+bool FFmpegDemux::copy_codec_parameters() {
+	m_codec_params = avcodec_parameters_alloc();
+	if (nullptr == m_codec_params) {
+		SPDLOG_ERROR("avcodec_parameters_alloc error, m_input_url: {}", m_input_url);
+		return false;
+	}
+
+	// a copy, the demux thread keeps reading while channels open their sinks
+	int code = avcodec_parameters_copy(m_codec_params, m_video_stream->codecpar);
+	if (code < 0) {
+		SPDLOG_ERROR("avcodec_parameters_copy error, code: {}, msg: {}, m_input_url: {}", code, ffmpeg_error_str(code), m_input_url);
+		return false;
+	}
+	m_codec_params->width = m_width;
+	m_codec_params->height = m_height;
+
+	// the fast probe leaves in band parameter sets in the packets it read, collect them as annex-b extradata
+	if (m_codec_params->extradata_size <= 0) {
+		std::vector<uint8_t> extradata;
+		for (FFmpegPacket &packet : m_probe_packets) {
+			if (h26x_parameter_sets(m_codec_id, packet.raw_ptr()->data, packet.raw_ptr()->size, extradata)) {
+				break;
+			}
+		}
+
+		if (!extradata.empty()) {
+			m_codec_params->extradata = (uint8_t *)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+			if (nullptr == m_codec_params->extradata) {
+				SPDLOG_ERROR("av_mallocz error, size: {}", extradata.size());
+				return false;
+			}
+			memcpy(m_codec_params->extradata, extradata.data(), extradata.size());
+			m_codec_params->extradata_size = (int)extradata.size();
+		}
+	}
+
+	// the fast probe opens no decoder, the reorder depth comes from the annex-b sps
+	H26xStreamInfo info = { 0, 0, 0.0, 0 };
+	if (m_codec_params->extradata_size > 0 && h26x_find_stream_info(m_codec_id, m_codec_params->extradata, m_codec_params->extradata_size, info)) {
+		m_codec_params->video_delay = std::max(m_codec_params->video_delay, info.reorder_frames);
+	}
+
+	return true;
+}
+
+
 void FFmpegDemux::teardown()
 {
 	if (m_format_context != nullptr) {
 		avformat_close_input(&m_format_context);
 	}
 	m_format_context = nullptr;
+	avcodec_parameters_free(&m_codec_params);
 
 	m_video_stream_index = -1;
 	m_video_stream = nullptr;
+	m_probe_packets.clear();
 	m_input_url.clear();
 }
 
 
 FFmpegPacket FFmpegDemux::read_frame() {
+	if (!m_probe_packets.empty()) {
+		FFmpegPacket probe_packet = std::move(m_probe_packets.front());
+		m_probe_packets.pop_front();
+		return probe_packet;
+	}
+
 	FFmpegPacket packet;
 	if (packet.is_null()) {
 		return packet;
@@ -129,7 +285,7 @@ FFmpegPacket FFmpegDemux::read_frame() {
 }
 
 
-std::vector<FFmpegPacket> FFmpegDemux::read_some_frames(int limit_packets)
+std::vector<FFmpegPacket> FFmpegDemux::read_some_frames(int limit_packets, FFmpegPacketArena *arena)
 {
 	std::vector<FFmpegPacket> vec;
 
@@ -139,6 +295,10 @@ std::vector<FFmpegPacket> FFmpegDemux::read_some_frames(int limit_packets)
 			break;
 		}
 
+		if (arena != nullptr && !arena->store(packet)) {
+			SPDLOG_WARN("packet arena store failed, keep the demuxed buffer, packet: {}", i);
+		}
+
 		vec.push_back(std::move(packet));
 	}
 
@@ -175,3 +335,307 @@ double FFmpegDemux::fps()
 	return m_fps;
 }
 
+
+std::pair<int, int> FFmpegDemux::time_base()
+{
+	if (m_video_stream != nullptr && m_video_stream->time_base.num > 0 && m_video_stream->time_base.den > 0) {
+		return std::make_pair(m_video_stream->time_base.num, m_video_stream->time_base.den);
+	}
+
+	AVRational time_base = av_inv_q(av_d2q(m_fps, 1001000));
+	return std::make_pair(time_base.num, time_base.den);
+}
+
+
+int64_t FFmpegDemux::bit_rate()
+{
+	if (m_video_stream != nullptr && m_video_stream->codecpar->bit_rate > 0) {
+		return m_video_stream->codecpar->bit_rate;
+	}
+	if (m_format_context != nullptr && m_format_context->bit_rate > 0) {
+		return m_format_context->bit_rate;
+	}
+	return 0;
+}
+
+
+int64_t FFmpegDemux::input_size()
+{
+	if (nullptr == m_format_context || nullptr == m_format_context->pb) {
+		return -1;
+	}
+
+	int64_t size = avio_size(m_format_context->pb);
+	return size > 0 ? size : -1;
+}
+
+
+const AVCodecParameters *FFmpegDemux::codec_parameters()
+{
+	return m_codec_params;
+}
+
+
+bool FFmpegDemux::has_pts()
+{
+	return m_format_context != nullptr && !(m_format_context->iformat->flags & AVFMT_NOTIMESTAMPS);
+}
+
+
+
+
+FFmpegPacketVector::FFmpegPacketVector(
+	std::vector<FFmpegPacket> &packets, double fps, std::pair<int, int> time_base, const AVCodecParameters *codecpar, bool has_pts
+)
+	: m_packets(packets)
+	, m_index(0)
+	, m_fps(fps > 0.0 ? fps : 25.0)
+	, m_time_base(time_base)
+	, m_codecpar(codecpar)
+	, m_has_pts(has_pts)
+{
+}
+
+
+bool FFmpegPacketVector::setup()
+{
+	m_index = 0;
+	return true;
+}
+
+
+void FFmpegPacketVector::teardown()
+{
+}
+
+
+FFmpegPacket *FFmpegPacketVector::next()
+{
+	if (m_index >= m_packets.size()) {
+		return nullptr;
+	}
+
+	return &m_packets[m_index++];
+}
+
+
+bool FFmpegPacketVector::ready(std::function<void()> on_ready)
+{
+	return true;
+}
+
+
+int64_t FFmpegPacketVector::size()
+{
+	return (int64_t)m_packets.size();
+}
+
+
+int64_t FFmpegPacketVector::bit_rate()
+{
+	if (m_packets.empty()) {
+		return 0;
+	}
+
+	int64_t bytes = 0;
+	for (FFmpegPacket &packet : m_packets) {
+		bytes += packet.raw_ptr()->size;
+	}
+	return (int64_t)(bytes * 8 * m_fps / m_packets.size());
+}
+
+
+double FFmpegPacketVector::fps()
+{
+	return m_fps;
+}
+
+
+std::pair<int, int> FFmpegPacketVector::time_base()
+{
+	return m_time_base;
+}
+
+
+const AVCodecParameters *FFmpegPacketVector::codec_parameters()
+{
+	return m_codecpar;
+}
+
+
+bool FFmpegPacketVector::has_pts()
+{
+	return m_has_pts;
+}
+
+
+std::string FFmpegPacketVector::stats()
+{
+	return "";
+}
+
+
+
+FFmpegDemuxStream::FFmpegDemuxStream(std::string input_url, int queue_depth, int limit_packets, bool fast_probe)
+	: m_demux(input_url, fast_probe)
+	, m_limit_packets(limit_packets)
+	, m_queue(queue_depth > 0 ? queue_depth : 1)
+	, m_current(nullptr)
+	, m_packets(0)
+	, m_ma50_demux_packet(50)
+	, m_ma50_queue(50)
+{
+}
+
+
+FFmpegDemuxStream::~FFmpegDemuxStream()
+{
+	teardown();
+}
+
+
+bool FFmpegDemuxStream::setup()
+{
+	if (m_thread.joinable()) {
+		return true;
+	}
+
+	if (!m_demux.setup()) {
+		return false;
+	}
+
+	m_thread = std::thread(&FFmpegDemuxStream::work, this);
+
+	return true;
+}
+
+
+void FFmpegDemuxStream::teardown()
+{
+	// a blocked push returns once the ring is closed
+	m_queue.close();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+
+	m_demux.teardown();
+
+	// the callback may hold the channel, don't keep it alive
+	std::lock_guard<std::mutex> lock(m_ready_mutex);
+	m_on_ready = nullptr;
+}
+
+
+void FFmpegDemuxStream::work()
+{
+	for (int i = 0; i < m_limit_packets; i++) {
+		TimeIt ti_step;
+
+		FFmpegPacket packet = m_demux.read_frame();
+		if (packet.is_null()) {
+			break;
+		}
+
+		double demux_elasped_ms = ti_step.elapsed_milliseconds();
+		m_ma50_demux_packet.add(demux_elasped_ms);
+		m_percentile_demux.add(demux_elasped_ms);
+
+		if (!m_queue.push(packet)) {
+			break;
+		}
+		notify_ready();
+	}
+
+	m_queue.close();
+	notify_ready();
+}
+
+
+void FFmpegDemuxStream::notify_ready()
+{
+	std::function<void()> on_ready;
+	{
+		std::lock_guard<std::mutex> lock(m_ready_mutex);
+		on_ready = std::move(m_on_ready);
+		m_on_ready = nullptr;
+	}
+
+	if (on_ready) {
+		on_ready();
+	}
+}
+
+
+FFmpegPacket *FFmpegDemuxStream::next()
+{
+	// occupancy seen by the decoder, near empty means demux is the bottleneck
+	m_ma50_queue.add((double)m_queue.size());
+	if (!m_queue.pop(m_current)) {
+		return nullptr;
+	}
+
+	m_packets++;
+	return &m_current;
+}
+
+
+bool FFmpegDemuxStream::ready(std::function<void()> on_ready)
+{
+	if (m_queue.size() > 0 || m_queue.is_closed()) {
+		return true;
+	}
+
+	// checked again under the lock, a push before it is seen here and a push after it finds the callback
+	std::lock_guard<std::mutex> lock(m_ready_mutex);
+	if (m_queue.size() > 0 || m_queue.is_closed()) {
+		return true;
+	}
+	m_on_ready = std::move(on_ready);
+	return false;
+}
+
+
+int64_t FFmpegDemuxStream::size()
+{
+	return -1;
+}
+
+
+int64_t FFmpegDemuxStream::bit_rate()
+{
+	return m_demux.bit_rate();
+}
+
+
+double FFmpegDemuxStream::fps()
+{
+	return m_demux.fps();
+}
+
+
+std::pair<int, int> FFmpegDemuxStream::time_base()
+{
+	return m_demux.time_base();
+}
+
+
+const AVCodecParameters *FFmpegDemuxStream::codec_parameters()
+{
+	return m_demux.codec_parameters();
+}
+
+
+bool FFmpegDemuxStream::has_pts()
+{
+	return m_demux.has_pts();
+}
+
+
+std::string FFmpegDemuxStream::stats()
+{
+	return fmt::format(
+		"packets: {}, ma50_demux_packet: {:.2f} (90%th={:.2f}) ms/packet, packet_queue: {:.2f}/{} (full_waits={}, empty_waits={})",
+		m_packets, m_ma50_demux_packet.calc(), m_percentile_demux.calc(0.9),
+		m_ma50_queue.calc(), m_queue.capacity(), m_queue.full_waits(), m_queue.empty_waits()
+	);
+}
@@ -4,28 +4,40 @@
 #include <limits.h>
 
 // c++
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 // project
+#include "ffmpeg_arena.hpp"
 #include "ffmpeg_types.hpp"
+#include "math_utils.hpp"
+#include "spsc_queue.hpp"
 
 // ffmpeg
 struct AVStream;
-struct AVFormatContext;;
+struct AVFormatContext;
+struct AVCodecParameters;
 
 
 
 class FFmpegDemux {
 public:
-	FFmpegDemux(std::string input_url);
+	// fast_probe reads the stream parameters from the first sps instead of avformat_find_stream_info
+	FFmpegDemux(std::string input_url, bool fast_probe = false);
 	~FFmpegDemux();
 
 	bool setup();
 	void teardown();
 
 	FFmpegPacket read_frame();
-	std::vector<FFmpegPacket> read_some_frames(int limit_packets = INT_MAX);
+
+	// payloads are copied into arena when given, otherwise every packet keeps its own buffer
+	std::vector<FFmpegPacket> read_some_frames(int limit_packets = INT_MAX, FFmpegPacketArena *arena = nullptr);
 
 	int codec_id();
 	std::string codec_name();
@@ -33,14 +45,38 @@ public:
 	int height();
 	double fps();
 
+	// unit of the packet timestamps
+	std::pair<int, int> time_base();
+
+	// bits per second from the container or the stream header, 0 when neither has it
+	int64_t bit_rate();
+
+	// bytes of the input, -1 when unknown like for live streams
+	int64_t input_size();
+
+	// copy of the video stream's parameters taken after probing, extradata carries the parameter sets when any were found
+	const AVCodecParameters *codec_parameters();
+
+	// false for raw elementary streams, their packets come in decode order without pts
+	bool has_pts();
+
 
 private:
+	bool full_probe();
+	bool fast_probe();
+	bool copy_codec_parameters();
+
 	std::string m_input_url;
+	bool m_fast_probe;
+
+	// packets read while probing, read_frame hands them out first
+	std::deque<FFmpegPacket> m_probe_packets;
 
 	int m_video_stream_index;
 	AVStream *m_video_stream;
 
 	AVFormatContext *m_format_context;
+	AVCodecParameters *m_codec_params;
 
 	int m_codec_id;
 	int m_width;
@@ -48,3 +84,123 @@ private:
 	double m_fps;
 };
 
+
+
+// packets of one channel, the decoder reads them in order
+class FFmpegPacketSource {
+public:
+	virtual ~FFmpegPacketSource() = default;
+
+	virtual bool setup() = 0;
+	virtual void teardown() = 0;
+
+	// next packet, valid until the following call, nullptr at the end of input
+	virtual FFmpegPacket *next() = 0;
+
+	// whether next returns without waiting, when it would wait on_ready is called once, possibly from another thread,
+	// as soon as it no longer does, so a scheduled channel parks instead of polling
+	virtual bool ready(std::function<void()> on_ready) = 0;
+
+	// total packets, -1 when unknown up front
+	virtual int64_t size() = 0;
+
+	// input bits per second, 0 when unknown
+	virtual int64_t bit_rate() = 0;
+
+	// input frames per second
+	virtual double fps() = 0;
+
+	// unit of the packet timestamps, packets without any are counted in frames at this unit
+	virtual std::pair<int, int> time_base() = 0;
+
+	// what a muxer needs to take the packets as they are, extradata empty when the input has no parameter sets, nullptr when unknown
+	virtual const AVCodecParameters *codec_parameters() = 0;
+
+	// whether packets carry presentation timestamps, without them a muxer can only number packets in decode order
+	virtual bool has_pts() = 0;
+
+	// demux stage statics, empty when nothing is measured
+	virtual std::string stats() = 0;
+};
+
+
+typedef std::function<std::shared_ptr<FFmpegPacketSource>()> FFmpegPacketSourceMaker;
+
+
+// packets loaded before the test and shared by every channel, demux cost is not measured
+// packets and codecpar are owned by the caller and outlive the vector
+class FFmpegPacketVector : public FFmpegPacketSource {
+public:
+	FFmpegPacketVector(
+		std::vector<FFmpegPacket> &packets, double fps = 25.0, std::pair<int, int> time_base = std::make_pair(1, 25),
+		const AVCodecParameters *codecpar = nullptr, bool has_pts = true
+	);
+
+	bool setup() override;
+	void teardown() override;
+
+	FFmpegPacket *next() override;
+	bool ready(std::function<void()> on_ready) override;
+	int64_t size() override;
+	int64_t bit_rate() override;
+	double fps() override;
+	std::pair<int, int> time_base() override;
+	const AVCodecParameters *codec_parameters() override;
+	bool has_pts() override;
+	std::string stats() override;
+
+
+private:
+	std::vector<FFmpegPacket> &m_packets;
+	size_t m_index;
+	double m_fps;
+	std::pair<int, int> m_time_base;
+	const AVCodecParameters *m_codecpar;
+	bool m_has_pts;
+};
+
+
+// every channel demuxes on its own thread into a bounded ring, the demux thread waits when the ring is full
+class FFmpegDemuxStream : public FFmpegPacketSource {
+public:
+	FFmpegDemuxStream(std::string input_url, int queue_depth, int limit_packets = INT_MAX, bool fast_probe = false);
+	FFmpegDemuxStream(const FFmpegDemuxStream &other) = delete;
+	~FFmpegDemuxStream();
+
+	bool setup() override;
+	void teardown() override;
+
+	FFmpegPacket *next() override;
+	bool ready(std::function<void()> on_ready) override;
+	int64_t size() override;
+	int64_t bit_rate() override;
+	double fps() override;
+	std::pair<int, int> time_base() override;
+	const AVCodecParameters *codec_parameters() override;
+	bool has_pts() override;
+	std::string stats() override;
+
+
+private:
+	void work();
+
+	// demux thread, hands the parked consumer's callback back after a push or the close
+	void notify_ready();
+
+	FFmpegDemux m_demux;
+	int m_limit_packets;
+
+	SpscQueue<FFmpegPacket> m_queue;
+	std::thread m_thread;
+	FFmpegPacket m_current;
+
+	// set while the consumer is parked on an empty ring
+	std::mutex m_ready_mutex;
+	std::function<void()> m_on_ready;
+
+	// statics, demux side is read after the thread is joined
+	size_t m_packets;
+	MovingAverage m_ma50_demux_packet;
+	Percentile m_percentile_demux;
+	MovingAverage m_ma50_queue;
+};
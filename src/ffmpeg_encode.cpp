@@ -1,6 +1,9 @@
 // self
 #include "ffmpeg_encode.hpp"
 
+// c++
+#include <algorithm>
+
 // project
 #include "ffmpeg_utils.hpp"
 #include "ffmpeg_types.hpp"
@@ -23,6 +26,14 @@ FFmpegEncode::FFmpegEncode(std::string codec_name, int width, int height, int64_
     , m_height(height)
     , m_bitrate(bitrate)
     , m_pixel_format(pixel_format)
+    , m_frame_rate(25.0)
+    , m_time_base(0, 1)
+    , m_gop_size(0)
+    , m_threads(1)
+    , m_global_header(false)
+    , m_eof(false)
+    , m_frames_in(0)
+    , m_packets_out(0)
     , m_codec_context(nullptr)
 {
 }
@@ -48,12 +59,17 @@ bool FFmpegEncode::setup(AVBufferRef *hw_frames_context) {
         m_codec_context->raw_ptr()->pix_fmt = (enum AVPixelFormat)m_pixel_format;
         m_codec_context->raw_ptr()->width = m_width;
         m_codec_context->raw_ptr()->height = m_height;
-        m_codec_context->raw_ptr()->time_base = { 1, 25 };
-        m_codec_context->raw_ptr()->framerate = { 25, 1 };
+        AVRational frame_rate = av_d2q(m_frame_rate, 1001000);
+        bool has_time_base = m_time_base.first > 0 && m_time_base.second > 0;
+        m_codec_context->raw_ptr()->time_base = has_time_base ? AVRational{ m_time_base.first, m_time_base.second } : av_inv_q(frame_rate);
+        m_codec_context->raw_ptr()->framerate = frame_rate;
         m_codec_context->raw_ptr()->bit_rate = m_bitrate;
         m_codec_context->raw_ptr()->bit_rate_tolerance = (int)(m_bitrate / 4);
-        m_codec_context->raw_ptr()->gop_size = 50;
+        m_codec_context->raw_ptr()->gop_size = m_gop_size > 0 ? m_gop_size : std::max((int)(m_frame_rate * 2.0 + 0.5), 1);
         m_codec_context->raw_ptr()->max_b_frames = 0;
+        if (m_global_header) {
+            m_codec_context->raw_ptr()->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
 
         if (hw_frames_context != nullptr) {
             m_codec_context->raw_ptr()->hw_frames_ctx = av_buffer_ref(hw_frames_context);
@@ -62,9 +78,10 @@ bool FFmpegEncode::setup(AVBufferRef *hw_frames_context) {
         int code = 0;
         std::map<std::string, std::string> options;
         if (m_codec_name == "libx264" || m_codec_name == "libx265") {
-            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", "ultrafast", 0);
+            std::string preset = m_preset.empty() ? "ultrafast" : m_preset;
+            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", preset.c_str(), 0);
             if (code < 0) {
-                SPDLOG_ERROR("av_opt_set(preset, ultrafast) error, code: {}, msg: {}, m_encoder_name: {}", code, ffmpeg_error_str(code), m_codec_name);
+                SPDLOG_ERROR("av_opt_set(preset, {}) error, code: {}, msg: {}, m_encoder_name: {}", preset, code, ffmpeg_error_str(code), m_codec_name);
             }
 
             code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "tune", "zerolatency", 0);
@@ -72,16 +89,22 @@ bool FFmpegEncode::setup(AVBufferRef *hw_frames_context) {
                 SPDLOG_ERROR("av_opt_set(tune, zerolatency) error, code: {}, msg: {}, m_encoder_name: {}", code, ffmpeg_error_str(code), m_codec_name);
             }
 
+            // x264 sliced threads, x265 wavefront rows on a pool of that size
             if (m_codec_name == "libx265") {
-                av_opt_set(m_codec_context->raw_ptr()->priv_data, "x265-params", "threads=1", 0);
+                std::string params = m_threads > 1 ? fmt::format("pools={}", m_threads) : "threads=1";
+                av_opt_set(m_codec_context->raw_ptr()->priv_data, "x265-params", params.c_str(), 0);
+            }
+            else {
+                m_codec_context->raw_ptr()->thread_type = FF_THREAD_SLICE;
             }
 
-            options.insert(std::make_pair("threads", "1"));
+            options.insert(std::make_pair("threads", std::to_string(m_threads)));
         }
         else if (endswith(m_codec_name, "_qsv")) {
-            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", "fast", 0);
+            std::string preset = m_preset.empty() ? "fast" : m_preset;
+            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", preset.c_str(), 0);
             if (code < 0) {
-                SPDLOG_ERROR("av_opt_set(preset, fast) error, code: {}, msg: {}, m_encoder_name: {}", code, ffmpeg_error_str(code), m_codec_name);
+                SPDLOG_ERROR("av_opt_set(preset, {}) error, code: {}, msg: {}, m_encoder_name: {}", preset, code, ffmpeg_error_str(code), m_codec_name);
             }
 
             code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "async_depth", "1", 0);
@@ -90,9 +113,10 @@ bool FFmpegEncode::setup(AVBufferRef *hw_frames_context) {
             }
         }
         else if (endswith(m_codec_name, "_nvenc")) {
-            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", "ll", 0);
+            std::string preset = m_preset.empty() ? "ll" : m_preset;
+            code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "preset", preset.c_str(), 0);
             if (code < 0) {
-                SPDLOG_ERROR("av_opt_set(preset, ll) error, code: {}, msg: {}, m_encoder_name: {}", code, ffmpeg_error_str(code), m_codec_name);
+                SPDLOG_ERROR("av_opt_set(preset, {}) error, code: {}, msg: {}, m_encoder_name: {}", preset, code, ffmpeg_error_str(code), m_codec_name);
             }
 
             code = av_opt_set(m_codec_context->raw_ptr()->priv_data, "tune", "ll", 0);
@@ -145,15 +169,51 @@ bool FFmpegEncode::send_frame(FFmpegFrame &frame) {
         SPDLOG_WARN("avcodec_send_frame error, code: {}, msg: {}", code, ffmpeg_error_str(code));
         return false;
     }
+    m_frames_in++;
 
     return true;
 }
 
 
+bool FFmpegEncode::flush() {
+    // an encoder that never got a frame was never opened
+    if (nullptr == m_codec_context) {
+        m_eof = true;
+        return true;
+    }
+
+    int code = avcodec_send_frame(m_codec_context->raw_ptr(), nullptr);
+    if (code < 0 && code != AVERROR_EOF) {
+        SPDLOG_WARN("avcodec_send_frame(flush) error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        return false;
+    }
+
+    return true;
+}
+
+
+bool FFmpegEncode::eof()
+{
+    return m_eof;
+}
+
+
+size_t FFmpegEncode::frames_in()
+{
+    return m_frames_in;
+}
+
+
+size_t FFmpegEncode::packets_out()
+{
+    return m_packets_out;
+}
+
+
 FFmpegPacket FFmpegEncode::receive_packet() {
     int code = 0;
     while (code >= 0) {
-        FFmpegPacket packet;
+        FFmpegPacket packet = m_packet_pool != nullptr ? m_packet_pool->acquire() : FFmpegPacket();
         if (packet.is_null()) {
             code = AVERROR(ENOMEM);
             return packet;
@@ -164,9 +224,15 @@ FFmpegPacket FFmpegEncode::receive_packet() {
             packet.need_more();
         }
         else if (code == AVERROR_EOF) {
+            m_eof = true;
+            packet.free();
         }
         else if (code < 0) {
             SPDLOG_WARN("avcodec_receive_packet error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+            packet.free();
+        }
+        else {
+            m_packets_out++;
         }
 
         return packet;
@@ -175,3 +241,92 @@ FFmpegPacket FFmpegEncode::receive_packet() {
     return FFmpegPacket(nullptr);
 }
 
+
+void FFmpegEncode::set_packet_pool(std::shared_ptr<FFmpegPacketPool> packet_pool)
+{
+    m_packet_pool = packet_pool;
+}
+
+
+void FFmpegEncode::set_frame_rate(double fps)
+{
+    if (fps > 0.0) {
+        m_frame_rate = fps;
+    }
+}
+
+
+void FFmpegEncode::set_time_base(std::pair<int, int> time_base)
+{
+    m_time_base = time_base;
+}
+
+
+void FFmpegEncode::set_preset(std::string preset)
+{
+    m_preset = preset;
+}
+
+
+void FFmpegEncode::set_gop_size(int gop_size)
+{
+    m_gop_size = gop_size;
+}
+
+
+void FFmpegEncode::set_threads(int threads)
+{
+    m_threads = std::max(threads, 1);
+}
+
+
+void FFmpegEncode::set_global_header(bool global_header)
+{
+    m_global_header = global_header;
+}
+
+
+bool FFmpegEncode::codec_parameters(AVCodecParameters *codecpar)
+{
+    if (nullptr == m_codec_context) {
+        return false;
+    }
+
+    int code = avcodec_parameters_from_context(codecpar, m_codec_context->raw_ptr());
+    if (code < 0) {
+        SPDLOG_ERROR("avcodec_parameters_from_context error, code: {}, msg: {}, m_encoder_name: {}", code, ffmpeg_error_str(code), m_codec_name);
+        return false;
+    }
+
+    return true;
+}
+
+
+std::pair<int, int> FFmpegEncode::time_base()
+{
+    if (nullptr == m_codec_context) {
+        return std::make_pair(0, 1);
+    }
+
+    return std::make_pair(m_codec_context->raw_ptr()->time_base.num, m_codec_context->raw_ptr()->time_base.den);
+}
+
+
+int FFmpegEncode::inflight_frames()
+{
+    // x264/x265 copy the picture in, nvenc with delay=0 copies into its input surfaces
+    if (m_codec_name == "libx264" || m_codec_name == "libx265" || endswith(m_codec_name, "_nvenc")) {
+        return 0;
+    }
+
+    // qsv holds async_depth surfaces, setup asks for 1 but read back what the encoder took
+    if (endswith(m_codec_name, "_qsv") && nullptr != m_codec_context) {
+        int64_t async_depth = 1;
+        if (av_opt_get_int(m_codec_context->raw_ptr()->priv_data, "async_depth", 0, &async_depth) >= 0) {
+            return (int)std::max<int64_t>(async_depth, 1);
+        }
+    }
+
+    // others may queue the last frame until the next one arrives
+    return 1;
+}
@@ -4,11 +4,16 @@
 #include <stdint.h>
 
 // c++
+#include <memory>
 #include <string>
+#include <utility>
 
 // project
 #include "ffmpeg_types.hpp"
 
+// ffmpeg
+struct AVCodecParameters;
+
 
 
 class FFmpegEncode {
@@ -20,8 +25,46 @@ public:
     void teardown();
 
     bool send_frame(FFmpegFrame &frame);
+
+    // one packet per call, call again until it needs more input
     FFmpegPacket receive_packet();
 
+    // end of input, receive_packet then hands out every packet the encoder still holds until eof
+    bool flush();
+    bool eof();
+
+    // frames sent and packets received, equal after a flush
+    size_t frames_in();
+    size_t packets_out();
+
+    // received packets come from and go back to this pool
+    void set_packet_pool(std::shared_ptr<FFmpegPacketPool> packet_pool);
+
+    // frames per second rate control budgets for and the gop spans 2 seconds of, set before setup (default 25)
+    void set_frame_rate(double fps);
+
+    // unit of the sent frames' timestamps, packets come out in it, set before setup (default 1 / frame rate)
+    void set_time_base(std::pair<int, int> time_base);
+
+    // preset of the x264, x265, qsv or nvenc encoder, set before setup, empty keeps ultrafast, fast and ll
+    void set_preset(std::string preset);
+
+    // frames between keyframes, set before setup, 0 spans 2 seconds at the frame rate
+    void set_gop_size(int gop_size);
+
+    // software encoders only, set before setup, zerolatency keeps frame threads off so these split every picture
+    void set_threads(int threads);
+
+    // mp4 and flv want the parameter sets once in the header instead of before every keyframe, set before setup
+    void set_global_header(bool global_header);
+
+    // stream parameters and timestamp unit of the opened encoder, what a muxer needs
+    bool codec_parameters(AVCodecParameters *codecpar);
+    std::pair<int, int> time_base();
+
+    // sent frames the encoder may still reference after send_frame returns, from the latency options setup sets
+    int inflight_frames();
+
 
 private:
     std::string m_codec_name;
@@ -31,7 +74,20 @@ private:
     int64_t m_bitrate;
 
     int m_pixel_format;
+    double m_frame_rate;
+    std::pair<int, int> m_time_base;
+    std::string m_preset;
+    int m_gop_size;
+    int m_threads;
+    bool m_global_header;
+    bool m_eof;
+
+    // statics
+    size_t m_frames_in;
+    size_t m_packets_out;
 
     FFmpegCodecContext *m_codec_context;
+
+    std::shared_ptr<FFmpegPacketPool> m_packet_pool;
 };
 
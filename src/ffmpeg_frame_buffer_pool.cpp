@@ -0,0 +1,275 @@
+// self
+#include "ffmpeg_frame_buffer_pool.hpp"
+
+// c++
+#include <vector>
+
+// project
+#include "system_utils.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/macros.h>
+#include <libavutil/pixdesc.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+// multiple of every decoder's linesize_align, STRIDE_ALIGN is at most 64 with avx512
+static const size_t k_buffer_alignment = 64;
+
+
+
+FFmpegFrameBufferPool::FFmpegFrameBufferPool(int width, int height, int pixel_format, bool huge_pages)
+    : m_width(width)
+    , m_height(height)
+    , m_pixel_format(pixel_format)
+    , m_huge_pages(huge_pages)
+    , m_planes(0)
+    , m_linesizes{0, 0, 0, 0}
+    , m_offsets{0, 0, 0, 0}
+    , m_buffer_size(0)
+    , m_pool(nullptr)
+    , m_allocs(0)
+{
+}
+
+
+FFmpegFrameBufferPool::~FFmpegFrameBufferPool()
+{
+    // frees right away if every buffer is back, otherwise with the last one
+    if (m_pool != nullptr) {
+        av_buffer_pool_uninit(&m_pool);
+
+        SPDLOG_INFO(
+            "frame buffer pool {}x{} {} released, buffers: {}, buffer_size: {}",
+            m_width, m_height, av_get_pix_fmt_name((enum AVPixelFormat)m_pixel_format), m_allocs.load(), m_buffer_size
+        );
+    }
+    m_pool = nullptr;
+}
+
+
+bool FFmpegFrameBufferPool::setup()
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)m_pixel_format);
+    if (nullptr == desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        return false;
+    }
+
+    int code = av_image_fill_linesizes(m_linesizes, (enum AVPixelFormat)m_pixel_format, m_width);
+    if (code < 0) {
+        return false;
+    }
+
+    ptrdiff_t linesizes[4];
+    for (int i = 0; i < 4; i++) {
+        m_linesizes[i] = FFALIGN(m_linesizes[i], (int)k_buffer_alignment);
+        linesizes[i] = m_linesizes[i];
+    }
+
+    size_t sizes[4] = {0, 0, 0, 0};
+    code = av_image_fill_plane_sizes(sizes, (enum AVPixelFormat)m_pixel_format, m_height, linesizes);
+    if (code < 0) {
+        return false;
+    }
+
+    // every plane starts on its own cache line
+    size_t offset = 0;
+    for (int i = 0; i < 4 && sizes[i] > 0; i++) {
+        m_offsets[i] = offset;
+        offset += FFALIGN(sizes[i], k_buffer_alignment);
+        m_planes++;
+    }
+
+    // simd code may read a little past the last line, like the default get_buffer2
+    m_buffer_size = offset + k_buffer_alignment;
+
+    m_pool = av_buffer_pool_init2(m_buffer_size, this, alloc, nullptr);
+    if (nullptr == m_pool) {
+        SPDLOG_ERROR("av_buffer_pool_init2 error, size: {}", m_buffer_size);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool FFmpegFrameBufferPool::get_buffer(AVFrame *frame)
+{
+    AVBufferRef *buf = av_buffer_pool_get(m_pool);
+    if (nullptr == buf) {
+        return false;
+    }
+
+    frame->buf[0] = buf;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        frame->data[i] = i < m_planes ? buf->data + m_offsets[i] : nullptr;
+        frame->linesize[i] = i < m_planes ? m_linesizes[i] : 0;
+    }
+    frame->extended_data = frame->data;
+
+    return true;
+}
+
+
+bool FFmpegFrameBufferPool::reserve(size_t buffers)
+{
+    // idle buffers come back first, holding all of them forces new ones
+    std::vector<AVBufferRef *> refs;
+    bool result = true;
+    while (m_allocs.load() < buffers) {
+        AVBufferRef *buf = av_buffer_pool_get(m_pool);
+        if (nullptr == buf) {
+            result = false;
+            break;
+        }
+        refs.push_back(buf);
+    }
+
+    for (auto buf : refs) {
+        av_buffer_unref(&buf);
+    }
+
+    return result;
+}
+
+
+bool FFmpegFrameBufferPool::matches(int width, int height, int pixel_format)
+{
+    return m_width == width && m_height == height && m_pixel_format == pixel_format;
+}
+
+
+size_t FFmpegFrameBufferPool::buffer_size()
+{
+    return m_buffer_size;
+}
+
+
+size_t FFmpegFrameBufferPool::allocs()
+{
+    return m_allocs.load();
+}
+
+
+AVBufferRef *FFmpegFrameBufferPool::alloc(void *opaque, size_t size)
+{
+    FFmpegFrameBufferPool *thiz = (FFmpegFrameBufferPool *)opaque;
+
+    uint8_t *data = (uint8_t *)aligned_malloc(size, k_buffer_alignment, thiz->m_huge_pages);
+    if (nullptr == data) {
+        SPDLOG_ERROR("aligned_malloc error, size: {}", size);
+        return nullptr;
+    }
+
+    // the size rides along as opaque, the buffer may be freed after this pool is gone
+    AVBufferRef *buf = av_buffer_create(data, size, free_buffer, (void *)(uintptr_t)size, 0);
+    if (nullptr == buf) {
+        SPDLOG_ERROR("av_buffer_create error, size: {}", size);
+        aligned_free(data);
+        return nullptr;
+    }
+
+    thiz->m_allocs.fetch_add(1);
+
+    FFmpegFrameBufferPools &pools = FFmpegFrameBufferPools::instance();
+    pools.m_buffers.fetch_add(1);
+    size_t bytes = pools.m_bytes.fetch_add(size) + size;
+    size_t peak = pools.m_peak_bytes.load();
+    while (bytes > peak && !pools.m_peak_bytes.compare_exchange_weak(peak, bytes)) {
+    }
+
+    return buf;
+}
+
+
+void FFmpegFrameBufferPool::free_buffer(void *opaque, uint8_t *data)
+{
+    FFmpegFrameBufferPools::instance().m_bytes.fetch_sub((size_t)(uintptr_t)opaque);
+    aligned_free(data);
+}
+
+
+
+FFmpegFrameBufferPools &FFmpegFrameBufferPools::instance()
+{
+    static FFmpegFrameBufferPools pools;
+    return pools;
+}
+
+
+FFmpegFrameBufferPools::FFmpegFrameBufferPools()
+    : m_enabled(false)
+    , m_huge_pages(false)
+    , m_created(0)
+    , m_buffers(0)
+    , m_bytes(0)
+    , m_peak_bytes(0)
+{
+}
+
+
+void FFmpegFrameBufferPools::enable(bool huge_pages)
+{
+    m_huge_pages.store(huge_pages);
+    m_enabled.store(true);
+}
+
+
+bool FFmpegFrameBufferPools::enabled()
+{
+    return m_enabled.load();
+}
+
+
+bool FFmpegFrameBufferPools::huge_pages()
+{
+    return m_huge_pages.load();
+}
+
+
+std::shared_ptr<FFmpegFrameBufferPool> FFmpegFrameBufferPools::get(int width, int height, int pixel_format)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::tuple<int, int, int> key = std::make_tuple(width, height, pixel_format);
+    auto it = m_pools.find(key);
+    if (it != m_pools.end()) {
+        std::shared_ptr<FFmpegFrameBufferPool> pool = it->second.lock();
+        if (pool != nullptr) {
+            return pool;
+        }
+        m_pools.erase(it);
+    }
+
+    std::shared_ptr<FFmpegFrameBufferPool> pool = std::make_shared<FFmpegFrameBufferPool>(width, height, pixel_format, m_huge_pages.load());
+    if (!pool->setup()) {
+        return nullptr;
+    }
+
+    m_pools[key] = pool;
+    m_created.fetch_add(1);
+
+    SPDLOG_INFO(
+        "frame buffer pool {}x{} {} created, buffer_size: {}, huge_pages: {}",
+        width, height, av_get_pix_fmt_name((enum AVPixelFormat)pixel_format), pool->buffer_size(), m_huge_pages.load()
+    );
+
+    return pool;
+}
+
+
+std::string FFmpegFrameBufferPools::stats()
+{
+    return fmt::format(
+        "frame buffer pools: {}, buffers: {}, live: {:.2f} MiB, peak: {:.2f} MiB",
+        m_created.load(), m_buffers.load(), m_bytes.load() / 1024.0 / 1024.0, m_peak_bytes.load() / 1024.0 / 1024.0
+    );
+}
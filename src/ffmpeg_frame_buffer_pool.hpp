@@ -0,0 +1,99 @@
+#pragma once
+
+// c
+#include <stddef.h>
+#include <stdint.h>
+
+// c++
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+// ffmpeg
+struct AVBufferPool;
+struct AVBufferRef;
+struct AVFrame;
+
+
+
+// picture buffers of one padded size and pixel format, all planes of a frame share one 64-byte aligned block
+// handed to decoders through get_buffer2, every decoder of that size draws from and returns to the same pool
+class FFmpegFrameBufferPool {
+public:
+    FFmpegFrameBufferPool(int width, int height, int pixel_format, bool huge_pages);
+    FFmpegFrameBufferPool(const FFmpegFrameBufferPool &other) = delete;
+    ~FFmpegFrameBufferPool();
+
+    // false for formats the pool can't lay out, palette, bitstream and hardware formats
+    bool setup();
+
+    // fill buf, data and linesize of frame, width and height of frame are left as the decoder set them
+    bool get_buffer(AVFrame *frame);
+
+    // allocate up front until the pool holds at least this many buffers
+    bool reserve(size_t buffers);
+
+    bool matches(int width, int height, int pixel_format);
+
+    size_t buffer_size();
+    size_t allocs();
+
+
+private:
+    static AVBufferRef *alloc(void *opaque, size_t size);
+    static void free_buffer(void *opaque, uint8_t *data);
+
+    int m_width;
+    int m_height;
+    int m_pixel_format;
+    bool m_huge_pages;
+
+    int m_planes;
+    int m_linesizes[4];
+    size_t m_offsets[4];
+    size_t m_buffer_size;
+
+    AVBufferPool *m_pool;
+
+    // statics
+    std::atomic<size_t> m_allocs;
+};
+
+
+// process wide, one pool per padded size and pixel format shared by all channels
+// a pool goes away with the last decoder using it, buffers still referenced outlive it
+class FFmpegFrameBufferPools {
+public:
+    static FFmpegFrameBufferPools &instance();
+
+    // decoders opened afterwards take their buffers from the shared pools
+    void enable(bool huge_pages);
+    bool enabled();
+    bool huge_pages();
+
+    std::shared_ptr<FFmpegFrameBufferPool> get(int width, int height, int pixel_format);
+
+    std::string stats();
+
+
+private:
+    friend class FFmpegFrameBufferPool;
+
+    FFmpegFrameBufferPools();
+    FFmpegFrameBufferPools(const FFmpegFrameBufferPools &other) = delete;
+
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_huge_pages;
+
+    std::mutex m_mutex;
+    std::map<std::tuple<int, int, int>, std::weak_ptr<FFmpegFrameBufferPool>> m_pools;
+
+    // statics
+    std::atomic<size_t> m_created;
+    std::atomic<size_t> m_buffers;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_peak_bytes;
+};
@@ -1,25 +1,90 @@
 // self
 #include "ffmpeg_scale.hpp"
 
+// c
+#include <limits.h>
+
+// c++
+#include <algorithm>
+#include <atomic>
+
 // project
 #include "ffmpeg_utils.hpp"
+#include "ffmpeg_scale_templates.hpp"
 #include "ffmpeg_types.hpp"
+#include "slice_thread_pool.hpp"
 #include "string_utils.hpp"
 
 // ffmpeg
 extern "C" {
 #include <libavutil/opt.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/hwcontext.h>
+#include <libavutil/rational.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersrc.h>
 #include <libavfilter/buffersink.h>
+#include <libswscale/swscale.h>
 }
 
+// fmt
+#include <fmt/ranges.h>
+
 // spdlog
 #include <spdlog/spdlog.h>
 
 
 
+std::map<std::string, ScaleBackend> ScaleBackendCvt::s_map_string_to_enum{
+    { "auto", ScaleBackend::Auto },
+    { "filter", ScaleBackend::Filter },
+    { "sws", ScaleBackend::Sws },
+    { "simd_bilinear", ScaleBackend::SimdBilinear },
+    { "simd_area", ScaleBackend::SimdArea },
+};
+
+
+std::map<ScaleBackend, std::string> ScaleBackendCvt::s_map_enum_to_string{
+    { ScaleBackend::Auto, "auto" },
+    { ScaleBackend::Filter, "filter" },
+    { ScaleBackend::Sws, "sws" },
+    { ScaleBackend::SimdBilinear, "simd_bilinear" },
+    { ScaleBackend::SimdArea, "simd_area" },
+};
+
+
+ScaleBackend ScaleBackendCvt::from_string(std::string s)
+{
+    auto iter = s_map_string_to_enum.find(s);
+    if (iter != s_map_string_to_enum.end()) {
+        return iter->second;
+    }
+    return ScaleBackend::Invalid;
+}
+
+
+std::string ScaleBackendCvt::to_string(ScaleBackend e)
+{
+    auto iter = s_map_enum_to_string.find(e);
+    if (iter != s_map_enum_to_string.end()) {
+        return iter->second;
+    }
+    return "";
+}
+
+
+std::string ScaleBackendCvt::support_list()
+{
+    std::vector<std::string> result;
+    for (auto e = (uint8_t)ScaleBackend::Invalid + 1; e <= (uint8_t)ScaleBackend::SimdArea; e++) {
+        result.push_back(to_string((ScaleBackend)e));
+    }
+    return fmt::to_string(fmt::join(result, ", "));
+}
+
+
+
 FFmpegScale::FFmpegScale(int src_width, int src_height, int src_pixel_format, int dst_width, int dst_height, int dst_pixel_format, int pixel_aspect_num, int pixel_aspect_den, int time_base_num, int time_base_den, std::string filter_text)
     : m_src_width(src_width)
     , m_src_height(src_height)
@@ -35,6 +100,14 @@ FFmpegScale::FFmpegScale(int src_width, int src_height, int src_pixel_format, in
     , m_filter_graph(nullptr)
     , m_buffer_src_filter_context(nullptr)
     , m_buffer_sink_filter_context(nullptr)
+    , m_backend(ScaleBackend::Auto)
+    , m_slices(1)
+    , m_dst_pool_depth(0)
+    , m_simd_src_width(0)
+    , m_simd_src_height(0)
+    , m_graph_reusable(false)
+    , m_sws_reusable(false)
+    , m_from_template(false)
 {
 }
 
@@ -46,7 +119,41 @@ FFmpegScale::~FFmpegScale()
 
 
 bool FFmpegScale::setup(AVBufferRef *hw_frames_context) {
-    if (m_filter_graph != nullptr) {
+    if (m_filter_graph != nullptr || !m_sws_contexts.empty() || m_simd_scaler != nullptr) {
+        return true;
+    }
+    m_from_template = false;
+
+    if (nullptr == hw_frames_context && m_backend != ScaleBackend::Filter && startswith(m_filter_text, "scale=")) {
+        if (m_backend == ScaleBackend::SimdBilinear || m_backend == ScaleBackend::SimdArea) {
+            if (setup_simd()) {
+                return true;
+            }
+            SPDLOG_WARN(
+                "{} can't scale {}x{} {} -> {}x{}, fall back to sws",
+                ScaleBackendCvt::to_string(m_backend), m_src_width, m_src_height,
+                av_get_pix_fmt_name((enum AVPixelFormat)m_src_pixel_format), m_dst_width, m_dst_height
+            );
+        }
+        return setup_sws();
+    }
+
+    // software graphs are shared through the templates, hardware ones are bound to their decoder's frames context
+    FFmpegScaleTemplates &templates = FFmpegScaleTemplates::instance();
+    bool reusable = nullptr == hw_frames_context;
+    std::string key = graph_template_key();
+    if (reusable && templates.invalid(key)) {
+        SPDLOG_ERROR("filter graph failed to configure before, key: {}", key);
+        return false;
+    }
+
+    FFmpegFilterGraphInstance instance;
+    if (reusable && templates.take_graph(key, instance)) {
+        m_filter_graph = instance.graph;
+        m_buffer_src_filter_context = instance.buffer_src;
+        m_buffer_sink_filter_context = instance.buffer_sink;
+        m_graph_reusable = true;
+        m_from_template = true;
         return true;
     }
 
@@ -54,13 +161,13 @@ bool FFmpegScale::setup(AVBufferRef *hw_frames_context) {
     AVFilterInOut *outputs = nullptr;
 
     do {
-        AVFilter *buffer_src_filter = (AVFilter *)avfilter_get_by_name("buffer");
+        const AVFilter *buffer_src_filter = templates.buffer_src_filter();
         if (nullptr == buffer_src_filter) {
             SPDLOG_ERROR("avfilter_get_by_name(buffer) error");
             break;
         }
 
-        AVFilter *buffer_sink_filter = (AVFilter *)avfilter_get_by_name("buffersink");
+        const AVFilter *buffer_sink_filter = templates.buffer_sink_filter();
         if (nullptr == buffer_sink_filter) {
             SPDLOG_ERROR("avfilter_get_by_name(buffersink) error");
             break;
@@ -84,6 +191,11 @@ bool FFmpegScale::setup(AVBufferRef *hw_frames_context) {
             break;
         }
 
+        // filters slice on libavfilter's own threads, the shared pool can't reach into the graph
+        if (m_slices > 1) {
+            m_filter_graph->nb_threads = m_slices;
+        }
+
         std::string args = fmt::format(
             "video_size={}x{}:pix_fmt={}:time_base={}/{}:pixel_aspect={}/{}",
             m_src_width, m_src_height, m_src_pixel_format, m_time_base_num, m_time_base_den, m_pixel_aspect_num, m_pixel_aspect_den
@@ -150,6 +262,8 @@ bool FFmpegScale::setup(AVBufferRef *hw_frames_context) {
         avfilter_inout_free(&inputs);
         avfilter_inout_free(&outputs);
 
+        m_graph_reusable = reusable;
+
         return true;
 
     } while (false);
@@ -162,43 +276,154 @@ bool FFmpegScale::setup(AVBufferRef *hw_frames_context) {
         avfilter_inout_free(&outputs);
     }
 
+    if (reusable) {
+        templates.set_invalid(key);
+    }
+
     teardown();
 
     return false;
 }
 
 
+bool FFmpegScale::setup_sws()
+{
+    // same default flags as the scale filter, output matches the filter graph path
+    // one context per slice, every slice context reads the whole input and writes its own output rows
+    FFmpegScaleTemplates &templates = FFmpegScaleTemplates::instance();
+    std::string key = sws_template_key();
+    m_from_template = true;
+    for (int i = 0; i < m_slices; i++) {
+        SwsContext *sws_context = templates.take_sws(key);
+        if (nullptr == sws_context) {
+            m_from_template = false;
+            sws_context = sws_getContext(
+                m_src_width, m_src_height, (enum AVPixelFormat)m_src_pixel_format,
+                m_dst_width, m_dst_height, (enum AVPixelFormat)m_dst_pixel_format,
+                SWS_BICUBIC, nullptr, nullptr, nullptr
+            );
+        }
+        if (nullptr == sws_context) {
+            SPDLOG_ERROR("sws_getContext error, {}x{} -> {}x{}", m_src_width, m_src_height, m_dst_width, m_dst_height);
+            teardown();
+            return false;
+        }
+        m_sws_contexts.push_back(sws_context);
+    }
+    m_sws_reusable = true;
+
+    if (!setup_dst_buffer_pool()) {
+        teardown();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool FFmpegScale::setup_simd()
+{
+    // planar 4:2:0 downscales only, the kernels neither convert formats nor upscale
+    bool yuv420p = m_src_pixel_format == AV_PIX_FMT_YUV420P || m_src_pixel_format == AV_PIX_FMT_YUVJ420P;
+    if (!yuv420p || m_dst_pixel_format != m_src_pixel_format || m_dst_width > m_src_width || m_dst_height > m_src_height) {
+        return false;
+    }
+
+    SimdScaleFilter filter = m_backend == ScaleBackend::SimdArea ? SimdScaleFilter::Area : SimdScaleFilter::Bilinear;
+    m_simd_scaler.reset(new SimdScaler(m_src_width, m_src_height, m_dst_width, m_dst_height, filter, m_slices));
+    m_simd_src_width = m_src_width;
+    m_simd_src_height = m_src_height;
+
+    if (!setup_dst_buffer_pool()) {
+        teardown();
+        return false;
+    }
+
+    SPDLOG_INFO(
+        "{} {}x{} -> {}x{}, isa: {}",
+        ScaleBackendCvt::to_string(m_backend), m_src_width, m_src_height, m_dst_width, m_dst_height, SimdScaler::isa()
+    );
+
+    return true;
+}
+
+
+bool FFmpegScale::setup_dst_buffer_pool()
+{
+    // without a ring, outputs of the same size share destination buffers across channels
+    if (0 == m_dst_pool_depth) {
+        m_dst_buffer_pool = FFmpegFrameBufferPools::instance().get(m_dst_width, m_dst_height, m_dst_pixel_format);
+        if (nullptr == m_dst_buffer_pool) {
+            SPDLOG_ERROR("frame buffer pool error, {}x{}", m_dst_width, m_dst_height);
+            return false;
+        }
+        return true;
+    }
+
+    m_dst_buffer_pool = std::make_shared<FFmpegFrameBufferPool>(m_dst_width, m_dst_height, m_dst_pixel_format, FFmpegFrameBufferPools::instance().huge_pages());
+    if (!m_dst_buffer_pool->setup() || !m_dst_buffer_pool->reserve(m_dst_pool_depth)) {
+        SPDLOG_ERROR("scale ring error, {}x{}, depth: {}", m_dst_width, m_dst_height, m_dst_pool_depth);
+        m_dst_buffer_pool = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
 void FFmpegScale::teardown()
 {
-    if (m_filter_graph != nullptr) {
+    if (m_filter_graph != nullptr && m_graph_reusable) {
+        // frames left in the sink would come out of the next channel's graph
+        FFmpegFrame frame;
+        while (!frame.is_null() && av_buffersink_get_frame(m_buffer_sink_filter_context, frame.raw_ptr()) >= 0) {
+            av_frame_unref(frame.raw_ptr());
+        }
+
+        FFmpegFilterGraphInstance instance{ m_filter_graph, m_buffer_src_filter_context, m_buffer_sink_filter_context };
+        FFmpegScaleTemplates::instance().put_graph(graph_template_key(), instance);
+    }
+    else if (m_filter_graph != nullptr) {
         avfilter_graph_free(&m_filter_graph);
     }
     m_filter_graph = nullptr;
+    m_buffer_src_filter_context = nullptr;
+    m_buffer_sink_filter_context = nullptr;
+    m_graph_reusable = false;
+
+    for (auto sws_context : m_sws_contexts) {
+        if (m_sws_reusable) {
+            FFmpegScaleTemplates::instance().put_sws(sws_template_key(), sws_context);
+        }
+        else {
+            sws_freeContext(sws_context);
+        }
+    }
+    m_sws_contexts.clear();
+    m_sws_reusable = false;
+    m_simd_scaler = nullptr;
+    m_dst_buffer_pool = nullptr;
 }
 
 
 FFmpegFrame FFmpegScale::scale(FFmpegFrame &frame) {
-    FFmpegFrame scaled_frame;
-    if (scaled_frame.is_null()) {
-        return scaled_frame;
+    if (!m_sws_contexts.empty()) {
+        return sws_scale_frame(frame);
+    }
+    if (m_simd_scaler != nullptr) {
+        return simd_scale_frame(frame);
     }
 
-    int code = 0;
-    if (startswith(m_filter_text, "scale=")) {
-        scaled_frame.raw_ptr()->format = (enum AVPixelFormat)m_dst_pixel_format;
-        scaled_frame.raw_ptr()->width = m_dst_width;
-        scaled_frame.raw_ptr()->height = m_dst_height;
-
-        code = av_frame_get_buffer(scaled_frame.raw_ptr(), 1);
-        if (code < 0) {
-            SPDLOG_ERROR("av_frame_get_buffer error, code: {}, msg: {}", code, ffmpeg_error_str(code));
-            return scaled_frame;
-        }
+    FFmpegFrame scaled_frame = m_frame_pool != nullptr ? m_frame_pool->acquire() : FFmpegFrame();
+    if (scaled_frame.is_null()) {
+        return scaled_frame;
     }
 
-    code = av_buffersrc_add_frame_flags(m_buffer_src_filter_context, frame.raw_ptr(), AV_BUFFERSRC_FLAG_KEEP_REF);
+    // the sink hands out frames from the graph's own buffer pools, nothing to allocate here
+    int code = av_buffersrc_add_frame_flags(m_buffer_src_filter_context, frame.raw_ptr(), AV_BUFFERSRC_FLAG_KEEP_REF);
     if (code < 0) {
         SPDLOG_ERROR("av_buffersrc_add_frame_flags error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        m_graph_reusable = false;
         return scaled_frame;
     }
 
@@ -211,6 +436,7 @@ FFmpegFrame FFmpegScale::scale(FFmpegFrame &frame) {
         }
         else if (code < 0) {
             SPDLOG_ERROR("av_buffersink_get_frame error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+            m_graph_reusable = false;
         }
 
         return scaled_frame;
@@ -220,8 +446,293 @@ FFmpegFrame FFmpegScale::scale(FFmpegFrame &frame) {
 }
 
 
+void FFmpegScale::set_frame_pool(std::shared_ptr<FFmpegFramePool> frame_pool)
+{
+    m_frame_pool = frame_pool;
+}
+
+
+void FFmpegScale::set_backend(ScaleBackend backend)
+{
+    m_backend = backend;
+}
+
+
+void FFmpegScale::set_slices(int slices)
+{
+    m_slices = std::max(1, std::min(slices, m_dst_height));
+}
+
+
+bool FFmpegScale::from_template()
+{
+    return m_from_template;
+}
+
+
+std::string FFmpegScale::graph_template_key()
+{
+    return fmt::format(
+        "{}x{}:{}:{}/{}:{}/{} -> {}x{}:{} threads={} {}",
+        m_src_width, m_src_height, m_src_pixel_format, m_time_base_num, m_time_base_den, m_pixel_aspect_num, m_pixel_aspect_den,
+        m_dst_width, m_dst_height, m_dst_pixel_format, m_slices, m_filter_text
+    );
+}
+
+
+std::string FFmpegScale::sws_template_key()
+{
+    return fmt::format(
+        "{}x{}:{} -> {}x{}:{} flags={}",
+        m_src_width, m_src_height, m_src_pixel_format, m_dst_width, m_dst_height, m_dst_pixel_format, SWS_BICUBIC
+    );
+}
+
+
+void FFmpegScale::set_dst_pool_depth(size_t depth)
+{
+    m_dst_pool_depth = depth;
+}
+
+
+std::string FFmpegScale::dst_pool_stats(size_t frames)
+{
+    if (0 == m_dst_pool_depth || nullptr == m_dst_buffer_pool) {
+        return "";
+    }
+
+    // buffers beyond the preallocated depth were allocated while scaling
+    size_t allocs = m_dst_buffer_pool->allocs();
+    size_t extra = allocs > m_dst_pool_depth ? allocs - m_dst_pool_depth : 0;
+    return fmt::format(
+        "scale_ring: depth: {}, buffers: {}, allocs/frame: {:.3f}",
+        m_dst_pool_depth, allocs, frames > 0 ? (double)extra / frames : 0.0
+    );
+}
+
+
 AVBufferRef *FFmpegScale::hw_frames_context()
 {
+    if (nullptr == m_buffer_sink_filter_context) {
+        return nullptr;
+    }
     return av_buffersink_get_hw_frames_ctx(m_buffer_sink_filter_context);
 }
 
+
+FFmpegFrame FFmpegScale::alloc_scaled_frame(AVFrame *src)
+{
+    FFmpegFrame scaled_frame = m_frame_pool != nullptr ? m_frame_pool->acquire() : FFmpegFrame();
+    if (scaled_frame.is_null()) {
+        return scaled_frame;
+    }
+
+    AVFrame *dst = scaled_frame.raw_ptr();
+    dst->format = m_dst_pixel_format;
+    dst->width = m_dst_width;
+    dst->height = m_dst_height;
+    if (!m_dst_buffer_pool->get_buffer(dst)) {
+        SPDLOG_ERROR("frame buffer pool get_buffer error, {}x{}", m_dst_width, m_dst_height);
+        scaled_frame.free();
+        return scaled_frame;
+    }
+
+    int code = av_frame_copy_props(dst, src);
+    if (code < 0) {
+        SPDLOG_ERROR("av_frame_copy_props error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        scaled_frame.free();
+        return scaled_frame;
+    }
+
+    // keep the display aspect, as the scale filter does
+    if (src->sample_aspect_ratio.num != 0) {
+        av_reduce(
+            &dst->sample_aspect_ratio.num, &dst->sample_aspect_ratio.den,
+            (int64_t)src->sample_aspect_ratio.num * m_dst_height * src->width,
+            (int64_t)src->sample_aspect_ratio.den * m_dst_width * src->height,
+            INT_MAX
+        );
+    }
+
+    return scaled_frame;
+}
+
+
+FFmpegFrame FFmpegScale::sws_scale_frame(FFmpegFrame &frame) {
+    AVFrame *src = frame.raw_ptr();
+
+    // recreated only when the input size or format changes mid stream, and no longer matches its template key then
+    if (src->width != m_src_width || src->height != m_src_height || src->format != m_src_pixel_format) {
+        m_sws_reusable = false;
+    }
+    for (auto &sws_context : m_sws_contexts) {
+        sws_context = sws_getCachedContext(
+            sws_context, src->width, src->height, (enum AVPixelFormat)src->format,
+            m_dst_width, m_dst_height, (enum AVPixelFormat)m_dst_pixel_format,
+            SWS_BICUBIC, nullptr, nullptr, nullptr
+        );
+        if (nullptr == sws_context) {
+            SPDLOG_ERROR("sws_getCachedContext error, {}x{} -> {}x{}", src->width, src->height, m_dst_width, m_dst_height);
+            teardown();
+            return FFmpegFrame(nullptr);
+        }
+    }
+
+    FFmpegFrame scaled_frame = alloc_scaled_frame(src);
+    if (scaled_frame.is_null()) {
+        return scaled_frame;
+    }
+
+    AVFrame *dst = scaled_frame.raw_ptr();
+    if (m_sws_contexts.size() == 1) {
+        int code = sws_scale(m_sws_contexts[0], src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+        if (code < 0) {
+            SPDLOG_ERROR("sws_scale error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+            scaled_frame.free();
+        }
+        return scaled_frame;
+    }
+
+    // slice borders on the chroma subsampling grid, as sws_receive_slice requires
+    int slices = (int)m_sws_contexts.size();
+    int align = (int)sws_receive_slice_alignment(m_sws_contexts[0]);
+    std::atomic<int> error_code(0);
+
+    SliceThreadPool::instance().run(
+        slices,
+        [this, src, dst, slices, align, &error_code](int slice) {
+            int y_begin = slice == 0 ? 0 : (int)((int64_t)m_dst_height * slice / slices) / align * align;
+            int y_end = slice == slices - 1 ? m_dst_height : (int)((int64_t)m_dst_height * (slice + 1) / slices) / align * align;
+            if (y_end <= y_begin) {
+                return;
+            }
+
+            SwsContext *sws_context = m_sws_contexts[slice];
+            int code = sws_frame_start(sws_context, dst, src);
+            if (code >= 0) {
+                code = sws_send_slice(sws_context, 0, src->height);
+            }
+            if (code >= 0) {
+                code = sws_receive_slice(sws_context, y_begin, y_end - y_begin);
+            }
+            sws_frame_end(sws_context);
+
+            if (code < 0) {
+                error_code.store(code);
+            }
+        }
+    );
+
+    int code = error_code.load();
+    if (code < 0) {
+        SPDLOG_ERROR("sws slice error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        scaled_frame.free();
+    }
+
+    return scaled_frame;
+}
+
+
+FFmpegFrame FFmpegScale::simd_scale_frame(FFmpegFrame &frame) {
+    AVFrame *src = frame.raw_ptr();
+    if (src->format != m_src_pixel_format || src->width < m_dst_width || src->height < m_dst_height) {
+        SPDLOG_ERROR(
+            "simd scaler input changed to {}x{} {}, can't scale to {}x{}",
+            src->width, src->height, av_get_pix_fmt_name((enum AVPixelFormat)src->format), m_dst_width, m_dst_height
+        );
+        return FFmpegFrame(nullptr);
+    }
+
+    // filter tables only depend on the sizes, rebuilt when the input size changes mid stream
+    if (src->width != m_simd_src_width || src->height != m_simd_src_height) {
+        SimdScaleFilter filter = m_backend == ScaleBackend::SimdArea ? SimdScaleFilter::Area : SimdScaleFilter::Bilinear;
+        m_simd_scaler.reset(new SimdScaler(src->width, src->height, m_dst_width, m_dst_height, filter, m_slices));
+        m_simd_src_width = src->width;
+        m_simd_src_height = src->height;
+    }
+
+    FFmpegFrame scaled_frame = alloc_scaled_frame(src);
+    if (scaled_frame.is_null()) {
+        return scaled_frame;
+    }
+
+    AVFrame *dst = scaled_frame.raw_ptr();
+    SimdScaler *simd_scaler = m_simd_scaler.get();
+    SliceThreadPool::instance().run(
+        simd_scaler->slices(),
+        [simd_scaler, src, dst](int slice) {
+            simd_scaler->scale(src->data, src->linesize, dst->data, dst->linesize, slice);
+        }
+    );
+
+    return scaled_frame;
+}
+
+
+
+FFmpegScaleCascade::FFmpegScaleCascade(int src_width, int src_height, std::vector<int> widths, std::vector<int> heights, bool enabled)
+    : m_src_width(src_width)
+    , m_src_height(src_height)
+    , m_widths(widths)
+    , m_heights(heights)
+    , m_parents(widths.size(), -1)
+{
+    if (!enabled) {
+        return;
+    }
+
+    for (size_t i = 0; i < m_widths.size(); i++) {
+        // smallest rung that covers this one in both dimensions and is strictly larger, ties go to the first
+        int64_t best_area = (int64_t)m_src_width * m_src_height;
+        for (size_t j = 0; j < m_widths.size(); j++) {
+            int64_t area = (int64_t)m_widths[j] * m_heights[j];
+            if (m_widths[j] < m_widths[i] || m_heights[j] < m_heights[i] || area <= (int64_t)m_widths[i] * m_heights[i]) {
+                continue;
+            }
+            if (area < best_area) {
+                best_area = area;
+                m_parents[i] = (int)j;
+            }
+        }
+    }
+}
+
+
+int FFmpegScaleCascade::parent(size_t index)
+{
+    return m_parents[index];
+}
+
+
+std::vector<size_t> FFmpegScaleCascade::children(int index)
+{
+    std::vector<size_t> result;
+    for (size_t i = 0; i < m_parents.size(); i++) {
+        if (m_parents[i] == index) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+
+int FFmpegScaleCascade::src_width(size_t index)
+{
+    return m_parents[index] < 0 ? m_src_width : m_widths[m_parents[index]];
+}
+
+
+int FFmpegScaleCascade::src_height(size_t index)
+{
+    return m_parents[index] < 0 ? m_src_height : m_heights[m_parents[index]];
+}
+
+
+std::string FFmpegScaleCascade::to_string()
+{
+    std::vector<std::string> rungs;
+    for (size_t i = 0; i < m_parents.size(); i++) {
+        rungs.push_back(fmt::format("{}x{} <- {}x{}", m_widths[i], m_heights[i], src_width(i), src_height(i)));
+    }
+    return fmt::format("{}", fmt::join(rungs, ", "));
+}
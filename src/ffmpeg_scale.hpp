@@ -1,7 +1,15 @@
 #pragma once
 
+// c++
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 // project
+#include "ffmpeg_frame_buffer_pool.hpp"
 #include "ffmpeg_types.hpp"
+#include "simd_scale.hpp"
 
 // ffmpeg
 struct AVBufferRef;
@@ -9,6 +17,32 @@ struct AVFilter;
 struct AVFilterGraph;
 struct AVFilterInOut;
 struct AVFilterContext;
+struct SwsContext;
+
+
+
+// how software frames are scaled, hardware frames always go through the filter graph
+enum class ScaleBackend : uint8_t {
+	Invalid,
+	Auto,
+	Filter,
+	Sws,
+	SimdBilinear,
+	SimdArea,
+};
+
+
+class ScaleBackendCvt {
+public:
+	static ScaleBackend from_string(std::string s);
+	static std::string to_string(ScaleBackend e);
+	static std::string support_list();
+
+
+private:
+	static std::map<std::string, ScaleBackend> s_map_string_to_enum;
+	static std::map<ScaleBackend, std::string> s_map_enum_to_string;
+};
 
 
 
@@ -22,10 +56,42 @@ public:
 
 	FFmpegFrame scale(FFmpegFrame &frame);
 
+	// scaled frames come from and go back to this pool
+	void set_frame_pool(std::shared_ptr<FFmpegFramePool> frame_pool);
+
+	// takes effect on the next setup, simd backends fall back to sws for anything but yuv420p downscales
+	void set_backend(ScaleBackend backend);
+
+	// horizontal slices of every output frame scaled in parallel on the shared slice thread pool, same output as 1
+	void set_slices(int slices);
+
+	// sws and simd outputs go to a ring of this many preallocated buffers owned by this scaler, 0 to share the process wide pool
+	// frames return to the ring once the encoder drops them, so it covers every frame alive between scale and encode
+	void set_dst_pool_depth(size_t depth);
+
+	// empty without a ring
+	std::string dst_pool_stats(size_t frames);
+
+	// the last setup took its graph or sws contexts from FFmpegScaleTemplates
+	bool from_template();
+
 	AVBufferRef *hw_frames_context();
 
 
 private:
+	bool setup_sws();
+	bool setup_simd();
+	bool setup_dst_buffer_pool();
+
+	std::string graph_template_key();
+	std::string sws_template_key();
+
+	// pooled output frame with the props and display aspect of frame
+	FFmpegFrame alloc_scaled_frame(AVFrame *src);
+
+	FFmpegFrame sws_scale_frame(FFmpegFrame &frame);
+	FFmpegFrame simd_scale_frame(FFmpegFrame &frame);
+
 	int m_src_width;
 	int m_src_height;
 	int m_src_pixel_format;
@@ -42,5 +108,49 @@ private:
 	AVFilterGraph *m_filter_graph;
 	AVFilterContext *m_buffer_src_filter_context;
 	AVFilterContext *m_buffer_sink_filter_context;
+
+	ScaleBackend m_backend;
+	int m_slices;
+	size_t m_dst_pool_depth;
+
+	// plain software scale= skips the filter graph, one context per slice
+	std::vector<SwsContext *> m_sws_contexts;
+	std::unique_ptr<SimdScaler> m_simd_scaler;
+	int m_simd_src_width;
+	int m_simd_src_height;
+	std::shared_ptr<FFmpegFrameBufferPool> m_dst_buffer_pool;
+
+	// checked back into FFmpegScaleTemplates on teardown
+	bool m_graph_reusable;
+	bool m_sws_reusable;
+	bool m_from_template;
+
+	std::shared_ptr<FFmpegFramePool> m_frame_pool;
 };
 
+
+// resolution ladder of a multi-output transcode, every rung is scaled from the nearest larger rung instead of the source
+// so the full size picture is read once per frame, by the largest rung only
+class FFmpegScaleCascade {
+public:
+	FFmpegScaleCascade(int src_width, int src_height, std::vector<int> widths, std::vector<int> heights, bool enabled = true);
+
+	// output index rung index is scaled from, -1 for the source
+	int parent(size_t index);
+
+	// rungs scaled from the given output, -1 for the ones scaled from the source
+	std::vector<size_t> children(int index);
+
+	int src_width(size_t index);
+	int src_height(size_t index);
+
+	std::string to_string();
+
+
+private:
+	int m_src_width;
+	int m_src_height;
+	std::vector<int> m_widths;
+	std::vector<int> m_heights;
+	std::vector<int> m_parents;
+};
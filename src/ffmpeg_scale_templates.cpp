@@ -0,0 +1,168 @@
+// self
+#include "ffmpeg_scale_templates.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libswscale/swscale.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+FFmpegScaleTemplates &FFmpegScaleTemplates::instance()
+{
+    static FFmpegScaleTemplates templates;
+    return templates;
+}
+
+
+FFmpegScaleTemplates::FFmpegScaleTemplates()
+    : m_max_idle(256)
+    , m_buffer_src_filter(avfilter_get_by_name("buffer"))
+    , m_buffer_sink_filter(avfilter_get_by_name("buffersink"))
+    , m_graph_hits(0)
+    , m_graph_misses(0)
+    , m_sws_hits(0)
+    , m_sws_misses(0)
+{
+}
+
+
+FFmpegScaleTemplates::~FFmpegScaleTemplates()
+{
+    for (auto &item : m_graphs) {
+        for (auto &instance : item.second) {
+            avfilter_graph_free(&instance.graph);
+        }
+    }
+    m_graphs.clear();
+
+    for (auto &item : m_sws_contexts) {
+        for (auto sws_context : item.second) {
+            sws_freeContext(sws_context);
+        }
+    }
+    m_sws_contexts.clear();
+}
+
+
+const AVFilter *FFmpegScaleTemplates::buffer_src_filter()
+{
+    return m_buffer_src_filter;
+}
+
+
+const AVFilter *FFmpegScaleTemplates::buffer_sink_filter()
+{
+    return m_buffer_sink_filter;
+}
+
+
+bool FFmpegScaleTemplates::take_graph(const std::string &key, FFmpegFilterGraphInstance &instance)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_graphs.find(key);
+    if (it == m_graphs.end() || it->second.empty()) {
+        m_graph_misses.fetch_add(1);
+        return false;
+    }
+
+    instance = it->second.back();
+    it->second.pop_back();
+    m_graph_hits.fetch_add(1);
+
+    return true;
+}
+
+
+void FFmpegScaleTemplates::put_graph(const std::string &key, FFmpegFilterGraphInstance &instance)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<FFmpegFilterGraphInstance> &idle = m_graphs[key];
+        if (idle.size() < m_max_idle) {
+            idle.push_back(instance);
+            instance.graph = nullptr;
+        }
+    }
+
+    if (instance.graph != nullptr) {
+        avfilter_graph_free(&instance.graph);
+    }
+    instance.buffer_src = nullptr;
+    instance.buffer_sink = nullptr;
+}
+
+
+SwsContext *FFmpegScaleTemplates::take_sws(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_sws_contexts.find(key);
+    if (it == m_sws_contexts.end() || it->second.empty()) {
+        m_sws_misses.fetch_add(1);
+        return nullptr;
+    }
+
+    SwsContext *sws_context = it->second.back();
+    it->second.pop_back();
+    m_sws_hits.fetch_add(1);
+
+    return sws_context;
+}
+
+
+void FFmpegScaleTemplates::put_sws(const std::string &key, SwsContext *sws_context)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<SwsContext *> &idle = m_sws_contexts[key];
+        if (idle.size() < m_max_idle) {
+            idle.push_back(sws_context);
+            return;
+        }
+    }
+
+    sws_freeContext(sws_context);
+}
+
+
+void FFmpegScaleTemplates::set_invalid(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_invalid.insert(key);
+}
+
+
+bool FFmpegScaleTemplates::invalid(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_invalid.count(key) > 0;
+}
+
+
+std::string FFmpegScaleTemplates::stats()
+{
+    size_t idle_graphs = 0;
+    size_t idle_sws_contexts = 0;
+    size_t invalid = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &item : m_graphs) {
+            idle_graphs += item.second.size();
+        }
+        for (auto &item : m_sws_contexts) {
+            idle_sws_contexts += item.second.size();
+        }
+        invalid = m_invalid.size();
+    }
+
+    return fmt::format(
+        "scale templates, graphs: {} hits, {} misses, {} idle, sws: {} hits, {} misses, {} idle, invalid: {}",
+        m_graph_hits.load(), m_graph_misses.load(), idle_graphs, m_sws_hits.load(), m_sws_misses.load(), idle_sws_contexts, invalid
+    );
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// c
+#include <stddef.h>
+
+// c++
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// ffmpeg
+struct AVFilter;
+struct AVFilterContext;
+struct AVFilterGraph;
+struct SwsContext;
+
+
+
+// a configured graph ready for frames, with its source and sink
+struct FFmpegFilterGraphInstance {
+    AVFilterGraph *graph;
+    AVFilterContext *buffer_src;
+    AVFilterContext *buffer_sink;
+};
+
+
+// process wide cache of scale stages keyed by their whole configuration, sizes, pixel formats and filter text
+// libavfilter and swscale can't copy a configured graph or context, so torn down channels check theirs in
+// and the next channel with the same key takes it instead of parsing, negotiating and initializing again
+class FFmpegScaleTemplates {
+public:
+    static FFmpegScaleTemplates &instance();
+
+    // buffer and buffersink, looked up once
+    const AVFilter *buffer_src_filter();
+    const AVFilter *buffer_sink_filter();
+
+    // false when no idle graph has this key
+    bool take_graph(const std::string &key, FFmpegFilterGraphInstance &instance);
+
+    // freed instead when the key already has enough idle graphs
+    void put_graph(const std::string &key, FFmpegFilterGraphInstance &instance);
+
+    // nullptr when no idle context has this key
+    SwsContext *take_sws(const std::string &key);
+    void put_sws(const std::string &key, SwsContext *sws_context);
+
+    // configurations that failed once fail again without building anything
+    void set_invalid(const std::string &key);
+    bool invalid(const std::string &key);
+
+    std::string stats();
+
+
+private:
+    FFmpegScaleTemplates();
+    FFmpegScaleTemplates(const FFmpegScaleTemplates &other) = delete;
+    ~FFmpegScaleTemplates();
+
+    size_t m_max_idle;
+
+    const AVFilter *m_buffer_src_filter;
+    const AVFilter *m_buffer_sink_filter;
+
+    std::mutex m_mutex;
+    std::map<std::string, std::vector<FFmpegFilterGraphInstance>> m_graphs;
+    std::map<std::string, std::vector<SwsContext *>> m_sws_contexts;
+    std::set<std::string> m_invalid;
+
+    // statics
+    std::atomic<size_t> m_graph_hits;
+    std::atomic<size_t> m_graph_misses;
+    std::atomic<size_t> m_sws_hits;
+    std::atomic<size_t> m_sws_misses;
+};
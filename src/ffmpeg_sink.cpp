@@ -0,0 +1,469 @@
+// self
+#include "ffmpeg_sink.hpp"
+
+// c++
+#include <algorithm>
+
+// project
+#include "ffmpeg_utils.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+// fmt
+#include <fmt/ranges.h>
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+std::map<std::string, SinkType> SinkTypeCvt::s_map_string_to_enum{
+    { "null", SinkType::Null },
+    { "mp4", SinkType::Mp4 },
+    { "ts", SinkType::Ts },
+    { "flv", SinkType::Flv },
+};
+
+
+std::map<SinkType, std::string> SinkTypeCvt::s_map_enum_to_string{
+    { SinkType::Null, "null" },
+    { SinkType::Mp4, "mp4" },
+    { SinkType::Ts, "ts" },
+    { SinkType::Flv, "flv" },
+};
+
+
+SinkType SinkTypeCvt::from_string(std::string s)
+{
+    auto iter = s_map_string_to_enum.find(s);
+    if (iter != s_map_string_to_enum.end()) {
+        return iter->second;
+    }
+    return SinkType::Invalid;
+}
+
+
+std::string SinkTypeCvt::to_string(SinkType e)
+{
+    auto iter = s_map_enum_to_string.find(e);
+    if (iter != s_map_enum_to_string.end()) {
+        return iter->second;
+    }
+    return "";
+}
+
+
+std::string SinkTypeCvt::support_list()
+{
+    std::vector<std::string> result;
+    for (auto e = (uint8_t)SinkType::Invalid + 1; e <= (uint8_t)SinkType::Flv; e++) {
+        result.push_back(to_string((SinkType)e));
+    }
+    return fmt::to_string(fmt::join(result, ", "));
+}
+
+
+
+std::shared_ptr<FFmpegSink> FFmpegSink::create(SinkType type, std::string url)
+{
+    switch (type) {
+    case SinkType::Null:
+        return std::make_shared<FFmpegNullSink>();
+    case SinkType::Mp4:
+    case SinkType::Ts:
+    case SinkType::Flv:
+    case SinkType::Image:
+        return std::make_shared<FFmpegMuxSink>(type, url);
+    default:
+        return nullptr;
+    }
+}
+
+
+std::string FFmpegSink::extension(SinkType type)
+{
+    return type == SinkType::Null ? "" : SinkTypeCvt::to_string(type);
+}
+
+
+
+FFmpegNullSink::FFmpegNullSink()
+    : m_packets(0)
+    , m_bytes(0)
+{
+}
+
+
+bool FFmpegNullSink::global_header()
+{
+    return false;
+}
+
+
+bool FFmpegNullSink::open(const AVCodecParameters *codecpar, std::pair<int, int> time_base)
+{
+    return true;
+}
+
+
+bool FFmpegNullSink::write(FFmpegPacket &packet)
+{
+    m_packets++;
+    m_bytes += packet.raw_ptr()->size;
+
+    packet.free();
+    return true;
+}
+
+
+bool FFmpegNullSink::close()
+{
+    return true;
+}
+
+
+std::string FFmpegNullSink::stats()
+{
+    return fmt::format("sink: null, packets: {}, bytes: {}", m_packets, m_bytes);
+}
+
+
+
+FFmpegMuxSink::FFmpegMuxSink(SinkType type, std::string url)
+    : m_type(type)
+    , m_url(url)
+    , m_format_context(nullptr)
+    , m_time_base(1, 25)
+    , m_thread(0)
+    , m_opened(false)
+    , m_closed(false)
+    , m_next_pts(0)
+    , m_finished(false)
+    , m_packets(0)
+    , m_bytes(0)
+    , m_errors(0)
+{
+}
+
+
+FFmpegMuxSink::~FFmpegMuxSink()
+{
+    close();
+
+    if (m_format_context != nullptr) {
+        avformat_free_context(m_format_context);
+    }
+    m_format_context = nullptr;
+}
+
+
+const char *FFmpegMuxSink::format_name()
+{
+    switch (m_type) {
+    case SinkType::Mp4:
+        return "mp4";
+    case SinkType::Ts:
+        return "mpegts";
+    case SinkType::Flv:
+        return "flv";
+    case SinkType::Image:
+        return "image2";
+    default:
+        return nullptr;
+    }
+}
+
+
+bool FFmpegMuxSink::global_header()
+{
+    const AVOutputFormat *output_format = av_guess_format(format_name(), nullptr, nullptr);
+    return output_format != nullptr && (output_format->flags & AVFMT_GLOBALHEADER) != 0;
+}
+
+
+bool FFmpegMuxSink::open(const AVCodecParameters *codecpar, std::pair<int, int> time_base)
+{
+    if (m_opened) {
+        return true;
+    }
+
+    do {
+        int code = avformat_alloc_output_context2(&m_format_context, nullptr, format_name(), m_url.c_str());
+        if (code < 0 || nullptr == m_format_context) {
+            SPDLOG_ERROR("avformat_alloc_output_context2 error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+            break;
+        }
+
+        AVStream *stream = avformat_new_stream(m_format_context, nullptr);
+        if (nullptr == stream) {
+            SPDLOG_ERROR("avformat_new_stream error, url: {}", m_url);
+            break;
+        }
+
+        code = avcodec_parameters_copy(stream->codecpar, codecpar);
+        if (code < 0) {
+            SPDLOG_ERROR("avcodec_parameters_copy error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+            break;
+        }
+        stream->codecpar->codec_tag = 0;
+        stream->time_base = AVRational{ time_base.first, time_base.second };
+        m_time_base = time_base;
+
+        if (!(m_format_context->oformat->flags & AVFMT_NOFILE)) {
+            code = avio_open(&m_format_context->pb, m_url.c_str(), AVIO_FLAG_WRITE);
+            if (code < 0) {
+                SPDLOG_ERROR("avio_open error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+                break;
+            }
+        }
+
+        // the muxer may pick another stream time base here, packets are rescaled to it
+        code = avformat_write_header(m_format_context, nullptr);
+        if (code < 0) {
+            SPDLOG_ERROR("avformat_write_header error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+            break;
+        }
+
+        m_thread = FFmpegSinkIo::instance().assign();
+        m_opened = true;
+
+        return true;
+    } while (false);
+
+    if (m_format_context != nullptr) {
+        if (m_format_context->pb != nullptr && !(m_format_context->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&m_format_context->pb);
+        }
+        avformat_free_context(m_format_context);
+    }
+    m_format_context = nullptr;
+
+    return false;
+}
+
+
+bool FFmpegMuxSink::write(FFmpegPacket &packet)
+{
+    if (!m_opened || m_closed) {
+        packet.free();
+        return false;
+    }
+
+    FFmpegSinkIo::instance().post(m_thread, this, packet, false);
+    return true;
+}
+
+
+bool FFmpegMuxSink::close()
+{
+    if (!m_opened || m_closed) {
+        return true;
+    }
+    m_closed = true;
+
+    FFmpegPacket end(nullptr);
+    FFmpegSinkIo::instance().post(m_thread, this, end, true);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return m_finished; });
+
+    return m_errors.load() == 0;
+}
+
+
+void FFmpegMuxSink::mux(FFmpegPacket &packet)
+{
+    AVPacket *raw = packet.raw_ptr();
+    m_packets.fetch_add(1);
+    m_bytes.fetch_add(raw->size);
+
+    // raw access units and timestamp-less encoder output are numbered in the time base
+    if (raw->pts == AV_NOPTS_VALUE) {
+        raw->pts = m_next_pts;
+    }
+    if (raw->dts == AV_NOPTS_VALUE) {
+        raw->dts = raw->pts;
+    }
+    m_next_pts = std::max(m_next_pts, raw->pts) + 1;
+
+    AVStream *stream = m_format_context->streams[0];
+    raw->stream_index = stream->index;
+    av_packet_rescale_ts(raw, AVRational{ m_time_base.first, m_time_base.second }, stream->time_base);
+
+    int code = av_write_frame(m_format_context, raw);
+    if (code < 0 && 0 == m_errors.fetch_add(1)) {
+        SPDLOG_WARN("av_write_frame error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+    }
+
+    packet.free();
+}
+
+
+void FFmpegMuxSink::finish()
+{
+    int code = av_write_trailer(m_format_context);
+    if (code < 0) {
+        m_errors.fetch_add(1);
+        SPDLOG_WARN("av_write_trailer error, code: {}, msg: {}, url: {}", code, ffmpeg_error_str(code), m_url);
+    }
+
+    if (!(m_format_context->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&m_format_context->pb);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished = true;
+    m_cv.notify_all();
+}
+
+
+std::string FFmpegMuxSink::stats()
+{
+    return fmt::format("sink: {}, packets: {}, bytes: {}, errors: {}", m_url, m_packets.load(), m_bytes.load(), m_errors.load());
+}
+
+
+
+FFmpegSinkIo &FFmpegSinkIo::instance()
+{
+    static FFmpegSinkIo io;
+    return io;
+}
+
+
+FFmpegSinkIo::FFmpegSinkIo()
+    : m_max_queued(256)
+    , m_next(0)
+    , m_posted(0)
+    , m_full_waits(0)
+    , m_max_depth(0)
+{
+}
+
+
+FFmpegSinkIo::~FFmpegSinkIo()
+{
+    stop();
+}
+
+
+void FFmpegSinkIo::start(int threads)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_workers.empty()) {
+        return;
+    }
+
+    for (int i = 0; i < std::max(threads, 1); i++) {
+        m_workers.emplace_back(new Worker());
+        Worker *worker = m_workers.back().get();
+        worker->stop = false;
+        worker->thread = std::thread(&FFmpegSinkIo::work, this, worker);
+    }
+}
+
+
+void FFmpegSinkIo::stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // queued packets are still written
+    for (auto &worker : m_workers) {
+        {
+            std::lock_guard<std::mutex> worker_lock(worker->mutex);
+            worker->stop = true;
+        }
+        worker->not_empty.notify_all();
+    }
+    for (auto &worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    m_workers.clear();
+}
+
+
+int FFmpegSinkIo::threads()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int)m_workers.size();
+}
+
+
+size_t FFmpegSinkIo::assign()
+{
+    start(1);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_next++ % m_workers.size();
+}
+
+
+void FFmpegSinkIo::post(size_t thread, FFmpegMuxSink *sink, FFmpegPacket &packet, bool close)
+{
+    Worker *worker = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        worker = m_workers[thread].get();
+    }
+
+    size_t depth = 0;
+    {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        if (worker->items.size() >= m_max_queued) {
+            m_full_waits.fetch_add(1);
+            worker->not_full.wait(lock, [this, worker]() { return worker->items.size() < m_max_queued; });
+        }
+
+        worker->items.push_back(Item{ sink, std::move(packet), close });
+        depth = worker->items.size();
+    }
+    worker->not_empty.notify_one();
+
+    if (!close) {
+        m_posted.fetch_add(1);
+    }
+    size_t max_depth = m_max_depth.load();
+    while (depth > max_depth && !m_max_depth.compare_exchange_weak(max_depth, depth)) {
+    }
+}
+
+
+void FFmpegSinkIo::work(Worker *worker)
+{
+    while (true) {
+        Item item{ nullptr, FFmpegPacket(nullptr), false };
+        {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            worker->not_empty.wait(lock, [worker]() { return worker->stop || !worker->items.empty(); });
+            if (worker->items.empty()) {
+                return;
+            }
+
+            item = std::move(worker->items.front());
+            worker->items.pop_front();
+        }
+        worker->not_full.notify_one();
+
+        if (item.close) {
+            item.sink->finish();
+        }
+        else {
+            item.sink->mux(item.packet);
+        }
+    }
+}
+
+
+std::string FFmpegSinkIo::stats()
+{
+    return fmt::format(
+        "sink io, threads: {}, packets: {}, queue: {} max/{} (full_waits={})",
+        threads(), m_posted.load(), m_max_depth.load(), m_max_queued, m_full_waits.load()
+    );
+}
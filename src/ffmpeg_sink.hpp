@@ -0,0 +1,204 @@
+#pragma once
+
+// c
+#include <stddef.h>
+#include <stdint.h>
+
+// c++
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// project
+#include "ffmpeg_types.hpp"
+
+// ffmpeg
+struct AVCodecParameters;
+struct AVFormatContext;
+
+
+
+// where the encoded and remuxed packets of every output go
+enum class SinkType : uint8_t {
+    Invalid,
+    Null,
+    Mp4,
+    Ts,
+    Flv,
+    // one file per packet through image2, what snapshot tasks write for any file sink, not a --sink choice
+    Image,
+};
+
+
+class SinkTypeCvt {
+public:
+    static SinkType from_string(std::string s);
+    static std::string to_string(SinkType e);
+    static std::string support_list();
+
+
+private:
+    static std::map<std::string, SinkType> s_map_string_to_enum;
+    static std::map<SinkType, std::string> s_map_enum_to_string;
+};
+
+
+
+// the packets of one output, written by one producer at a time
+class FFmpegSink {
+public:
+    virtual ~FFmpegSink() = default;
+
+    // a null sink, or a muxer writing url on the sink io threads, nullptr for Invalid
+    // url of an Image sink is an image2 pattern like dir/task0_snapshot%06d.jpg
+    static std::shared_ptr<FFmpegSink> create(SinkType type, std::string url);
+
+    // file extension of a type, empty for null
+    static std::string extension(SinkType type);
+
+    // the encoder must keep its parameter sets in the extradata, asked before the encoder opens
+    virtual bool global_header() = 0;
+
+    // once before the first packet, packet timestamps are in time_base, ones without any are numbered in it
+    virtual bool open(const AVCodecParameters *codecpar, std::pair<int, int> time_base) = 0;
+
+    // takes over the packet's reference, packet is empty afterwards
+    virtual bool write(FFmpegPacket &packet) = 0;
+
+    // after the last packet, returns once every queued packet and the trailer are written
+    virtual bool close() = 0;
+
+    virtual std::string stats() = 0;
+};
+
+
+// drops packets where they are produced, the cost of the old discard
+class FFmpegNullSink : public FFmpegSink {
+public:
+    FFmpegNullSink();
+
+    bool global_header() override;
+    bool open(const AVCodecParameters *codecpar, std::pair<int, int> time_base) override;
+    bool write(FFmpegPacket &packet) override;
+    bool close() override;
+    std::string stats() override;
+
+
+private:
+    // statics
+    size_t m_packets;
+    int64_t m_bytes;
+};
+
+
+// one stream muxed into a file, write only queues the packet for the sink's io thread
+class FFmpegMuxSink : public FFmpegSink {
+public:
+    FFmpegMuxSink(SinkType type, std::string url);
+    FFmpegMuxSink(const FFmpegMuxSink &other) = delete;
+    ~FFmpegMuxSink();
+
+    bool global_header() override;
+    bool open(const AVCodecParameters *codecpar, std::pair<int, int> time_base) override;
+    bool write(FFmpegPacket &packet) override;
+    bool close() override;
+    std::string stats() override;
+
+
+private:
+    friend class FFmpegSinkIo;
+
+    // io thread
+    void mux(FFmpegPacket &packet);
+    void finish();
+
+    const char *format_name();
+
+    SinkType m_type;
+    std::string m_url;
+
+    AVFormatContext *m_format_context;
+    std::pair<int, int> m_time_base;
+    size_t m_thread;
+    bool m_opened;
+    bool m_closed;
+
+    // io thread, the number given to the next packet without timestamps
+    int64_t m_next_pts;
+
+    // set by the io thread once the trailer is out
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_finished;
+
+    // statics
+    std::atomic<size_t> m_packets;
+    std::atomic<int64_t> m_bytes;
+    std::atomic<size_t> m_errors;
+};
+
+
+// process wide io threads muxing for every mux sink, a sink sticks to one thread so its packets stay in order
+// the queues are bounded, a producer waits while its sink's thread is that far behind
+class FFmpegSinkIo {
+public:
+    static FFmpegSinkIo &instance();
+
+    // the first mux sink starts 1 thread when nothing did before
+    void start(int threads);
+    void stop();
+
+    int threads();
+
+    std::string stats();
+
+
+private:
+    friend class FFmpegMuxSink;
+
+    struct Item {
+        FFmpegMuxSink *sink;
+        FFmpegPacket packet;
+        bool close;
+    };
+
+    struct Worker {
+        std::thread thread;
+
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<Item> items;
+        bool stop;
+    };
+
+    FFmpegSinkIo();
+    FFmpegSinkIo(const FFmpegSinkIo &other) = delete;
+    ~FFmpegSinkIo();
+
+    // thread for a new sink, round robin
+    size_t assign();
+
+    // the packet moves into the queue, close asks for the trailer after it
+    void post(size_t thread, FFmpegMuxSink *sink, FFmpegPacket &packet, bool close);
+
+    void work(Worker *worker);
+
+    size_t m_max_queued;
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    size_t m_next;
+
+    // statics
+    std::atomic<size_t> m_posted;
+    std::atomic<size_t> m_full_waits;
+    std::atomic<size_t> m_max_depth;
+};
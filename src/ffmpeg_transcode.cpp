@@ -1,20 +1,34 @@
 // self
 #include "ffmpeg_transcode.hpp"
 
+// c
+#include <limits.h>
+#include <stdint.h>
+
 // c++
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <future>
+#include <memory>
 #include <thread>
 #include <vector>
 
 // project
+#include "channel_scheduler.hpp"
+#include "codec_thread_budget.hpp"
 #include "ffmpeg_utils.hpp"
 #include "ffmpeg_types.hpp"
 #include "ffmpeg_demux.hpp"
 #include "ffmpeg_decode.hpp"
 #include "ffmpeg_scale.hpp"
 #include "ffmpeg_encode.hpp"
+#include "frame_decimator.hpp"
+#include "h26x_frame_dropper.hpp"
 #include "math_utils.hpp"
+#include "spsc_queue.hpp"
 #include "string_utils.hpp"
+#include "system_utils.hpp"
 
 // ffmpeg
 extern "C" {
@@ -38,14 +52,13 @@ extern "C" {
 // cli11
 #include <CLI/CLI.hpp>
 
-// task-thread-pool
-#include <task_thread_pool.hpp>
-
 
 
 std::map<std::string, TranscodeType> TranscodeTypeCvt::s_map_string_to_enum{
     { "h264_decode_only", TranscodeType::H264DecodeOnly },
     { "h265_decode_only", TranscodeType::H265DecodeOnly },
+    { "h264_snapshot", TranscodeType::H264Snapshot },
+    { "h265_snapshot", TranscodeType::H265Snapshot },
     { "h264_to_d1_h264", TranscodeType::H264ToD1H264 },
     { "h264_to_cif_h264", TranscodeType::H264ToCifH264 },
     { "h265_to_d1_h265", TranscodeType::H265ToD1H265 },
@@ -62,6 +75,8 @@ std::map<std::string, TranscodeType> TranscodeTypeCvt::s_map_string_to_enum{
 std::map<TranscodeType, std::string> TranscodeTypeCvt::s_map_enum_to_string{
     { TranscodeType::H264DecodeOnly, "h264_decode_only" },
     { TranscodeType::H265DecodeOnly, "h265_decode_only" },
+    { TranscodeType::H264Snapshot, "h264_snapshot" },
+    { TranscodeType::H265Snapshot, "h265_snapshot" },
     { TranscodeType::H264ToD1H264, "h264_to_d1_h264" },
     { TranscodeType::H264ToCifH264, "h264_to_cif_h264" },
     { TranscodeType::H265ToD1H265, "h265_to_d1_h265" },
@@ -106,21 +121,401 @@ std::string TranscodeTypeCvt::support_list()
 
 
 
+// an output that keeps the input's compressed packets, nothing is decoded or encoded for it
+class FFmpegRemuxOutput {
+public:
+    FFmpegRemuxOutput(int task_id, int index, std::shared_ptr<FFmpegSink> sink, std::shared_ptr<FFmpegPacketPool> packet_pool)
+        : task_id(task_id)
+        , index(index)
+        , sink(sink)
+        , packet_pool(packet_pool)
+        , packets(0)
+        , bytes(0)
+    {
+    }
+
+    // the sink gets its own reference to the packet's buffer
+    void write(FFmpegPacket &packet)
+    {
+        packets++;
+        bytes += packet.raw_ptr()->size;
+
+        FFmpegPacket ref_packet = packet_pool->acquire();
+        if (ref_packet.is_null() || av_packet_ref(ref_packet.raw_ptr(), packet.raw_ptr()) < 0) {
+            return;
+        }
+        sink->write(ref_packet);
+    }
+
+    int task_id;
+    int index;
+
+    std::shared_ptr<FFmpegSink> sink;
+    std::shared_ptr<FFmpegPacketPool> packet_pool;
+
+    // statics
+    size_t packets;
+    int64_t bytes;
+};
+
+
+
+// decode side of a channel, shared by every transcoder
+class FFmpegTranscodeInput {
+public:
+    FFmpegTranscodeInput(int task_id, std::shared_ptr<FFmpegPacketSource> packets, std::string input_codec)
+        : task_id(task_id)
+        , packets(packets)
+        , decoder(input_codec)
+        , frame_pool(std::make_shared<FFmpegFramePool>())
+        , packet_pool(std::make_shared<FFmpegPacketPool>())
+        , decoding(true)
+        , draining(false)
+        , flushed(false)
+        , setup_ms(0.0)
+        , min_pts(INT64_MAX)
+        , max_pts(INT64_MIN)
+        , next_pts(0)
+        , first_frame(false)
+        , frames(0)
+        , ma50_decode_frame(50)
+        , ma50_decode_gop(50)
+    {
+        decoder.set_frame_pool(frame_pool);
+    }
+
+    bool setup()
+    {
+        return setup_packets() && setup_decoder(true);
+    }
+
+    bool setup_packets()
+    {
+        ti_start.reset();
+        return packets->setup();
+    }
+
+    // a channel whose outputs are all remuxed never opens the decoder
+    bool setup_decoder(bool decode)
+    {
+        decoding = decode;
+        decoder.set_packet_time_base(packets->time_base());
+        if (decoding && !decoder.setup()) {
+            return false;
+        }
+
+        setup_ms = ti_start.elapsed_milliseconds();
+        ti_task.reset();
+        return true;
+    }
+
+    // 0 when a frame is ready or, without decoding, the packet is remuxed, 1 when the decoder needs more input,
+    // < 0 to stop, INT_MIN once the input ended and the flushed decoder gave back every frame it held
+    int decode(FFmpegFrame &yuv_frame)
+    {
+        // every frame the last packet or the flush left in the decoder goes out before the next packet
+        if (draining) {
+            TimeIt ti_step;
+            int code = receive(yuv_frame, ti_step);
+            if (code != 1) {
+                return code;
+            }
+            draining = false;
+        }
+        if (flushed) {
+            return INT_MIN;
+        }
+
+        FFmpegPacket *packet = packets->next();
+        if (nullptr == packet) {
+            if (!decoding) {
+                return INT_MIN;
+            }
+
+            if (!decoder.flush()) {
+                return -1;
+            }
+            flushed = true;
+            draining = true;
+            return 1;
+        }
+        frames++;
+
+        AVPacket *raw = packet->raw_ptr();
+        int64_t pts = raw->pts != AV_NOPTS_VALUE ? raw->pts : raw->dts;
+        if (pts != AV_NOPTS_VALUE) {
+            min_pts = std::min(min_pts, pts);
+            max_pts = std::max(max_pts, pts);
+        }
+
+        for (auto remux : remuxes) {
+            remux->write(*packet);
+        }
+        if (!decoding) {
+            return 0;
+        }
+        if (dropper != nullptr && dropper->drop(*packet)) {
+            return 1;
+        }
+
+        TimeIt ti_step;
+
+        // decode
+        if (!decoder.send_packet(*packet)) {
+            return -1;
+        }
+
+        draining = true;
+        int code = receive(yuv_frame, ti_step);
+        if (1 == code) {
+            draining = false;
+        }
+        return code;
+    }
+
+    // 0 with the next frame, 1 when the decoder has none ready or reached eof, < 0 on errors
+    int receive(FFmpegFrame &yuv_frame, TimeIt &ti_step)
+    {
+        while (true) {
+            yuv_frame = decoder.receive_frame();
+            if (yuv_frame.does_need_more() || decoder.eof()) {
+                return 1;
+            }
+            if (yuv_frame.is_null()) {
+                return -1;
+            }
+
+            // scale and encode keep the frame's pts, raw streams without timestamps are numbered one frame duration apart
+            // a guess from decode order timestamps may go backwards with b-frames, it only counts when it moves forward
+            AVFrame *raw = yuv_frame.raw_ptr();
+            if (AV_NOPTS_VALUE == raw->pts) {
+                int64_t guess = raw->best_effort_timestamp;
+                raw->pts = guess != AV_NOPTS_VALUE && guess >= next_pts ? guess : next_pts;
+            }
+            next_pts = raw->pts + frame_duration();
+
+            // what the dropper had to keep, reference frames of a stream without disposable ones
+            if (nullptr == decimator || decimator->keep(yuv_frame)) {
+                break;
+            }
+            yuv_frame.free();
+        }
+
+        // calc decode time
+        double decode_elasped_ms = ti_step.elapsed_milliseconds();
+        ma50_decode_frame.add(decode_elasped_ms);
+        ma50_decode_gop.add(ma50_decode_frame.calc());
+        percentile_decode.add(decode_elasped_ms);
+
+        // channel start latency, from opening the input to the first picture
+        if (!first_frame) {
+            first_frame = true;
+            SPDLOG_INFO(
+                "task: {:2d}, first frame after {:.2f} ms, setup: {:.2f} ms, packets: {}",
+                task_id, ti_start.elapsed_milliseconds(), setup_ms, frames
+            );
+        }
+
+        return 0;
+    }
+
+    // one frame in the packet time base, at least 1
+    int64_t frame_duration()
+    {
+        auto time_base = packets->time_base();
+        double duration = (double)time_base.second / time_base.first / packets->fps();
+        return std::max((int64_t)(duration + 0.5), (int64_t)1);
+    }
+
+    // media time the packets span by their timestamps, their count at the input frame rate when they have none
+    double media_ms()
+    {
+        double frame_ms = 1000.0 / packets->fps();
+        if (max_pts < min_pts) {
+            return frames * frame_ms;
+        }
+
+        auto time_base = packets->time_base();
+        return (max_pts - min_pts) * 1000.0 * time_base.first / time_base.second + frame_ms;
+    }
+
+    std::string position()
+    {
+        int64_t total = packets->size();
+        if (total > 0) {
+            return fmt::format("progress: {:.2f}%", 100.0 * (frames - 1) / total);
+        }
+        return fmt::format("packets: {}", frames);
+    }
+
+    void progress(std::string extra = "")
+    {
+        if (0 == frames % 1000) {
+            SPDLOG_INFO(
+                "task: {:2d}, {}, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame{}",
+                task_id, position(), ma50_decode_gop.calc(), percentile_decode.calc(0.9), extra
+            );
+        }
+        else if (0 == frames % 250) {
+            SPDLOG_INFO(
+                "task: {:2d}, {}, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame{}",
+                task_id, position(), ma50_decode_frame.calc(), percentile_decode.calc(0.9), extra
+            );
+        }
+    }
+
+    double finish()
+    {
+        double expect_ms = media_ms();
+        // a remux only channel finishes in well under a millisecond per frame
+        double task_elasped_ms = ti_task.elapsed_microseconds() / 1000.0;
+        double speed = expect_ms / task_elasped_ms;
+
+        SPDLOG_INFO(
+            "task: {:2d}, progress: 100.00%, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame",
+            task_id, ma50_decode_gop.calc(), percentile_decode.calc(0.9)
+        );
+
+        // every packet sent gives a frame back, skipped pictures aside
+        if (decoding) {
+            SPDLOG_INFO("task: {:2d}, decode, packets in: {}, frames out: {}", task_id, decoder.packets_in(), decoder.frames_out());
+        }
+
+        if (dropper != nullptr) {
+            SPDLOG_INFO("task: {:2d}, {}", task_id, dropper->stats());
+        }
+        if (decimator != nullptr) {
+            SPDLOG_INFO("task: {:2d}, {}", task_id, decimator->stats());
+        }
+
+        // shells allocated by the channel, flat after the first frames once the pools are warm
+        SPDLOG_INFO("task: {:2d}, {}, {}", task_id, frame_pool->stats(frames), packet_pool->stats(frames));
+
+        // demux statics are complete once its thread is gone
+        packets->teardown();
+        std::string demux_stats = packets->stats();
+        if (!demux_stats.empty()) {
+            SPDLOG_INFO("task: {:2d}, {}", task_id, demux_stats);
+        }
+
+        return speed;
+    }
+
+    int task_id;
+    std::shared_ptr<FFmpegPacketSource> packets;
+
+    FFmpegDecode decoder;
+    bool decoding;
+
+    // the decoder may hold more frames of the last packet, and the input ended and it was flushed
+    bool draining;
+    bool flushed;
+
+    // outputs fed with the packets themselves
+    std::vector<FFmpegRemuxOutput *> remuxes;
+
+    // thins the packets sent to the decoder when a lower output frame rate is asked for
+    std::unique_ptr<H26xFrameDropper> dropper;
+
+    // brings the decoded frames down to that rate, the dropper can only skip disposable pictures
+    std::unique_ptr<FrameDecimator> decimator;
+
+    // per channel, shared by the decoder and every output
+    std::shared_ptr<FFmpegFramePool> frame_pool;
+    std::shared_ptr<FFmpegPacketPool> packet_pool;
+
+    // smallest and largest packet timestamp, and the pts given to the next decoded frame without one
+    int64_t min_pts;
+    int64_t max_pts;
+    int64_t next_pts;
+
+    // statics
+    TimeIt ti_start;
+    double setup_ms;
+    bool first_frame;
+    TimeIt ti_task;
+    size_t frames;
+    MovingAverage ma50_decode_frame;
+    MovingAverage ma50_decode_gop;
+    Percentile percentile_decode;
+};
+
+
+
+FFmpegTranscode::FFmpegTranscode()
+    : m_decode_tier(DecodeTier::Full)
+    , m_sink_type(SinkType::Null)
+    , m_sink_dir(".")
+    , m_sink_name("")
+{
+}
+
+
+void FFmpegTranscode::set_decode_tier(DecodeTier tier)
+{
+    m_decode_tier = tier;
+}
+
+
+void FFmpegTranscode::set_sink(SinkType type, std::string dir, std::string name)
+{
+    m_sink_type = type;
+    m_sink_dir = dir;
+    m_sink_name = name;
+}
+
+
+std::string FFmpegTranscode::sink_prefix()
+{
+    return m_sink_name.empty() ? fmt::format("{}/", m_sink_dir) : fmt::format("{}/{}_", m_sink_dir, m_sink_name);
+}
+
+
 double FFmpegTranscode::multi_threading_test(
-    int threads, std::vector<FFmpegPacket> &frames_queue,
+    int threads, FFmpegPacketSourceMaker make_packets,
     std::string input_codec, int input_width, int input_height,
-    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
+    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+    int workers
 ) {
+    std::vector<std::shared_ptr<FFmpegPacketSource>> sources;
+    for (int i = 0; i < std::max(threads, 1); ++i) {
+        sources.push_back(make_packets());
+    }
+    int64_t frames = sources[0]->size();
+
     SPDLOG_INFO(
-        "========== threads: {}, frames: {}, decode: {},{}{} test begin ==========",
-        threads, frames_queue.size(), input_codec,
+        "========== threads: {}, workers: {}, frames: {}, decode: {},{}{} test begin ==========",
+        threads, workers, frames, input_codec,
         output_width.empty() ? "" : fmt::format(" scale: {},", fmt::join(output_height, ", ")),
         output_codec.empty() ? "" : fmt::format(" encode: {},", fmt::join(output_codec, ", "))
     );
 
+    CodecThreadBudget::instance().add_channels(std::max(threads, 1));
+
     double total_speed = 0.0;
-    if (threads <= 1) {
-        total_speed = run(0, frames_queue, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate);
+    if (threads <= 1 && workers <= 0) {
+        total_speed = run(0, sources[0], input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate);
+    }
+    else if (workers > 0) {
+        // all channels multiplexed onto a fixed set of workers
+        ChannelScheduler scheduler(workers);
+        std::vector<std::future<double>> futures;
+
+        for (int i = 0; i < threads; ++i) {
+            std::shared_ptr<std::promise<double>> speed_promise = std::make_shared<std::promise<double>>();
+            futures.push_back(speed_promise->get_future());
+
+            schedule(
+                scheduler, i, sources[i], input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate,
+                [speed_promise](double speed) {
+                    speed_promise->set_value(speed);
+                }
+            );
+        }
+
+        for (auto &future : futures) {
+            total_speed += future.get();
+        }
     }
     else {
         std::vector<std::thread> tasks;
@@ -132,9 +527,10 @@ double FFmpegTranscode::multi_threading_test(
             std::future<double> speed_future = speed_promise->get_future();
 
             int task_id = i;
+            std::shared_ptr<FFmpegPacketSource> packets = sources[i];
             tasks.emplace_back(
-                [this, speed_promise, task_id, &frames_queue, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate]() {
-                    double result = run(task_id, frames_queue, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate);
+                [this, speed_promise, task_id, packets, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate]() {
+                    double result = run(task_id, packets, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate);
                     speed_promise->set_value(result);
                 }
             );
@@ -152,9 +548,11 @@ double FFmpegTranscode::multi_threading_test(
         }
     }
 
+    CodecThreadBudget::instance().remove_channels(std::max(threads, 1));
+
     SPDLOG_INFO(
-        "========== threads: {}, frames: {}, decode: {},{}{} test end with {:.2f}x speed ==========",
-        threads, frames_queue.size(), input_codec,
+        "========== threads: {}, workers: {}, frames: {}, decode: {},{}{} test end with {:.2f}x speed ==========",
+        threads, workers, frames, input_codec,
         output_width.empty() ? "" : fmt::format(" scale: {},", fmt::join(output_height, ", ")),
         output_codec.empty() ? "" : fmt::format(" encode: {},", fmt::join(output_codec, ", ")),
         total_speed
@@ -165,424 +563,1421 @@ double FFmpegTranscode::multi_threading_test(
 
 
 double FFmpegDecodeOnly::run(
-    int task_id, std::vector<FFmpegPacket> &frames_queue,
+    int task_id, std::shared_ptr<FFmpegPacketSource> packets,
     std::string input_codec, int input_width, int input_height,
     std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 ) {
     SPDLOG_INFO(
         "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}",
-        task_id, frames_queue.size(), input_codec, input_width, input_height
+        task_id, packets->size(), input_codec, input_width, input_height
     );
 
-    FFmpegDecode decoder(input_codec);
-    if (!decoder.setup()) {
+    FFmpegTranscodeInput input(task_id, packets, input_codec);
+    input.decoder.set_tier(m_decode_tier);
+    input.decoder.set_threads(CodecThreadBudget::instance().threads(1.0, 1.0));
+    if (!input.setup()) {
         return -1;
     }
 
+    while (true) {
+        FFmpegFrame yuv_frame(nullptr);
+        int code = input.decode(yuv_frame);
+        if (code < 0) {
+            break;
+        }
+        if (code > 0) {
+            continue;
+        }
+
+        input.progress();
+    }
+
+    return input.finish();
+}
+
+
+// one packet per work item, the next one is posted to the same strand to keep the order
+void decode_only_step(std::shared_ptr<FFmpegTranscodeInput> input, std::shared_ptr<ChannelStrand> strand, std::function<void(double)> done)
+{
+    std::function<void()> next_step = [input, strand, done]() {
+        strand->post(
+            [input, strand, done]() {
+                decode_only_step(input, strand, done);
+            }
+        );
+    };
+
+    // the demux thread is behind, park until it pushes the next packet and let the other channels run
+    if (!input->packets->ready(next_step)) {
+        return;
+    }
+
+    FFmpegFrame yuv_frame(nullptr);
+    int code = input->decode(yuv_frame);
+    if (code < 0) {
+        done(input->finish());
+        return;
+    }
+    if (0 == code) {
+        input->progress();
+    }
+
+    next_step();
+}
+
+
+void FFmpegDecodeOnly::schedule(
+    ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+    std::string input_codec, int input_width, int input_height,
+    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+    std::function<void(double)> done
+) {
+    SPDLOG_INFO(
+        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}",
+        task_id, packets->size(), input_codec, input_width, input_height
+    );
+
+    std::shared_ptr<FFmpegTranscodeInput> input = std::make_shared<FFmpegTranscodeInput>(task_id, packets, input_codec);
+    input->decoder.set_tier(m_decode_tier);
+    input->decoder.set_threads(CodecThreadBudget::instance().threads(1.0, 1.0));
+    std::shared_ptr<ChannelStrand> strand = scheduler.make_strand();
+
+    strand->post(
+        [input, strand, done]() {
+            if (!input->setup()) {
+                done(-1);
+                return;
+            }
+
+            decode_only_step(input, strand, done);
+        }
+    );
+}
+
+
+// stage costs of the codec thread budget
+bool is_hevc_codec(std::string codec_name, bool encoder) {
+    const AVCodec *codec = encoder ? avcodec_find_encoder_by_name(codec_name.c_str()) : avcodec_find_decoder_by_name(codec_name.c_str());
+    return codec != nullptr && AV_CODEC_ID_HEVC == codec->id;
+}
+
+
+std::string get_filter_text(std::string input_codec, int width, int height) {
+    if (endswith(input_codec, "_qsv")) {
+        return fmt::format("scale_qsv=w={}:h={}", width, height);
+    }
+    else if (endswith(input_codec, "_cuvid")) {
+        return fmt::format("scale_npp=w={}:h={}", width, height);
+    }
+    else if (endswith(input_codec, "_amf")) {
+        return fmt::format("scale_amf=w={}:h={}", width, height);  // not working
+    }
+    return fmt::format("scale={}:{}", width, height);
+}
+
+
+// per output state of FFmpegTranscodeN, driven either by its own consumer threads or by strands on a scheduler
+class FFmpegTranscodeOutput {
+public:
+    FFmpegTranscodeOutput(
+        int task_id, int index, int queue_depth, int src_width, int src_height, int pix_fmt, std::pair<int, int> pixel_aspect, std::pair<int, int> time_base,
+        std::string scale_filter, std::string codec, int width, int height, int64_t bitrate,
+        std::shared_ptr<FFmpegFramePool> frame_pool, std::shared_ptr<FFmpegPacketPool> packet_pool, ScaleBackend scale_backend, int scale_slices,
+        std::shared_ptr<FFmpegSink> sink
+    )
+        : task_id(task_id)
+        , index(index)
+        , scaler(src_width, src_height, pix_fmt, width, height, pix_fmt, pixel_aspect.first, pixel_aspect.second, time_base.first, time_base.second, scale_filter)
+        , encoder(codec, width, height, bitrate, pix_fmt)
+        , sink(sink)
+        , scale_queue(queue_depth)
+        , encode_queue(queue_depth)
+        , inflight(0)
+        , ma50_scale_frame(50)
+        , ma50_scale_gop(50)
+        , ma50_encode_frame(50)
+        , ma50_encode_gop(50)
+        , ma50_scale_queue(50)
+        , ma50_encode_queue(50)
+        , frames(0)
+        , passthrough(src_width == width && src_height == height)
+        , scale_setup_ms(passthrough ? 0.0 : -1.0)
+        , encode_setup_ms(-1.0)
+        , parent(nullptr)
+    {
+        scaler.set_frame_pool(frame_pool);
+        scaler.set_backend(scale_backend);
+        scaler.set_slices(scale_slices);
+        encoder.set_packet_pool(packet_pool);
+        encoder.set_global_header(sink->global_header());
+    }
+
+    // 0 on success, 1 when the frame was decimated and nothing goes on, < 0 to stop
+    int scale(FFmpegFrame &yuv_frame, FFmpegFrame &scaled_yuv_frame)
+    {
+        // neither this output nor the lower rungs fed from it encode the frame
+        if (scale_decimator != nullptr && !scale_decimator->keep(yuv_frame)) {
+            yuv_frame.free();
+            return 1;
+        }
+
+        // identity rendition, the encoder takes the decoded frame itself
+        if (passthrough) {
+            scaled_yuv_frame = std::move(yuv_frame);
+            return 0;
+        }
+
+        TimeIt ti_step;
+
+        if (!scaler.setup(yuv_frame.raw_ptr()->hw_frames_ctx)) {
+            return -2;
+        }
+        if (scale_setup_ms < 0) {
+            scale_setup_ms = ti_step.elapsed_microseconds() / 1000.0;
+        }
+
+        // scale
+        scaled_yuv_frame = scaler.scale(yuv_frame);
+        if (scaled_yuv_frame.is_null()) {
+            return INT_MIN;
+        }
+
+        // free decoded frame reference
+        yuv_frame.free();
+
+        // calc scale time
+        double scale_elasped_ms = ti_step.elapsed_milliseconds();
+        ma50_scale_frame.add(scale_elasped_ms);
+        ma50_scale_gop.add(ma50_scale_frame.calc());
+        percentile_scale.add(scale_elasped_ms);
+
+        return 0;
+    }
+
+    int encode(FFmpegFrame &scaled_yuv_frame)
+    {
+        // scaled only for the faster lower rungs
+        if (encode_decimator != nullptr && !encode_decimator->keep(scaled_yuv_frame)) {
+            scaled_yuv_frame.free();
+            return 0;
+        }
+
+        TimeIt ti_step;
+
+        // a passed through frame comes with the decoder's hardware frames
+        if (!encoder.setup(passthrough ? scaled_yuv_frame.raw_ptr()->hw_frames_ctx : scaler.hw_frames_context())) {
+            return -3;
+        }
+        if (encode_setup_ms < 0) {
+            if (!open_sink()) {
+                return -5;
+            }
+
+            encode_setup_ms = ti_step.elapsed_microseconds() / 1000.0;
+            SPDLOG_INFO(
+                "task: {:2d}, output: {}, setup scale: {:.2f} ms{}, encoder: {:.2f} ms",
+                task_id, index, scale_setup_ms, passthrough ? " (passthrough)" : scaler.from_template() ? " (template)" : "", encode_setup_ms
+            );
+        }
+
+        // encode
+        if (!encoder.send_frame(scaled_yuv_frame)) {
+            return INT_MIN;
+        }
+
+        // free scaled frame
+        scaled_yuv_frame.free();
+
+        // mux or drop every packet the frame completed
+        int code = drain();
+        if (code != 0) {
+            return code;
+        }
+
+        // calc encode time
+        double encode_elasped_ms = ti_step.elapsed_milliseconds();
+        ma50_encode_frame.add(encode_elasped_ms);
+        ma50_encode_gop.add(ma50_encode_frame.calc());
+        percentile_encode.add(encode_elasped_ms);
+
+        frames++;
+        if (0 == frames % 1000) {
+            SPDLOG_INFO(
+                "task: {:2d}, output: {}, frames: {}, ma50_scale_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_encode_gop: {:.2f} (90%th={:.2f}) ms/frame",
+                task_id, index, frames, ma50_scale_gop.calc(), percentile_scale.calc(0.9), ma50_encode_gop.calc(), percentile_encode.calc(0.9)
+            );
+        }
+
+        return 0;
+    }
+
+    // 0 once the encoder needs more input after at least one packet, 1 when it gave none, < 0 on errors
+    int drain()
+    {
+        size_t drained = 0;
+        while (true) {
+            FFmpegPacket encoded_es_packet = encoder.receive_packet();
+            if (encoded_es_packet.does_need_more() || encoder.eof()) {
+                break;
+            }
+            if (encoded_es_packet.is_null()) {
+                return INT_MIN;
+            }
+
+            sink->write(encoded_es_packet);
+            drained++;
+        }
+
+        return drained > 0 ? 0 : 1;
+    }
+
+    // end of input, every packet the encoder still holds goes to the sink
+    int flush()
+    {
+        if (!encoder.flush()) {
+            return -3;
+        }
+
+        while (!encoder.eof()) {
+            int code = drain();
+            if (code < 0) {
+                return code;
+            }
+            if (code > 0 && !encoder.eof()) {
+                SPDLOG_WARN("task: {:2d}, output: {}, encoder wants input after the flush", task_id, index);
+                break;
+            }
+        }
+
+        return 0;
+    }
+
+    // the muxer takes the opened encoder's parameters
+    bool open_sink()
+    {
+        AVCodecParameters *codecpar = avcodec_parameters_alloc();
+        bool opened = codecpar != nullptr && encoder.codec_parameters(codecpar) && sink->open(codecpar, encoder.time_base());
+        avcodec_parameters_free(&codecpar);
+
+        return opened;
+    }
+
+    int task_id;
+    int index;
+
+    FFmpegScale scaler;
+    FFmpegEncode encoder;
+    std::shared_ptr<FFmpegSink> sink;
+
+    // output frame rate below the decoded one, scale keeps what this output or its lower rungs encode, encode what this one does
+    std::unique_ptr<FrameDecimator> scale_decimator;
+    std::unique_ptr<FrameDecimator> encode_decimator;
+
+    // decode -> scale, and scale -> encode in pipeline mode
+    SpscQueue<FFmpegFrame> scale_queue;
+    SpscQueue<FFmpegFrame> encode_queue;
+
+    std::thread scale_thread;
+    std::thread encode_thread;
+
+    // scheduler mode, frames posted but not yet encoded
+    std::shared_ptr<ChannelStrand> scale_strand;
+    std::shared_ptr<ChannelStrand> encode_strand;
+    std::atomic<int> inflight;
+
     // statics
-    TimeIt ti_task;
-    TimeIt ti_step;
-    size_t frames = frames_queue.size();
-    MovingAverage ma50_decode_frame(50);
-    MovingAverage ma50_decode_gop(50);
-    Percentile percentile_decode;
+    MovingAverage ma50_scale_frame;
+    MovingAverage ma50_scale_gop;
+    Percentile percentile_scale;
+    MovingAverage ma50_encode_frame;
+    MovingAverage ma50_encode_gop;
+    Percentile percentile_encode;
+    MovingAverage ma50_scale_queue;
+    MovingAverage ma50_encode_queue;
+    size_t frames;
 
-    int index = 1;
-    for (auto i = 0; i < frames_queue.size(); i++) {
-        ti_step.reset();
+    // source and output sizes match, nothing is scaled
+    bool passthrough;
 
-        // decode
-        if (!decoder.send_packet(frames_queue[i])) {
-            break;
+    // first setup of each stage, for the startup log
+    double scale_setup_ms;
+    double encode_setup_ms;
+
+    // scale cascade, fed by the parent's scaled frames instead of decoded ones
+    FFmpegTranscodeOutput *parent;
+    std::vector<FFmpegTranscodeOutput *> children;
+};
+
+
+// one FFmpegTranscodeN channel, the decode side plus every output
+class FFmpegTranscodeNChannel : public std::enable_shared_from_this<FFmpegTranscodeNChannel> {
+public:
+    FFmpegTranscodeNChannel(
+        int task_id, std::shared_ptr<FFmpegPacketSource> packets, std::string input_codec, int input_width, int input_height,
+        std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+        int queue_depth, bool pipeline, bool scale_cascade, ScaleBackend scale_backend, std::vector<int> scale_slices, double output_fps,
+        std::vector<double> rendition_fps, std::vector<std::string> rendition_preset, std::vector<int> rendition_gop,
+        SinkType sink_type, std::string sink_prefix
+    )
+        : input(task_id, packets, input_codec)
+        , input_codec(input_codec)
+        , input_width(input_width)
+        , input_height(input_height)
+        , output_codec(output_codec)
+        , output_width(output_width)
+        , output_height(output_height)
+        , output_bitrate(output_bitrate)
+        , queue_depth(queue_depth)
+        , pipeline(pipeline)
+        , scale_cascade(scale_cascade)
+        , scale_backend(scale_backend)
+        , scale_slices(scale_slices)
+        , output_fps(output_fps)
+        , rendition_fps(rendition_fps)
+        , rendition_preset(rendition_preset)
+        , rendition_gop(rendition_gop)
+        , sink_type(sink_type)
+        , sink_prefix(sink_prefix)
+        , error_code(0)
+        , stopped(false)
+        , decode_parked(false)
+        , remaining_outputs(0)
+    {
+    }
+
+    bool setup()
+    {
+        if (!input.setup_packets()) {
+            return false;
         }
 
-        FFmpegFrame yuv_frame = decoder.receive_frame();
-        if (yuv_frame.does_need_more()) {
-            continue;
+        // renditions the input already satisfies are remuxed, the others are decoded once and transcoded
+        int64_t input_bitrate = input.packets->bit_rate();
+        std::vector<size_t> transcodes;
+        std::vector<int> transcode_width;
+        std::vector<int> transcode_height;
+        for (size_t i = 0; i < output_codec.size(); i++) {
+            if (remuxable(i, input_bitrate)) {
+                SPDLOG_INFO(
+                    "task: {:2d}, output: {}, remux, {} {}x{} at {} bps is within the {} bps ceiling",
+                    input.task_id, i, input_codec, input_width, input_height, input_bitrate, output_bitrate[i]
+                );
+                std::shared_ptr<FFmpegSink> sink = create_sink(i);
+                if (nullptr == sink || !open_remux_sink(*sink)) {
+                    return false;
+                }
+                remux_outputs.emplace_back(new FFmpegRemuxOutput(input.task_id, (int)i, sink, input.packet_pool));
+                input.remuxes.push_back(remux_outputs.back().get());
+                continue;
+            }
+
+            transcodes.push_back(i);
+            transcode_width.push_back(output_width[i]);
+            transcode_height.push_back(output_height[i]);
         }
-        if (yuv_frame.is_null()) {
-            break;
+
+        // rate of the decoded frames, and of what each transcoded output encodes
+        double input_fps = input.packets->fps();
+        double decoded_fps = output_fps > 0.0 ? std::min(output_fps, input_fps) : input_fps;
+        std::vector<double> encode_fps;
+        for (size_t i : transcodes) {
+            encode_fps.push_back(output_rendition_fps(i) > 0.0 ? std::min(output_rendition_fps(i), decoded_fps) : decoded_fps);
         }
 
-        // calc decode time
-        double decode_elasped_ms = ti_step.elapsed_milliseconds();
-        ma50_decode_frame.add(decode_elasped_ms);
-        ma50_decode_gop.add(ma50_decode_frame.calc());
-        percentile_decode.add(decode_elasped_ms);
-        ti_step.reset();
+        // the decoder and every transcoded output split the channel's share of the codec threads by what they cost
+        CodecThreadBudget &budget = CodecThreadBudget::instance();
+        double decode_cost = CodecThreadBudget::decode_cost(is_hevc_codec(input_codec, false), input_width, input_height);
+        std::vector<double> encode_cost;
+        double channel_cost = decode_cost;
+        for (size_t k = 0; k < transcodes.size(); k++) {
+            size_t i = transcodes[k];
+            double cost = CodecThreadBudget::encode_cost(is_hevc_codec(output_codec[i], true), output_width[i], output_height[i]);
+            encode_cost.push_back(cost * encode_fps[k] / decoded_fps);
+            channel_cost += encode_cost.back();
+        }
+        std::vector<int> codec_threads;
+        if (!transcodes.empty()) {
+            codec_threads.push_back(budget.threads(decode_cost, channel_cost));
+            input.decoder.set_threads(codec_threads.back());
+        }
 
-        if (0 == (i + 1) % 1000) {
-            double progress = 100.0 * i / frames;
+        if (!input.setup_decoder(!transcodes.empty())) {
+            return false;
+        }
+        if (transcodes.empty()) {
+            return true;
+        }
+
+        int pix_fmt = input.decoder.pixel_format();
+        auto time_base = input.packets->time_base();
+
+        // remuxes only run at the input rate, the dropper thins what is decoded
+        // and the decimator drops the rest, so the encoders really get decoded_fps
+        if (output_fps > 0.0 && output_fps < input_fps) {
+            const AVCodec *decoder = avcodec_find_decoder_by_name(input_codec.c_str());
+            if (decoder != nullptr && (AV_CODEC_ID_H264 == decoder->id || AV_CODEC_ID_HEVC == decoder->id)) {
+                input.dropper.reset(new H26xFrameDropper(decoder->id, input_fps, output_fps));
+            }
+            input.decimator.reset(new FrameDecimator(input_fps, output_fps, time_base));
+        }
+        auto pixel_aspect = input.decoder.pixel_aspect();
+
+        FFmpegScaleCascade cascade(input_width, input_height, transcode_width, transcode_height, scale_cascade);
+        for (size_t k = 0; k < transcodes.size(); k++) {
+            size_t i = transcodes[k];
+            std::shared_ptr<FFmpegSink> sink = create_sink(i);
+            if (nullptr == sink) {
+                return false;
+            }
+            outputs.emplace_back(
+                new FFmpegTranscodeOutput(
+                    input.task_id, (int)i, queue_depth, cascade.src_width(k), cascade.src_height(k), pix_fmt, pixel_aspect, time_base,
+                    get_filter_text(input_codec, output_width[i], output_height[i]), output_codec[i], output_width[i], output_height[i], output_bitrate[i],
+                    input.frame_pool, input.packet_pool, scale_backend, output_scale_slices(i), sink
+                )
+            );
+            outputs.back()->encoder.set_frame_rate(encode_fps[k]);
+            if (i < rendition_preset.size()) {
+                outputs.back()->encoder.set_preset(rendition_preset[i]);
+            }
+            if (i < rendition_gop.size()) {
+                outputs.back()->encoder.set_gop_size(rendition_gop[i]);
+            }
+            outputs.back()->encoder.set_time_base(time_base);
+            codec_threads.push_back(budget.threads(encode_cost[k], channel_cost));
+            outputs.back()->encoder.set_threads(codec_threads.back());
+            if (outputs.back()->passthrough) {
+                SPDLOG_INFO("task: {:2d}, output: {}, passthrough, {}x{} is the decoded size", input.task_id, i, output_width[i], output_height[i]);
+            }
+        }
+        remaining_outputs.store((int)outputs.size());
+        if (budget.cores() > 0) {
             SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_gop.calc(), percentile_decode.calc(0.9)
+                "task: {:2d}, codec threads, decode: {}, encode: {}",
+                input.task_id, codec_threads[0], fmt::join(codec_threads.begin() + 1, codec_threads.end(), ", ")
             );
         }
-        else if (0 == (i + 1) % 250) {
-            double progress = 100.0 * i / frames;
+
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (cascade.parent(i) >= 0) {
+                outputs[i]->parent = outputs[cascade.parent(i)].get();
+                outputs[cascade.parent(i)]->children.push_back(outputs[i].get());
+            }
+            else {
+                roots.push_back(outputs[i].get());
+            }
+        }
+        if (scale_cascade) {
+            SPDLOG_INFO("task: {:2d}, scale cascade: {}", input.task_id, cascade.to_string());
+        }
+
+        // a cascade parent scales at the rate of its fastest lower rung, and only encodes at its own
+        for (size_t k = 0; k < outputs.size(); k++) {
+            double scale_fps = subtree_fps(k, encode_fps);
+            double source_fps = cascade.parent(k) >= 0 ? subtree_fps((size_t)cascade.parent(k), encode_fps) : decoded_fps;
+            if (scale_fps < source_fps) {
+                outputs[k]->scale_decimator.reset(new FrameDecimator(source_fps, scale_fps, time_base));
+            }
+            if (encode_fps[k] < scale_fps) {
+                outputs[k]->encode_decimator.reset(new FrameDecimator(scale_fps, encode_fps[k], time_base));
+            }
+            if (encode_fps[k] < decoded_fps) {
+                SPDLOG_INFO("task: {:2d}, output: {}, {:.2f} fps, scaled at {:.2f} fps", input.task_id, outputs[k]->index, encode_fps[k], scale_fps);
+            }
+        }
+
+        // a ring buffer per frame alive between scale and encode: the one being scaled, the encode queue,
+        // the one being sent plus what the encoder keeps, and the clones queued for the children
+        for (auto &output : outputs) {
+            if (!output->passthrough) {
+                output->scaler.set_dst_pool_depth(2 + (size_t)queue_depth * (1 + output->children.size()) + output->encoder.inflight_frames());
+            }
+        }
+
+        return true;
+    }
+
+    // same codec at the input size and rate, the input bitrate is already under the output's ceiling,
+    // and the input has the parameter sets a muxer needs to take its packets as they are
+    bool remuxable(size_t index, int64_t input_bitrate)
+    {
+        if (input_bitrate <= 0 || input_bitrate > output_bitrate[index]) {
+            return false;
+        }
+        // a remux passes every packet, a lower output_fps or rendition rate needs the dropper and decimator of a transcode
+        if (output_fps > 0.0 && output_fps < input.packets->fps()) {
+            return false;
+        }
+        if (output_rendition_fps(index) > 0.0 && output_rendition_fps(index) < input.packets->fps()) {
+            return false;
+        }
+        const AVCodecParameters *input_codecpar = input.packets->codec_parameters();
+        if (nullptr == input_codecpar || input_codecpar->extradata_size <= 0) {
+            return false;
+        }
+        // the sink numbers pts-less packets in decode order, b-frames would be shown out of order
+        if (input_codecpar->video_delay > 0 && !input.packets->has_pts()) {
+            return false;
+        }
+        if (output_width[index] != input_width || output_height[index] != input_height) {
+            return false;
+        }
+
+        const AVCodec *decoder = avcodec_find_decoder_by_name(input_codec.c_str());
+        const AVCodec *encoder = avcodec_find_encoder_by_name(output_codec[index].c_str());
+        return decoder != nullptr && encoder != nullptr && decoder->id == encoder->id;
+    }
+
+    std::shared_ptr<FFmpegSink> create_sink(size_t index)
+    {
+        std::string url = fmt::format("{}task{}_output{}.{}", sink_prefix, input.task_id, index, FFmpegSink::extension(sink_type));
+        std::shared_ptr<FFmpegSink> sink = FFmpegSink::create(sink_type, url);
+        if (nullptr == sink) {
+            SPDLOG_ERROR("create sink error, type: {}, url: {}", SinkTypeCvt::to_string(sink_type), url);
+        }
+        return sink;
+    }
+
+    // remuxed packets keep the input's stream parameters, extradata included, and timestamps
+    bool open_remux_sink(FFmpegSink &sink)
+    {
+        AVCodecParameters *codecpar = avcodec_parameters_alloc();
+        if (nullptr == codecpar || avcodec_parameters_copy(codecpar, input.packets->codec_parameters()) < 0) {
+            SPDLOG_ERROR("task: {:2d}, copy input codec parameters error", input.task_id);
+            avcodec_parameters_free(&codecpar);
+            return false;
+        }
+        if (codecpar->bit_rate <= 0) {
+            codecpar->bit_rate = input.packets->bit_rate();
+        }
+
+        bool opened = sink.open(codecpar, input.packets->time_base());
+        avcodec_parameters_free(&codecpar);
+
+        return opened;
+    }
+
+    // one entry per output, the last one also covers the outputs after it
+    int output_scale_slices(size_t index)
+    {
+        if (scale_slices.empty()) {
+            return 1;
+        }
+        return scale_slices[std::min(index, scale_slices.size() - 1)];
+    }
+
+    // one entry per output, the last one also covers the outputs after it, 0 keeps the decoded rate
+    double output_rendition_fps(size_t index)
+    {
+        if (rendition_fps.empty()) {
+            return 0.0;
+        }
+        return rendition_fps[std::min(index, rendition_fps.size() - 1)];
+    }
+
+    // fastest rate output k or a lower rung fed from it encodes at
+    double subtree_fps(size_t k, const std::vector<double> &encode_fps)
+    {
+        double fps = encode_fps[k];
+        for (auto child : outputs[k]->children) {
+            for (size_t j = 0; j < outputs.size(); j++) {
+                if (outputs[j].get() == child) {
+                    fps = std::max(fps, subtree_fps(j, encode_fps));
+                }
+            }
+        }
+        return fps;
+    }
+
+    // first error wins, INT_MIN only stops
+    void stop(int code)
+    {
+        int expected = 0;
+        error_code.compare_exchange_strong(expected, code == INT_MIN ? 0 : code);
+        stopped.store(true);
+
+        for (auto &output : outputs) {
+            output->scale_queue.close();
+            output->encode_queue.close();
+        }
+    }
+
+    // every consumer gets its own reference to the same buffers, the last one takes the frame itself
+    FFmpegFrame reference(FFmpegFrame &yuv_frame, bool last)
+    {
+        if (last) {
+            return std::move(yuv_frame);
+        }
+
+        FFmpegFrame ref_frame = input.frame_pool->clone(yuv_frame);
+        if (ref_frame.is_null()) {
+            SPDLOG_ERROR("clone frame error");
+            stop(-4);
+        }
+        return ref_frame;
+    }
+
+    double finish()
+    {
+        if (error_code.load() != 0) {
+            return error_code.load();
+        }
+
+        // the io threads are part of the work, speed counts until the last packet is written
+        for (auto &output : outputs) {
+            if (output->flush() < 0) {
+                SPDLOG_WARN("task: {:2d}, output: {}, flush encoder error", input.task_id, output->index);
+            }
+            output->sink->close();
+        }
+        for (auto &remux : remux_outputs) {
+            remux->sink->close();
+        }
+
+        double speed = input.finish();
+
+        for (auto &output : outputs) {
+            SPDLOG_INFO(
+                "task: {:2d}, output: {}, frames: {}, ma50_scale_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_encode_gop: {:.2f} (90%th={:.2f}) ms/frame, "
+                "ma50_scale_queue: {:.2f}/{} (full_waits={}, empty_waits={}), ma50_encode_queue: {:.2f}/{} (full_waits={}, empty_waits={})",
+                input.task_id, output->index, output->frames, output->ma50_scale_gop.calc(), output->percentile_scale.calc(0.9), output->ma50_encode_gop.calc(), output->percentile_encode.calc(0.9),
+                output->ma50_scale_queue.calc(), output->scale_queue.capacity(), output->scale_queue.full_waits(), output->scale_queue.empty_waits(),
+                output->ma50_encode_queue.calc(), output->encode_queue.capacity(), output->encode_queue.full_waits(), output->encode_queue.empty_waits()
+            );
+
+            for (FrameDecimator *decimator : { output->scale_decimator.get(), output->encode_decimator.get() }) {
+                if (decimator != nullptr) {
+                    SPDLOG_INFO("task: {:2d}, output: {}, {}", input.task_id, output->index, decimator->stats());
+                }
+            }
+
+            std::string ring_stats = output->scaler.dst_pool_stats(output->frames);
+            if (!ring_stats.empty()) {
+                SPDLOG_INFO("task: {:2d}, output: {}, {}", input.task_id, output->index, ring_stats);
+            }
             SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_frame.calc(), percentile_decode.calc(0.9)
+                "task: {:2d}, output: {}, encode, frames in: {}, packets out: {}, {}",
+                input.task_id, output->index, output->encoder.frames_in(), output->encoder.packets_out(), output->sink->stats()
             );
         }
+
+        for (auto &remux : remux_outputs) {
+            SPDLOG_INFO("task: {:2d}, output: {}, remux, packets: {}, bytes: {}, {}", input.task_id, remux->index, remux->packets, remux->bytes, remux->sink->stats());
+        }
+
+        return speed;
+    }
+
+    // scheduler mode, every stage is a strand and every frame a work item
+    void start(ChannelScheduler &scheduler, std::function<void(double)> on_done)
+    {
+        done = on_done;
+        decode_strand = scheduler.make_strand();
+
+        std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+        ChannelScheduler *sched = &scheduler;
+        decode_strand->post(
+            [self, sched]() {
+                if (!self->setup()) {
+                    self->done(-1);
+                    return;
+                }
+
+                for (auto &output : self->outputs) {
+                    output->scale_strand = sched->make_strand();
+                    output->encode_strand = self->pipeline ? sched->make_strand() : output->scale_strand;
+                }
+
+                self->decode_step();
+            }
+        );
+    }
+
+    bool has_room()
+    {
+        for (auto &output : outputs) {
+            if (output->inflight.load() >= queue_depth) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void decode_step()
+    {
+        if (stopped.load()) {
+            end_of_input();
+            return;
+        }
+
+        // the demux thread is behind, park until it pushes the next packet and let the other channels run
+        std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+        if (!input.packets->ready([self]() { self->post_decode(); })) {
+            return;
+        }
+
+        FFmpegFrame yuv_frame(nullptr);
+        int code = input.decode(yuv_frame);
+        if (code < 0) {
+            end_of_input();
+            return;
+        }
+
+        if (0 == code) {
+            for (size_t j = 0; j < roots.size(); j++) {
+                post_scale(roots[j], reference(yuv_frame, j + 1 == roots.size()));
+            }
+
+            input.progress();
+        }
+
+        // park until the slowest output has room again
+        if (!has_room()) {
+            decode_parked.store(true);
+            if (!has_room()) {
+                return;
+            }
+
+            bool expected = true;
+            if (!decode_parked.compare_exchange_strong(expected, false)) {
+                return;
+            }
+        }
+
+        post_decode();
+    }
+
+    void post_decode()
+    {
+        std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+        decode_strand->post(
+            [self]() {
+                self->decode_step();
+            }
+        );
+    }
+
+    void post_scale(FFmpegTranscodeOutput *o, FFmpegFrame yuv_frame)
+    {
+        std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+        std::shared_ptr<FFmpegFrame> ref_frame = std::make_shared<FFmpegFrame>(std::move(yuv_frame));
+
+        o->ma50_scale_queue.add((double)o->inflight.fetch_add(1));
+        o->scale_strand->post(
+            [self, o, ref_frame]() {
+                self->scale_step(o, *ref_frame);
+            }
+        );
+    }
+
+    void scale_step(FFmpegTranscodeOutput *o, FFmpegFrame &yuv_frame)
+    {
+        if (stopped.load()) {
+            yuv_frame.free();
+            frame_done(o);
+            return;
+        }
+
+        FFmpegFrame scaled_yuv_frame(nullptr);
+        int code = o->scale(yuv_frame, scaled_yuv_frame);
+        if (code != 0) {
+            if (code < 0) {
+                stop(code);
+            }
+            frame_done(o);
+            return;
+        }
+
+        // lower rungs start from this output
+        for (auto child : o->children) {
+            FFmpegFrame ref_frame = reference(scaled_yuv_frame, false);
+            if (ref_frame.is_null()) {
+                break;
+            }
+            post_scale(child, std::move(ref_frame));
+        }
+
+        if (pipeline) {
+            std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+            std::shared_ptr<FFmpegFrame> scaled_frame = std::make_shared<FFmpegFrame>(std::move(scaled_yuv_frame));
+
+            o->ma50_encode_queue.add((double)o->encode_strand->pending());
+            o->encode_strand->post(
+                [self, o, scaled_frame]() {
+                    self->encode_step(o, *scaled_frame);
+                }
+            );
+            return;
+        }
+
+        encode_step(o, scaled_yuv_frame);
+    }
+
+    void encode_step(FFmpegTranscodeOutput *o, FFmpegFrame &scaled_yuv_frame)
+    {
+        if (!stopped.load()) {
+            int code = o->encode(scaled_yuv_frame);
+            if (code < 0) {
+                stop(code);
+            }
+        }
+
+        scaled_yuv_frame.free();
+        frame_done(o);
+    }
+
+    void frame_done(FFmpegTranscodeOutput *o)
+    {
+        o->inflight.fetch_sub(1);
+
+        if (decode_parked.load() && has_room()) {
+            bool expected = true;
+            if (decode_parked.compare_exchange_strong(expected, false)) {
+                post_decode();
+            }
+        }
+    }
+
+    // the end marker follows the frames through every strand of an output
+    void end_of_input()
+    {
+        for (auto o : roots) {
+            end_of_output(o);
+        }
+
+        if (outputs.empty()) {
+            done(finish());
+        }
     }
 
-    double expect_ms = frames * 40.0;
-    double task_elasped_ms = ti_task.elapsed_milliseconds();
-    double speed = expect_ms / task_elasped_ms;
+    void end_of_output(FFmpegTranscodeOutput *o)
+    {
+        std::shared_ptr<FFmpegTranscodeNChannel> self = shared_from_this();
+        o->scale_strand->post(
+            [self, o]() {
+                // every frame for the lower rungs is posted by now, their markers go behind them
+                for (auto child : o->children) {
+                    self->end_of_output(child);
+                }
 
-    SPDLOG_INFO(
-        "task: {:2d}, progress: 100.00%, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame",
-        task_id, ma50_decode_frame.calc(), percentile_decode.calc(0.9)
-    );
+                o->encode_strand->post(
+                    [self]() {
+                        self->output_finished();
+                    }
+                );
+            }
+        );
+    }
 
-    return speed;
-}
+    void output_finished()
+    {
+        if (1 == remaining_outputs.fetch_sub(1)) {
+            done(finish());
+        }
+    }
 
+    FFmpegTranscodeInput input;
+    std::vector<std::unique_ptr<FFmpegTranscodeOutput>> outputs;
+    std::vector<std::unique_ptr<FFmpegRemuxOutput>> remux_outputs;
+
+    // outputs fed by the decoder, the others by their parent
+    std::vector<FFmpegTranscodeOutput *> roots;
+
+    std::string input_codec;
+    int input_width;
+    int input_height;
+    std::vector<std::string> output_codec;
+    std::vector<int> output_width;
+    std::vector<int> output_height;
+    std::vector<int64_t> output_bitrate;
+    int queue_depth;
+    bool pipeline;
+    bool scale_cascade;
+    ScaleBackend scale_backend;
+    std::vector<int> scale_slices;
+    double output_fps;
+    std::vector<double> rendition_fps;
+    std::vector<std::string> rendition_preset;
+    std::vector<int> rendition_gop;
+    SinkType sink_type;
+    std::string sink_prefix;
+
+    std::atomic<int> error_code;
+    std::atomic<bool> stopped;
+
+    // scheduler mode
+    std::shared_ptr<ChannelStrand> decode_strand;
+    std::function<void(double)> done;
+    std::atomic<bool> decode_parked;
+    std::atomic<int> remaining_outputs;
+};
 
-std::string get_filter_text(std::string input_codec, int width, int height) {
-    if (endswith(input_codec, "_qsv")) {
-        return fmt::format("scale_qsv=w={}:h={}", width, height);
-    }
-    else if (endswith(input_codec, "_cuvid")) {
-        return fmt::format("scale_npp=w={}:h={}", width, height);
-    }
-    else if (endswith(input_codec, "_amf")) {
-        return fmt::format("scale_amf=w={}:h={}", width, height);  // not working
-    }
-    return fmt::format("scale={}:{}", width, height);
+
+FFmpegTranscodeN::FFmpegTranscodeN(
+    int queue_depth, bool pipeline, bool scale_cascade, ScaleBackend scale_backend, std::vector<int> scale_slices, double output_fps,
+    std::vector<double> rendition_fps
+)
+    : m_queue_depth(queue_depth > 0 ? queue_depth : 1)
+    , m_pipeline(pipeline)
+    , m_scale_cascade(scale_cascade)
+    , m_scale_backend(scale_backend)
+    , m_scale_slices(scale_slices)
+    , m_output_fps(output_fps)
+    , m_rendition_fps(rendition_fps)
+{
 }
 
 
-double FFmpegTranscodeOne::run(
-    int task_id, std::vector<FFmpegPacket> &frames_queue,
+double FFmpegTranscodeN::run(
+    int task_id, std::shared_ptr<FFmpegPacketSource> packets,
     std::string input_codec, int input_width, int input_height,
     std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 ) {
     SPDLOG_INFO(
-        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}, output_codec: {}, output_width: {}, output_height: {}, output_bitrate: {}",
-        task_id, frames_queue.size(), input_codec, input_width, input_height, fmt::join(output_codec, ", "), fmt::join(output_width, ", "),
-        fmt::join(output_height, ", "), fmt::join(output_bitrate, ", ")
+        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}, output_codec: {}, output_width: {}, output_height: {}, output_bitrate: {}, queue_depth: {}, pipeline: {}, scale_cascade: {}, scale_backend: {}, scale_slices: {}, output_fps: {}, rendition_fps: {}",
+        task_id, packets->size(), input_codec, input_width, input_height, fmt::join(output_codec, ", "), fmt::join(output_width, ", "),
+        fmt::join(output_height, ", "), fmt::join(output_bitrate, ", "), m_queue_depth, m_pipeline, m_scale_cascade,
+        ScaleBackendCvt::to_string(m_scale_backend), fmt::join(m_scale_slices, ", "), m_output_fps, fmt::join(m_rendition_fps, ", ")
     );
 
-    FFmpegDecode decoder(input_codec);
-    if (!decoder.setup()) {
+    FFmpegTranscodeNChannel channel(
+        task_id, packets, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate,
+        m_queue_depth, m_pipeline, m_scale_cascade, m_scale_backend, m_scale_slices, m_output_fps, m_rendition_fps,
+        m_rendition_preset, m_rendition_gop, m_sink_type, sink_prefix()
+    );
+    channel.input.decoder.set_tier(m_decode_tier);
+    if (!channel.setup()) {
         return -1;
     }
 
-    int pix_fmt = decoder.pixel_format();
-    auto time_base = decoder.time_base();
-    auto pixel_aspect = decoder.pixel_aspect();
-    std::string scale_filter = get_filter_text(input_codec, output_width[0], output_height[0]);
-
-    FFmpegScale scaler(input_width, input_height, pix_fmt, output_width[0], output_height[0], pix_fmt, pixel_aspect.first, pixel_aspect.second, time_base.first, time_base.second, scale_filter);
-
-    FFmpegEncode encoder(output_codec[0], output_width[0], output_height[0], output_bitrate[0], pix_fmt);
-
-    // statics
-    TimeIt ti_task;
-    TimeIt ti_step;
-    size_t frames = frames_queue.size();
-    MovingAverage ma50_decode_frame(50);
-    MovingAverage ma50_decode_gop(50);
-    Percentile percentile_decode;
-    MovingAverage ma50_scale_frame(50);
-    MovingAverage ma50_scale_gop(50);
-    Percentile percentile_scale;
-    MovingAverage ma50_encode_frame(50);
-    MovingAverage ma50_encode_gop(50);
-    Percentile percentile_encode;
+    for (auto &output : channel.outputs) {
+        FFmpegTranscodeOutput *o = output.get();
+        FFmpegTranscodeNChannel *c = &channel;
+
+        o->scale_thread = std::thread(
+            [o, c]() {
+                FFmpegFrame yuv_frame(nullptr);
+                while (o->scale_queue.pop(yuv_frame)) {
+                    FFmpegFrame scaled_yuv_frame(nullptr);
+                    int code = o->scale(yuv_frame, scaled_yuv_frame);
+                    if (code < 0) {
+                        c->stop(code);
+                        break;
+                    }
+                    if (code > 0) {
+                        continue;
+                    }
+
+                    // lower rungs start from this output
+                    bool stopped = false;
+                    for (auto child : o->children) {
+                        FFmpegFrame ref_frame = c->reference(scaled_yuv_frame, false);
+                        if (ref_frame.is_null() || !child->scale_queue.push(ref_frame)) {
+                            stopped = true;
+                            break;
+                        }
+                    }
+                    if (stopped) {
+                        break;
+                    }
+
+                    if (c->pipeline) {
+                        // occupancy seen by the producer, near depth means encode is the bottleneck
+                        o->ma50_encode_queue.add((double)o->encode_queue.size());
+                        if (!o->encode_queue.push(scaled_yuv_frame)) {
+                            break;
+                        }
+                        continue;
+                    }
+
+                    code = o->encode(scaled_yuv_frame);
+                    if (code < 0) {
+                        c->stop(code);
+                        break;
+                    }
+                }
 
-    int index = 1;
-    for (auto i = 0; i < frames_queue.size(); i++) {
-        ti_step.reset();
+                o->encode_queue.close();
+                for (auto child : o->children) {
+                    child->scale_queue.close();
+                }
+            }
+        );
 
-        // decode
-        if (!decoder.send_packet(frames_queue[i])) {
-            break;
+        if (c->pipeline) {
+            o->encode_thread = std::thread(
+                [o, c]() {
+                    FFmpegFrame scaled_yuv_frame(nullptr);
+                    while (o->encode_queue.pop(scaled_yuv_frame)) {
+                        int code = o->encode(scaled_yuv_frame);
+                        if (code < 0) {
+                            c->stop(code);
+                            break;
+                        }
+                    }
+                }
+            );
         }
+    }
 
-        FFmpegFrame yuv_frame = decoder.receive_frame();
-        if (yuv_frame.does_need_more()) {
-            continue;
-        }
-        if (yuv_frame.is_null()) {
+    while (true) {
+        FFmpegFrame yuv_frame(nullptr);
+        int code = channel.input.decode(yuv_frame);
+        if (code < 0) {
             break;
         }
-
-        // calc decode time
-        double decode_elasped_ms = ti_step.elapsed_milliseconds();
-        ma50_decode_frame.add(decode_elasped_ms);
-        ma50_decode_gop.add(ma50_decode_frame.calc());
-        percentile_decode.add(decode_elasped_ms);
-        ti_step.reset();
-
-        if (!scaler.setup(yuv_frame.raw_ptr()->hw_frames_ctx)) {
-            return -2;
-        }
-
-        // scale
-        FFmpegFrame scaled_yuv_frame = scaler.scale(yuv_frame);
-        if (scaled_yuv_frame.is_null()) {
-            break;
+        if (code > 0) {
+            continue;
         }
 
-        // free decoed frame
-        yuv_frame.free();
-
-        // calc scale time
-        double scale_elasped_ms = ti_step.elapsed_milliseconds();
-        ma50_scale_frame.add(scale_elasped_ms);
-        ma50_scale_gop.add(ma50_scale_frame.calc());
-        percentile_scale.add(scale_elasped_ms);
-        ti_step.reset();
-
-        if (!encoder.setup(scaler.hw_frames_context())) {
-            return -3;
+        // fan out, the decoder only waits when an output queue is full
+        bool stopped = false;
+        for (size_t j = 0; j < channel.roots.size(); j++) {
+            FFmpegTranscodeOutput *o = channel.roots[j];
+            FFmpegFrame ref_frame = channel.reference(yuv_frame, j + 1 == channel.roots.size());
+
+            // occupancy seen by the producer, near depth means this output is the bottleneck
+            o->ma50_scale_queue.add((double)o->scale_queue.size());
+            if (!o->scale_queue.push(ref_frame)) {
+                stopped = true;
+                break;
+            }
         }
-
-        // encode
-        if (!encoder.send_frame(scaled_yuv_frame)) {
+        if (stopped) {
             break;
         }
 
-        // free scaled frame
-        scaled_yuv_frame.free();
-
-        FFmpegPacket encoded_es_packet = encoder.receive_packet();
-        if (encoded_es_packet.does_need_more()) {
-            continue;
-        }
-        if (encoded_es_packet.is_null()) {
-            break;
+        std::vector<std::string> queues;
+        for (auto &output : channel.outputs) {
+            queues.push_back(fmt::format("{}/{}", output->scale_queue.size(), output->scale_queue.capacity()));
         }
+        channel.input.progress(fmt::format(", scale_queues: {}", fmt::join(queues, ", ")));
+    }
 
-        //printf("i: %d, size: %d\n", i, encoded_es_packet.raw_ptr()->size);
-
-        // free encoded frame
-        encoded_es_packet.free();
-
-        // calc encode time
-        double encode_elasped_ms = ti_step.elapsed_milliseconds();
-        ma50_encode_frame.add(encode_elasped_ms);
-        ma50_encode_gop.add(ma50_encode_frame.calc());
-        percentile_encode.add(encode_elasped_ms);
-        ti_step.reset();
-
-        if (0 == (i + 1) % 1000) {
-            double progress = 100.0 * i / frames;
-            SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_scale_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_encode_gop: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_gop.calc(), percentile_decode.calc(0.9), ma50_scale_gop.calc(), percentile_scale.calc(0.9), ma50_encode_gop.calc(), percentile_encode.calc(0.9)
-            );
-        }
-        else if (0 == (i + 1) % 250) {
-            double progress = 100.0 * i / frames;
-            SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame, ma50_scale_frame: {:.2f} (90%th={:.2f}) ms/frame, ma50_encode_frame: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_frame.calc(), percentile_decode.calc(0.9), ma50_scale_frame.calc(), percentile_scale.calc(0.9), ma50_encode_frame.calc(), percentile_encode.calc(0.9)
-            );
+    // let every output drain what is queued, lower rungs are closed by their parent
+    for (auto o : channel.roots) {
+        o->scale_queue.close();
+    }
+    for (auto &output : channel.outputs) {
+        output->scale_thread.join();
+        if (output->encode_thread.joinable()) {
+            output->encode_thread.join();
         }
     }
 
-    double expect_ms = frames * 40.0;
-    double task_elasped_ms = ti_task.elapsed_milliseconds();
-    double speed = expect_ms / task_elasped_ms;
-
-    SPDLOG_INFO(
-        "task: {:2d}, progress: 100.00%, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_scale_gop: {:.2f} (90%th={:.2f}) ms/frame, ma50_encode_gop: {:.2f} (90%th={:.2f}) ms/frame",
-        task_id, ma50_decode_gop.calc(), percentile_decode.calc(0.9), ma50_scale_gop.calc(), percentile_scale.calc(0.9), ma50_encode_gop.calc(), percentile_encode.calc(0.9)
-    );
-
-    return speed;
+    return channel.finish();
 }
 
 
-double FFmpegTranscodeTwo::run(
-    int task_id, std::vector<FFmpegPacket> &frames_queue,
+void FFmpegTranscodeN::schedule(
+    ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
     std::string input_codec, int input_width, int input_height,
-    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
+    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+    std::function<void(double)> done
 ) {
     SPDLOG_INFO(
-        "task: {:2d}, frames: {} input_codec: {}, input_width: {}, input_height: {}, output_codec: {}, output_width: {}, output_height: {}, output_bitrate: {}",
-        task_id, frames_queue.size(), input_codec, input_width, input_height, fmt::join(output_codec, ", "), fmt::join(output_width, ", "), fmt::join(output_height, ", "), fmt::join(output_bitrate, ", ")
+        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}, output_codec: {}, output_width: {}, output_height: {}, output_bitrate: {}, queue_depth: {}, pipeline: {}, scale_cascade: {}, scale_backend: {}, scale_slices: {}, output_fps: {}, rendition_fps: {}",
+        task_id, packets->size(), input_codec, input_width, input_height, fmt::join(output_codec, ", "), fmt::join(output_width, ", "),
+        fmt::join(output_height, ", "), fmt::join(output_bitrate, ", "), m_queue_depth, m_pipeline, m_scale_cascade,
+        ScaleBackendCvt::to_string(m_scale_backend), fmt::join(m_scale_slices, ", "), m_output_fps, fmt::join(m_rendition_fps, ", ")
     );
 
-    FFmpegDecode decoder(input_codec);
-    if (!decoder.setup()) {
-        return -1;
-    }
+    std::shared_ptr<FFmpegTranscodeNChannel> channel = std::make_shared<FFmpegTranscodeNChannel>(
+        task_id, packets, input_codec, input_width, input_height, output_codec, output_width, output_height, output_bitrate,
+        m_queue_depth, m_pipeline, m_scale_cascade, m_scale_backend, m_scale_slices, m_output_fps, m_rendition_fps,
+        m_rendition_preset, m_rendition_gop, m_sink_type, sink_prefix()
+    );
+    channel->input.decoder.set_tier(m_decode_tier);
+    channel->start(scheduler, done);
+}
 
-    int pix_fmt = decoder.pixel_format();
-    auto time_base = decoder.time_base();
-    auto pixel_aspect = decoder.pixel_aspect();
-    std::string scale_filter1 = get_filter_text(input_codec, output_width[0], output_height[0]);
-    std::string scale_filter2 = get_filter_text(input_codec, output_width[1], output_height[1]);
 
-    FFmpegScale scaler1(input_width, input_height, pix_fmt, output_width[0], output_height[0], pix_fmt, pixel_aspect.first, pixel_aspect.second, time_base.first, time_base.second, scale_filter1);
-    FFmpegScale scaler2(input_width, input_height, pix_fmt, output_width[1], output_height[1], pix_fmt, pixel_aspect.first, pixel_aspect.second, time_base.first, time_base.second, scale_filter2);
+void FFmpegTranscodeN::set_encoder_options(std::vector<std::string> presets, std::vector<int> gop_sizes)
+{
+    m_rendition_preset = presets;
+    m_rendition_gop = gop_sizes;
+}
 
-    FFmpegEncode encoder1(output_codec[0], output_width[0], output_height[0], output_bitrate[0], pix_fmt);
-    FFmpegEncode encoder2(output_codec[1], output_width[1], output_height[1], output_bitrate[1], pix_fmt);
 
-    // statics
-    TimeIt ti_task;
-    TimeIt ti_step;
-    size_t frames = frames_queue.size();
-    MovingAverage ma50_decode_frame(50);
-    MovingAverage ma50_decode_gop(50);
-    Percentile percentile_decode;
-    MovingAverage ma_scale_encode_50frames(50);
-    MovingAverage ma_scale_encode_200gops(50);
-    Percentile percentile_scale_encode;
 
-    task_thread_pool::task_thread_pool thread_pool(2);
-    for (auto i = 0; i < frames_queue.size(); i++) {
-        ti_step.reset();
+// keyframes of one input scaled and encoded into pictures, the other frames are skipped inside the decoder
+class FFmpegSnapshotChannel {
+public:
+    FFmpegSnapshotChannel(
+        int task_id, std::shared_ptr<FFmpegPacketSource> packets, std::string input_codec, int input_width, int input_height,
+        std::string output_codec, int output_width, int output_height, int64_t output_bitrate, SinkType sink_type, std::string sink_prefix
+    )
+        : input(task_id, packets, input_codec)
+        , input_codec(input_codec)
+        , input_width(input_width)
+        , input_height(input_height)
+        , output_codec(output_codec)
+        , output_width(output_width)
+        , output_height(output_height)
+        , output_bitrate(output_bitrate)
+        , sink_type(sink_type)
+        , sink_prefix(sink_prefix)
+        , sink_opened(false)
+        , snapshots(0)
+        , bytes(0)
+        , cpu_seconds(0.0)
+    {
+        input.decoder.set_skip_frame(AVDISCARD_NONKEY);
+        // outside the codec thread budget, snapshots/sec/core counts the cpu time of the calling thread only
+        input.decoder.set_threads(1);
+    }
 
-        // decode
-        if (!decoder.send_packet(frames_queue[i])) {
-            break;
+    bool setup()
+    {
+        if (!input.setup()) {
+            return false;
         }
 
-        FFmpegFrame yuv_frame = decoder.receive_frame();
-        if (yuv_frame.does_need_more()) {
-            continue;
+        // mjpeg wants full range yuv, raw pictures keep the decoded format
+        int pix_fmt = input.decoder.pixel_format();
+        int picture_pix_fmt = output_codec == "mjpeg" ? AV_PIX_FMT_YUVJ420P : pix_fmt;
+        auto time_base = input.packets->time_base();
+        auto pixel_aspect = input.decoder.pixel_aspect();
+
+        scaler.reset(
+            new FFmpegScale(
+                input_width, input_height, pix_fmt, output_width, output_height, picture_pix_fmt,
+                pixel_aspect.first, pixel_aspect.second, time_base.first, time_base.second, get_filter_text(input_codec, output_width, output_height)
+            )
+        );
+        scaler->set_frame_pool(input.frame_pool);
+
+        encoder.reset(new FFmpegEncode(output_codec, output_width, output_height, output_bitrate, picture_pix_fmt));
+        encoder->set_packet_pool(input.packet_pool);
+        encoder->set_frame_rate(input.packets->fps());
+        encoder->set_time_base(time_base);
+
+        // any file sink writes every picture to its own file, null only counts them
+        std::string url = fmt::format("{}task{}_snapshot%06d.{}", sink_prefix, input.task_id, output_codec == "mjpeg" ? "jpg" : "yuv");
+        sink = FFmpegSink::create(sink_type == SinkType::Null ? SinkType::Null : SinkType::Image, url);
+        if (nullptr == sink) {
+            SPDLOG_ERROR("create sink error, type: {}, url: {}", SinkTypeCvt::to_string(sink_type), url);
+            return false;
         }
-        if (yuv_frame.is_null()) {
-            break;
+
+        return true;
+    }
+
+    // one packet, and a picture when it was a keyframe, < 0 to stop, INT_MIN at the end of input
+    int step()
+    {
+        double cpu_begin = thread_cpu_seconds();
+
+        FFmpegFrame yuv_frame(nullptr);
+        int code = input.decode(yuv_frame);
+        if (0 == code) {
+            code = snapshot(yuv_frame);
+            input.progress();
         }
 
-        // calc decode time
-        double decode_elasped_ms = ti_step.elapsed_milliseconds();
-        ma50_decode_frame.add(decode_elasped_ms);
-        ma50_decode_gop.add(ma50_decode_frame.calc());
-        percentile_decode.add(decode_elasped_ms);
-        ti_step.reset();
+        cpu_seconds += thread_cpu_seconds() - cpu_begin;
+        return code;
+    }
+
+    int snapshot(FFmpegFrame &yuv_frame)
+    {
+        TimeIt ti_step;
+
+        if (!scaler->setup(yuv_frame.raw_ptr()->hw_frames_ctx)) {
+            return -2;
+        }
 
-        if (!scaler1.setup(yuv_frame.raw_ptr()->hw_frames_ctx)) {
+        FFmpegFrame picture = scaler->scale(yuv_frame);
+        yuv_frame.free();
+        if (picture.is_null()) {
             return -2;
         }
 
-        if (!scaler2.setup(yuv_frame.raw_ptr()->hw_frames_ctx)) {
+        if (!encoder->setup(nullptr)) {
             return -3;
         }
+        if (!sink_opened) {
+            if (!open_sink()) {
+                return -5;
+            }
+            sink_opened = true;
+        }
 
-        bool has_error1 = false;
-        bool need_more1 = false;
-        thread_pool.submit(
-            [&yuv_frame, &scaler1, &encoder1, &need_more1, &has_error1]() {
-                // scale
-                FFmpegFrame scaled_yuv_frame = scaler1.scale(yuv_frame);
-                if (scaled_yuv_frame.is_null()) {
-                    return;
-                }
+        if (!encoder->send_frame(picture)) {
+            return -3;
+        }
+        picture.free();
 
-                if (!encoder1.setup(scaler1.hw_frames_context())) {
-                    has_error1 = true;
-                    return;
-                }
+        // intra only encoders give the picture back right away
+        if (!drain()) {
+            return -3;
+        }
 
-                // encode
-                if (!encoder1.send_frame(scaled_yuv_frame)) {
-                    return;
-                }
+        percentile_snapshot.add(ti_step.elapsed_microseconds() / 1000.0);
+        return 0;
+    }
 
-                // free scaled frame
-                scaled_yuv_frame.free();
+    // the image muxer takes the opened encoder's parameters
+    bool open_sink()
+    {
+        AVCodecParameters *codecpar = avcodec_parameters_alloc();
+        bool opened = codecpar != nullptr && encoder->codec_parameters(codecpar) && sink->open(codecpar, encoder->time_base());
+        avcodec_parameters_free(&codecpar);
 
-                FFmpegPacket encoded_es_packet = encoder1.receive_packet();
-                if (encoded_es_packet.does_need_more()) {
-                    need_more1 = true;
-                }
-                if (encoded_es_packet.is_null()) {
-                    return;
-                }
+        return opened;
+    }
 
-                // free encoded frame
-                encoded_es_packet.free();
+    // every picture the encoder has ready goes to the sink, false on errors
+    bool drain()
+    {
+        while (!encoder->eof()) {
+            FFmpegPacket packet = encoder->receive_packet();
+            if (packet.does_need_more() || encoder->eof()) {
+                break;
+            }
+            if (packet.is_null()) {
+                return false;
             }
-        );
 
-        bool has_error2 = false;
-        bool need_more2 = false;
-        thread_pool.submit(
-            [&yuv_frame, &scaler2, &encoder2, &need_more2, &has_error2]() {
-                // scale
-                FFmpegFrame scaled_yuv_frame = scaler2.scale(yuv_frame);
-                if (scaled_yuv_frame.is_null()) {
-                    return;
-                }
+            snapshots++;
+            bytes += packet.raw_ptr()->size;
+            sink->write(packet);
+        }
 
-                if (!encoder2.setup(scaler2.hw_frames_context())) {
-                    has_error2 = true;
-                    return;
-                }
+        return true;
+    }
 
-                // encode
-                if (!encoder2.send_frame(scaled_yuv_frame)) {
-                    return;
-                }
+    double finish(int code)
+    {
+        if (code != INT_MIN) {
+            return code;
+        }
 
-                // free scaled frame
-                scaled_yuv_frame.free();
+        // pictures a delayed encoder still holds
+        if (encoder->flush()) {
+            drain();
+        }
+        sink->close();
 
-                FFmpegPacket encoded_es_packet = encoder2.receive_packet();
-                if (encoded_es_packet.does_need_more()) {
-                    need_more2 = true;
-                }
-                if (encoded_es_packet.is_null()) {
-                    return;
-                }
+        double speed = input.finish();
 
-                // free encoded frame
-                encoded_es_packet.free();
-            }
+        // decode of the skipped frames included, the whole cost of a snapshot on one core
+        SPDLOG_INFO(
+            "task: {:2d}, snapshots: {}, {} {}x{}, avg bytes: {}, scale+encode 90%th: {:.2f} ms, cpu: {:.2f} s, snapshots/sec/core: {:.1f}",
+            input.task_id, snapshots, output_codec, output_width, output_height, snapshots > 0 ? bytes / (int64_t)snapshots : 0,
+            percentile_snapshot.calc(0.9), cpu_seconds, cpu_seconds > 0.0 ? snapshots / cpu_seconds : 0.0
         );
+        SPDLOG_INFO("task: {:2d}, {}", input.task_id, sink->stats());
 
-        thread_pool.wait_for_tasks();
+        return speed;
+    }
 
-        if (has_error1 || has_error2) {
-            return -4;
-        }
+    FFmpegTranscodeInput input;
+    std::unique_ptr<FFmpegScale> scaler;
+    std::unique_ptr<FFmpegEncode> encoder;
+    std::shared_ptr<FFmpegSink> sink;
+
+    std::string input_codec;
+    int input_width;
+    int input_height;
+    std::string output_codec;
+    int output_width;
+    int output_height;
+    int64_t output_bitrate;
+    SinkType sink_type;
+    std::string sink_prefix;
+    bool sink_opened;
 
-        if (need_more1 || need_more2) {
-            continue;
-        }
+    // statics
+    size_t snapshots;
+    int64_t bytes;
+    double cpu_seconds;
+    Percentile percentile_snapshot;
+};
 
-        // calc scale & decode time
-        double encode_elasped_ms = ti_step.elapsed_milliseconds();
-        ma_scale_encode_50frames.add(encode_elasped_ms);
-        ma_scale_encode_200gops.add(ma_scale_encode_50frames.calc());
-        percentile_scale_encode.add(encode_elasped_ms);
-        ti_step.reset();
 
-        if (0 == (i + 1) % 1000) {
-            double progress = 100.0 * i / frames;
-            SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_gop: {:.2f} (90%th={:.2f}) ms/frame, ma_scale_encode_200gops: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_gop.calc(), percentile_decode.calc(0.9), ma_scale_encode_200gops.calc(), percentile_scale_encode.calc(0.9)
-            );
-        }
-        else if (0 == (i + 1) % 250) {
-            double progress = 100.0 * i / frames;
-            SPDLOG_INFO(
-                "task: {:2d}, progress: {:.2f}%, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame, ma_scale_encode_50frames: {:.2f} (90%th={:.2f}) ms/frame",
-                task_id, progress, ma50_decode_frame.calc(), percentile_decode.calc(0.9), ma_scale_encode_50frames.calc(), percentile_scale_encode.calc(0.9)
-            );
-        }
+double FFmpegSnapshot::run(
+    int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+    std::string input_codec, int input_width, int input_height,
+    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
+) {
+    SPDLOG_INFO(
+        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}, snapshot: {} {}x{}",
+        task_id, packets->size(), input_codec, input_width, input_height, output_codec[0], output_width[0], output_height[0]
+    );
+
+    FFmpegSnapshotChannel channel(
+        task_id, packets, input_codec, input_width, input_height, output_codec[0], output_width[0], output_height[0], output_bitrate[0],
+        m_sink_type, sink_prefix()
+    );
+    channel.input.decoder.set_tier(m_decode_tier);
+    if (!channel.setup()) {
+        return -1;
     }
 
-    double expect_ms = frames * 40.0;
-    double task_elasped_ms = ti_task.elapsed_milliseconds();
-    double speed = expect_ms / task_elasped_ms;
+    int code = 0;
+    while (code >= 0) {
+        code = channel.step();
+    }
+
+    return channel.finish(code);
+}
+
+
+// one packet per work item, like decode only
+void snapshot_step(std::shared_ptr<FFmpegSnapshotChannel> channel, std::shared_ptr<ChannelStrand> strand, std::function<void(double)> done)
+{
+    std::function<void()> next_step = [channel, strand, done]() {
+        strand->post(
+            [channel, strand, done]() {
+                snapshot_step(channel, strand, done);
+            }
+        );
+    };
 
+    // the demux thread is behind, park until it pushes the next packet and let the other channels run
+    if (!channel->input.packets->ready(next_step)) {
+        return;
+    }
+
+    int code = channel->step();
+    if (code < 0) {
+        done(channel->finish(code));
+        return;
+    }
+
+    next_step();
+}
+
+
+void FFmpegSnapshot::schedule(
+    ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+    std::string input_codec, int input_width, int input_height,
+    std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+    std::function<void(double)> done
+) {
     SPDLOG_INFO(
-        "task: {:2d}, progress: 100.00%, ma50_decode_frame: {:.2f} (90%th={:.2f}) ms/frame, ma_scale_encode_50frames: {:.2f} (90%th={:.2f}) ms/frame",
-        task_id, ma50_decode_frame.calc(), percentile_decode.calc(0.9), ma_scale_encode_50frames.calc(), percentile_scale_encode.calc(0.9)
+        "task: {:2d}, frames: {}, input_codec: {}, input_width: {}, input_height: {}, snapshot: {} {}x{}",
+        task_id, packets->size(), input_codec, input_width, input_height, output_codec[0], output_width[0], output_height[0]
+    );
+
+    std::shared_ptr<FFmpegSnapshotChannel> channel = std::make_shared<FFmpegSnapshotChannel>(
+        task_id, packets, input_codec, input_width, input_height, output_codec[0], output_width[0], output_height[0], output_bitrate[0],
+        m_sink_type, sink_prefix()
     );
+    channel->input.decoder.set_tier(m_decode_tier);
+    std::shared_ptr<ChannelStrand> strand = scheduler.make_strand();
+
+    strand->post(
+        [channel, strand, done]() {
+            if (!channel->setup()) {
+                done(-1);
+                return;
+            }
 
-    return speed;
+            snapshot_step(channel, strand, done);
+        }
+    );
 }
 
 
@@ -610,7 +2005,7 @@ std::string get_h264_encoder_name(bool intel_quick_sync_video, bool nvidia_video
     else if (nvidia_video_codec) {
         return "h264_nvenc";
     }
-    else if (nvidia_video_codec) {
+    else if (amd_advanced_media_framework) {
         return "h264_amf";
     }
     else {
@@ -626,7 +2021,7 @@ std::string get_h265_encoder_name(bool intel_quick_sync_video, bool nvidia_video
     else if (nvidia_video_codec) {
         return "hevc_nvenc";
     }
-    else if (nvidia_video_codec) {
+    else if (amd_advanced_media_framework) {
         return "hevc_amf";
     }
     else {
@@ -679,7 +2074,9 @@ void get_decoder_name(std::string &codec_name, bool intel_quick_sync_video, bool
 
 FFmpegTranscode *FFmpegTranscodeFactory::create(
     TranscodeType t, std::string &intput_codec, std::vector<std::string> &output_codec, std::vector<int> &output_width, std::vector<int> &output_height,
-    std::vector<int64_t> &output_bitrate, bool intel_quick_sync_video, bool nvidia_video_codec, bool amd_advanced_media_framework
+    std::vector<int64_t> &output_bitrate, bool intel_quick_sync_video, bool nvidia_video_codec, bool amd_advanced_media_framework,
+    int queue_depth, bool pipeline, bool scale_cascade, ScaleBackend scale_backend, std::vector<int> scale_slices, double output_fps,
+    std::vector<double> rendition_fps, DecodeTier decode_tier, SinkType sink_type, std::string sink_dir
 ) {
     output_codec.clear();
     output_width.clear();
@@ -688,7 +2085,10 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
 
     m_transcode = nullptr;
 
-    get_decoder_name(intput_codec, intel_quick_sync_video, nvidia_video_codec, amd_advanced_media_framework);
+    // snapshots decode their few keyframes in software and encode from system memory
+    if (t != TranscodeType::H264Snapshot && t != TranscodeType::H265Snapshot) {
+        get_decoder_name(intput_codec, intel_quick_sync_video, nvidia_video_codec, amd_advanced_media_framework);
+    }
 
     switch (t)
     {
@@ -704,13 +2104,33 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
     }
     break;
 
+    case TranscodeType::H264Snapshot:
+    {
+        output_codec.push_back("mjpeg");
+        output_width.push_back(352);
+        output_height.push_back(288);
+        output_bitrate.push_back(2 * 1000 * 1000);
+        m_transcode = new FFmpegSnapshot();
+    }
+    break;
+
+    case TranscodeType::H265Snapshot:
+    {
+        output_codec.push_back("mjpeg");
+        output_width.push_back(352);
+        output_height.push_back(288);
+        output_bitrate.push_back(2 * 1000 * 1000);
+        m_transcode = new FFmpegSnapshot();
+    }
+    break;
+
     case TranscodeType::H264ToD1H264:
     {
         output_codec.push_back(get_h264_encoder_name(intel_quick_sync_video, nvidia_video_codec, amd_advanced_media_framework));
         output_width.push_back(720);
         output_height.push_back(480);
         output_bitrate.push_back(1000 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H264ToCifH264:
@@ -719,7 +2139,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_width.push_back(352);
         output_height.push_back(288);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToD1H265:
@@ -728,7 +2148,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_width.push_back(720);
         output_height.push_back(480);
         output_bitrate.push_back(1000 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToCifH265:
@@ -737,7 +2157,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_width.push_back(352);
         output_height.push_back(288);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToD1H264:
@@ -746,7 +2166,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_width.push_back(720);
         output_height.push_back(480);
         output_bitrate.push_back(1000 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToCifH264:
@@ -755,7 +2175,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_width.push_back(352);
         output_height.push_back(288);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeOne();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
 
@@ -769,7 +2189,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_height.push_back(288);
         output_bitrate.push_back(1000 * 1000);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeTwo();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToD1CifH265:
@@ -782,7 +2202,7 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_height.push_back(288);
         output_bitrate.push_back(1000 * 1000);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeTwo();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     case TranscodeType::H265ToD1CifH264:
@@ -795,11 +2215,64 @@ FFmpegTranscode *FFmpegTranscodeFactory::create(
         output_height.push_back(288);
         output_bitrate.push_back(1000 * 1000);
         output_bitrate.push_back(128 * 1000);
-        m_transcode = new FFmpegTranscodeTwo();
+        m_transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, output_fps, rendition_fps);
     }
     break;
     }
 
+    if (m_transcode != nullptr) {
+        m_transcode->set_decode_tier(decode_tier);
+        m_transcode->set_sink(sink_type, sink_dir);
+    }
+
     return m_transcode;
 }
 
+
+FFmpegTranscode *FFmpegTranscodeFactory::create(
+    const JobSpec &job, std::string &intput_codec, std::vector<std::string> &output_codec, std::vector<int> &output_width, std::vector<int> &output_height,
+    std::vector<int64_t> &output_bitrate, int queue_depth, bool pipeline, bool scale_cascade, ScaleBackend scale_backend, std::vector<int> scale_slices,
+    SinkType sink_type, std::string sink_dir, std::string sink_name
+) {
+    output_codec.clear();
+    output_width.clear();
+    output_height.clear();
+    output_bitrate.clear();
+
+    get_decoder_name(intput_codec, job.intel_quick_sync_video, job.nvidia_video_codec, job.amd_advanced_media_framework);
+
+    std::vector<double> rendition_fps;
+    std::vector<std::string> rendition_preset;
+    std::vector<int> rendition_gop;
+    for (auto &rendition : job.renditions) {
+        if (rendition.codec == "h264") {
+            output_codec.push_back(get_h264_encoder_name(job.intel_quick_sync_video, job.nvidia_video_codec, job.amd_advanced_media_framework));
+        }
+        else if (rendition.codec == "h265") {
+            output_codec.push_back(get_h265_encoder_name(job.intel_quick_sync_video, job.nvidia_video_codec, job.amd_advanced_media_framework));
+        }
+        else {
+            output_codec.push_back(rendition.codec);
+        }
+        output_width.push_back(rendition.width);
+        output_height.push_back(rendition.height);
+        output_bitrate.push_back(rendition.bitrate);
+        rendition_fps.push_back(rendition.fps);
+        rendition_preset.push_back(rendition.preset);
+        rendition_gop.push_back(rendition.gop);
+    }
+
+    if (job.renditions.empty()) {
+        m_transcode = new FFmpegDecodeOnly();
+    }
+    else {
+        FFmpegTranscodeN *transcode = new FFmpegTranscodeN(queue_depth, pipeline, scale_cascade, scale_backend, scale_slices, job.decode_fps, rendition_fps);
+        transcode->set_encoder_options(rendition_preset, rendition_gop);
+        m_transcode = transcode;
+    }
+
+    m_transcode->set_decode_tier(DecodeTierCvt::from_string(job.decode_tier));
+    m_transcode->set_sink(sink_type, sink_dir, sink_name);
+
+    return m_transcode;
+}
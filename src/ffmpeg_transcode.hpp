@@ -1,12 +1,20 @@
 #pragma once
 
 // c++
+#include <functional>
 #include <map>
 #include <vector>
 #include <string>
 
 // project
+#include "ffmpeg_decode.hpp"
+#include "ffmpeg_demux.hpp"
+#include "ffmpeg_scale.hpp"
+#include "ffmpeg_sink.hpp"
 #include "ffmpeg_types.hpp"
+#include "job_spec.hpp"
+
+class ChannelScheduler;
 
 
 
@@ -14,6 +22,8 @@ enum class TranscodeType : uint8_t {
 	Invalid,
 	H264DecodeOnly,
 	H265DecodeOnly,
+	H264Snapshot,
+	H265Snapshot,
 	H264ToD1H264,
 	H264ToCifH264,
 	H265ToD1H265,
@@ -43,17 +53,47 @@ private:
 
 class FFmpegTranscode {
 public:
+	FFmpegTranscode();
+	virtual ~FFmpegTranscode() = default;
+
+	// every channel's decoder, set before running
+	void set_decode_tier(DecodeTier tier);
+
+	// where every output's packets go, file sinks write dir/task<id>_output<index>.<type>, or dir/task<id>_snapshot<n>.jpg|yuv
+	// per picture for snapshots, a name goes in front as dir/<name>_task<id>..., set before running
+	void set_sink(SinkType type, std::string dir, std::string name = "");
+
 	virtual double run(
-		int task_id, std::vector<FFmpegPacket> &frames_queue,
+		int task_id, std::shared_ptr<FFmpegPacketSource> packets,
 		std::string input_codec, int input_width, int input_height,
 		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 	) = 0;
 
+	// same work as run, split into per stage work items on the scheduler's strands, done receives the speed
+	virtual void schedule(
+		ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+		std::string input_codec, int input_width, int input_height,
+		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+		std::function<void(double)> done
+	) = 0;
+
+	// one thread per channel, or all channels on a scheduler with this many workers, every channel reads its own packet source
 	double multi_threading_test(
-		int threads, std::vector<FFmpegPacket> &frames_queue,
+		int threads, FFmpegPacketSourceMaker make_packets,
 		std::string input_codec, int input_width, int input_height,
-		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
+		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+		int workers = 0
 	);
+
+
+protected:
+	// dir/ or dir/<name>_, what the file names of the sinks start with
+	std::string sink_prefix();
+
+	DecodeTier m_decode_tier;
+	SinkType m_sink_type;
+	std::string m_sink_dir;
+	std::string m_sink_name;
 };
 
 
@@ -61,32 +101,79 @@ class FFmpegDecodeOnly : public FFmpegTranscode {
 public:
 	// decode 1 input only
 	double run(
-		int task_id, std::vector<FFmpegPacket> &frames_queue,
+		int task_id, std::shared_ptr<FFmpegPacketSource> packets,
 		std::string input_codec, int input_width, int input_height,
 		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 	) override;
+
+	void schedule(
+		ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+		std::string input_codec, int input_width, int input_height,
+		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+		std::function<void(double)> done
+	) override;
 };
 
 
-class FFmpegTranscodeOne : public FFmpegTranscode {
+class FFmpegSnapshot : public FFmpegTranscode {
 public:
-	// 1 input 1 outputs
+	// decode the keyframes of 1 input only, each one is scaled and encoded into a picture of the first output, a file sink writes each picture out
 	double run(
-		int task_id, std::vector<FFmpegPacket> &frames_queue,
+		int task_id, std::shared_ptr<FFmpegPacketSource> packets,
 		std::string input_codec, int input_width, int input_height,
 		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 	) override;
+
+	void schedule(
+		ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+		std::string input_codec, int input_width, int input_height,
+		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+		std::function<void(double)> done
+	) override;
 };
 
 
-class FFmpegTranscodeTwo : public FFmpegTranscode {
+class FFmpegTranscodeN : public FFmpegTranscode {
 public:
-	// 1 input 2 outputs
+	FFmpegTranscodeN(
+		int queue_depth, bool pipeline, bool scale_cascade = false, ScaleBackend scale_backend = ScaleBackend::Auto,
+		std::vector<int> scale_slices = std::vector<int>(), double output_fps = 0.0, std::vector<double> rendition_fps = std::vector<double>()
+	);
+
+	// 1 input N outputs, every output has a persistent scale + encode consumer fed by refcounted frames
+	// pipeline splits each consumer into separate scale and encode threads
+	// scale_cascade feeds smaller outputs from the scaled frames of the nearest larger one
+	// scale_backend picks how software frames are scaled
+	// scale_slices splits the scale of output i into scale_slices[i] parallel slices, the last entry covers the remaining outputs
+	// output_fps > 0 drops non-reference frames before decoding, decimates the decoded frames the rest of the way to that rate, and encodes at it
+	// rendition_fps[i] > 0 encodes output i at that rate, decimating decoded frames before they are scaled, the last entry covers the remaining outputs
 	double run(
-		int task_id, std::vector<FFmpegPacket> &frames_queue,
+		int task_id, std::shared_ptr<FFmpegPacketSource> packets,
 		std::string input_codec, int input_width, int input_height,
 		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate
 	) override;
+
+	void schedule(
+		ChannelScheduler &scheduler, int task_id, std::shared_ptr<FFmpegPacketSource> packets,
+		std::string input_codec, int input_width, int input_height,
+		std::vector<std::string> output_codec, std::vector<int> output_width, std::vector<int> output_height, std::vector<int64_t> output_bitrate,
+		std::function<void(double)> done
+	) override;
+
+	// one entry per output, empty presets and gop 0 or missing entries keep the encoder defaults
+	void set_encoder_options(std::vector<std::string> presets, std::vector<int> gop_sizes);
+
+
+private:
+	int m_queue_depth;
+	bool m_pipeline;
+	bool m_scale_cascade;
+	ScaleBackend m_scale_backend;
+	std::vector<int> m_scale_slices;
+	double m_output_fps;
+	std::vector<double> m_rendition_fps;
+	std::vector<std::string> m_rendition_preset;
+	std::vector<int> m_rendition_gop;
 };
 
 
@@ -99,7 +186,19 @@ public:
 	// create transcoder and fill parameters
 	FFmpegTranscode *create(
 		TranscodeType t, std::string &intput_codec, std::vector<std::string> &output_codec, std::vector<int> &output_width, std::vector<int> &output_height,
-		std::vector<int64_t> &output_bitrate, bool intel_quick_sync_video = false, bool nvidia_video_codec = false, bool amd_advanced_media_framework = false
+		std::vector<int64_t> &output_bitrate, bool intel_quick_sync_video = false, bool nvidia_video_codec = false, bool amd_advanced_media_framework = false,
+		int queue_depth = 4, bool pipeline = false, bool scale_cascade = false, ScaleBackend scale_backend = ScaleBackend::Auto,
+		std::vector<int> scale_slices = std::vector<int>(), double output_fps = 0.0, std::vector<double> rendition_fps = std::vector<double>(),
+		DecodeTier decode_tier = DecodeTier::Full, SinkType sink_type = SinkType::Null, std::string sink_dir = "."
+	);
+
+	// transcoder of a job file's ladder, fills parameters the same way, input_codec is the probed codec going in
+	// sink_name keeps the files of the job's inputs apart
+	FFmpegTranscode *create(
+		const JobSpec &job, std::string &intput_codec, std::vector<std::string> &output_codec, std::vector<int> &output_width, std::vector<int> &output_height,
+		std::vector<int64_t> &output_bitrate, int queue_depth = 4, bool pipeline = false, bool scale_cascade = false,
+		ScaleBackend scale_backend = ScaleBackend::Auto, std::vector<int> scale_slices = std::vector<int>(),
+		SinkType sink_type = SinkType::Null, std::string sink_dir = ".", std::string sink_name = ""
 	);
 
 private:
@@ -2,6 +2,7 @@
 #include "ffmpeg_types.hpp"
 
 // project
+#include "ffmpeg_frame_buffer_pool.hpp"
 #include "ffmpeg_utils.hpp"
 #include "string_utils.hpp"
 
@@ -36,15 +37,40 @@ FFmpegPacket::FFmpegPacket(AVPacket *packet)
 }
 
 
+FFmpegPacket::FFmpegPacket(AVPacket *packet, std::shared_ptr<FFmpegPacketPool> pool)
+    : m_packet(packet)
+    , m_need_more(false)
+    , m_pool(pool)
+{
+}
+
+
 FFmpegPacket::FFmpegPacket(FFmpegPacket &&other) noexcept
     : m_packet(other.m_packet)
     , m_need_more(other.m_need_more)
+    , m_pool(std::move(other.m_pool))
 {
     other.m_packet = nullptr;
     other.m_need_more = false;
 }
 
 
+FFmpegPacket &FFmpegPacket::operator=(FFmpegPacket &&other) noexcept
+{
+    if (this != &other) {
+        free();
+
+        m_packet = other.m_packet;
+        m_need_more = other.m_need_more;
+        m_pool = std::move(other.m_pool);
+
+        other.m_packet = nullptr;
+        other.m_need_more = false;
+    }
+    return *this;
+}
+
+
 FFmpegPacket::~FFmpegPacket()
 {
     free();
@@ -54,10 +80,16 @@ FFmpegPacket::~FFmpegPacket()
 void FFmpegPacket::free()
 {
     if (m_packet != nullptr) {
-        ffmpeg_free_packet(&m_packet);
+        if (m_pool != nullptr) {
+            m_pool->release(m_packet);
+        }
+        else {
+            ffmpeg_free_packet(&m_packet);
+        }
     }
     m_packet = nullptr;
     m_need_more = false;
+    m_pool = nullptr;
 }
 
 
@@ -105,15 +137,40 @@ FFmpegFrame::FFmpegFrame(AVFrame *frame)
 }
 
 
+FFmpegFrame::FFmpegFrame(AVFrame *frame, std::shared_ptr<FFmpegFramePool> pool)
+    : m_frame(frame)
+    , m_need_more(false)
+    , m_pool(pool)
+{
+}
+
+
 FFmpegFrame::FFmpegFrame(FFmpegFrame &&other) noexcept
     : m_frame(other.m_frame)
     , m_need_more(other.m_need_more)
+    , m_pool(std::move(other.m_pool))
 {
     other.m_frame = nullptr;
     other.m_need_more = false;
 }
 
 
+FFmpegFrame &FFmpegFrame::operator=(FFmpegFrame &&other) noexcept
+{
+    if (this != &other) {
+        free();
+
+        m_frame = other.m_frame;
+        m_need_more = other.m_need_more;
+        m_pool = std::move(other.m_pool);
+
+        other.m_frame = nullptr;
+        other.m_need_more = false;
+    }
+    return *this;
+}
+
+
 FFmpegFrame::~FFmpegFrame()
 {
     free();
@@ -123,10 +180,16 @@ FFmpegFrame::~FFmpegFrame()
 void FFmpegFrame::free()
 {
     if (m_frame != nullptr) {
-        ffmpeg_free_frame(&m_frame);
+        if (m_pool != nullptr) {
+            m_pool->release(m_frame);
+        }
+        else {
+            ffmpeg_free_frame(&m_frame);
+        }
     }
     m_frame = nullptr;
     m_need_more = false;
+    m_pool = nullptr;
 }
 
 
@@ -156,6 +219,200 @@ bool FFmpegFrame::does_need_more()
 
 
 
+FFmpegPacketPool::FFmpegPacketPool(size_t max_idle)
+    : m_max_idle(max_idle)
+    , m_allocs(0)
+    , m_reuses(0)
+{
+}
+
+
+FFmpegPacketPool::~FFmpegPacketPool()
+{
+    for (AVPacket *packet : m_idle) {
+        ffmpeg_free_packet(&packet);
+    }
+    m_idle.clear();
+}
+
+
+FFmpegPacket FFmpegPacketPool::acquire()
+{
+    AVPacket *packet = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty()) {
+            packet = m_idle.back();
+            m_idle.pop_back();
+        }
+    }
+
+    if (packet != nullptr) {
+        m_reuses.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        packet = av_packet_alloc();
+        if (nullptr == packet) {
+            SPDLOG_ERROR("av_packet_alloc error");
+            return FFmpegPacket(nullptr);
+        }
+        m_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return FFmpegPacket(packet, shared_from_this());
+}
+
+
+void FFmpegPacketPool::release(AVPacket *packet)
+{
+    av_packet_unref(packet);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle.size() < m_max_idle) {
+            m_idle.push_back(packet);
+            return;
+        }
+    }
+
+    ffmpeg_free_packet(&packet);
+}
+
+
+size_t FFmpegPacketPool::allocs()
+{
+    return m_allocs.load(std::memory_order_relaxed);
+}
+
+
+size_t FFmpegPacketPool::reuses()
+{
+    return m_reuses.load(std::memory_order_relaxed);
+}
+
+
+size_t FFmpegPacketPool::idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle.size();
+}
+
+
+std::string FFmpegPacketPool::stats(size_t frames)
+{
+    return fmt::format(
+        "packet_pool: allocs: {}, reuses: {}, idle: {}, allocs/frame: {:.3f}",
+        allocs(), reuses(), idle(), frames > 0 ? (double)allocs() / frames : 0.0
+    );
+}
+
+
+
+FFmpegFramePool::FFmpegFramePool(size_t max_idle)
+    : m_max_idle(max_idle)
+    , m_allocs(0)
+    , m_reuses(0)
+{
+}
+
+
+FFmpegFramePool::~FFmpegFramePool()
+{
+    for (AVFrame *frame : m_idle) {
+        ffmpeg_free_frame(&frame);
+    }
+    m_idle.clear();
+}
+
+
+FFmpegFrame FFmpegFramePool::acquire()
+{
+    AVFrame *frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty()) {
+            frame = m_idle.back();
+            m_idle.pop_back();
+        }
+    }
+
+    if (frame != nullptr) {
+        m_reuses.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        frame = av_frame_alloc();
+        if (nullptr == frame) {
+            SPDLOG_ERROR("av_frame_alloc error");
+            return FFmpegFrame(nullptr);
+        }
+        m_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return FFmpegFrame(frame, shared_from_this());
+}
+
+
+void FFmpegFramePool::release(AVFrame *frame)
+{
+    av_frame_unref(frame);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle.size() < m_max_idle) {
+            m_idle.push_back(frame);
+            return;
+        }
+    }
+
+    ffmpeg_free_frame(&frame);
+}
+
+
+FFmpegFrame FFmpegFramePool::clone(FFmpegFrame &frame)
+{
+    FFmpegFrame ref_frame = acquire();
+    if (ref_frame.is_null()) {
+        return ref_frame;
+    }
+
+    int code = av_frame_ref(ref_frame.raw_ptr(), frame.raw_ptr());
+    if (code < 0) {
+        SPDLOG_ERROR("av_frame_ref error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        ref_frame.free();
+    }
+    return ref_frame;
+}
+
+
+size_t FFmpegFramePool::allocs()
+{
+    return m_allocs.load(std::memory_order_relaxed);
+}
+
+
+size_t FFmpegFramePool::reuses()
+{
+    return m_reuses.load(std::memory_order_relaxed);
+}
+
+
+size_t FFmpegFramePool::idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle.size();
+}
+
+
+std::string FFmpegFramePool::stats(size_t frames)
+{
+    return fmt::format(
+        "frame_pool: allocs: {}, reuses: {}, idle: {}, allocs/frame: {:.3f}",
+        allocs(), reuses(), idle(), frames > 0 ? (double)allocs() / frames : 0.0
+    );
+}
+
+
+
 FFmpegCodec::FFmpegCodec(std::string codec_name)
     : m_codec(nullptr)
 {
@@ -263,6 +520,25 @@ enum AVPixelFormat get_pixel_format_callback(AVCodecContext *ctx, const enum AVP
 }
 
 
+int get_buffer2_callback(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+    auto thiz = (FFmpegCodecContext *)ctx->opaque;
+
+    // same padding as the default allocator, the pool rounds linesizes up to a multiple of linesize_align
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+
+    std::shared_ptr<FFmpegFrameBufferPool> pool = thiz->frame_buffer_pool(width, height, frame->format);
+    if (pool != nullptr && pool->get_buffer(frame)) {
+        return 0;
+    }
+
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
+
 FFmpegCodecContext::FFmpegCodecContext(std::string codec_name, int pixel_format)
     : m_codec(nullptr)
     , m_codec_context(nullptr)
@@ -281,6 +557,7 @@ FFmpegCodecContext::FFmpegCodecContext(FFmpegCodecContext &&other) noexcept
     m_pixel_format = other.m_pixel_format;
     m_hw_device_type = other.m_hw_device_type;
     m_hw_device_context = other.m_hw_device_context;
+    m_frame_buffer_pool = std::move(other.m_frame_buffer_pool);
 
     other.m_codec = nullptr;
     other.m_codec_context = nullptr;
@@ -321,6 +598,10 @@ void FFmpegCodecContext::init(std::string codec_name, int pixel_format)
             m_codec_context->hw_device_ctx = av_buffer_ref(m_hw_device_context);
             m_codec_context->get_format = get_pixel_format_callback;
         }
+        else if (FFmpegFrameBufferPools::instance().enabled() && av_codec_is_decoder(m_codec->raw_ptr()) && (m_codec->raw_ptr()->capabilities & AV_CODEC_CAP_DR1)) {
+            // software decoders share picture buffers with every channel of the same size
+            m_codec_context->get_buffer2 = get_buffer2_callback;
+        }
 
         return;
     } while (false);
@@ -416,6 +697,7 @@ void FFmpegCodecContext::free()
 
     m_hw_device_context = nullptr;
     m_codec_context = nullptr;
+    m_frame_buffer_pool = nullptr;
 
     m_codec = nullptr;
     m_codec_name.clear();
@@ -454,6 +736,16 @@ std::pair<int, int> FFmpegCodecContext::time_base()
 }
 
 
+std::shared_ptr<FFmpegFrameBufferPool> FFmpegCodecContext::frame_buffer_pool(int width, int height, int pixel_format)
+{
+    std::lock_guard<std::mutex> lock(m_frame_buffer_pool_mutex);
+    if (nullptr == m_frame_buffer_pool || !m_frame_buffer_pool->matches(width, height, pixel_format)) {
+        m_frame_buffer_pool = FFmpegFrameBufferPools::instance().get(width, height, pixel_format);
+    }
+    return m_frame_buffer_pool;
+}
+
+
 FFmpegEncoderContext::FFmpegEncoderContext(std::string codec_name, int pixel_format)
     : FFmpegCodecContext(codec_name, pixel_format)
 {
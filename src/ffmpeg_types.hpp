@@ -4,8 +4,12 @@
 #include <stdint.h>
 
 // c++
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 // ffmpeg
 struct AVBufferRef;
@@ -16,12 +20,19 @@ struct AVCodecContext;
 
 
 
+class FFmpegPacketPool;
+class FFmpegFramePool;
+class FFmpegFrameBufferPool;
+
+
 class FFmpegPacket {
 public:
     FFmpegPacket();
     FFmpegPacket(AVPacket *packet);
+    FFmpegPacket(AVPacket *packet, std::shared_ptr<FFmpegPacketPool> pool);
     FFmpegPacket(const FFmpegPacket &other) = delete;
     FFmpegPacket(FFmpegPacket &&other) noexcept;
+    FFmpegPacket &operator=(FFmpegPacket &&other) noexcept;
     virtual ~FFmpegPacket();
 
     void free();
@@ -36,6 +47,9 @@ public:
 private:
     bool m_need_more;
     AVPacket *m_packet;
+
+    // free() hands the shell back here instead of av_packet_free
+    std::shared_ptr<FFmpegPacketPool> m_pool;
 };
 
 
@@ -43,8 +57,10 @@ class FFmpegFrame {
 public:
     FFmpegFrame();
     FFmpegFrame(AVFrame *frame);
+    FFmpegFrame(AVFrame *frame, std::shared_ptr<FFmpegFramePool> pool);
     FFmpegFrame(const FFmpegFrame &other) = delete;
     FFmpegFrame(FFmpegFrame &&other) noexcept;
+    FFmpegFrame &operator=(FFmpegFrame &&other) noexcept;
     virtual ~FFmpegFrame();
 
     void free();
@@ -59,6 +75,70 @@ public:
 private:
     bool m_need_more;
     AVFrame *m_frame;
+
+    // free() hands the shell back here instead of av_frame_free
+    std::shared_ptr<FFmpegFramePool> m_pool;
+};
+
+
+// recycles AVPacket shells, released packets are unreferenced and kept for the next acquire
+// thread safe, packets may be freed on another thread than the one that acquired them
+class FFmpegPacketPool : public std::enable_shared_from_this<FFmpegPacketPool> {
+public:
+    FFmpegPacketPool(size_t max_idle = 64);
+    FFmpegPacketPool(const FFmpegPacketPool &other) = delete;
+    ~FFmpegPacketPool();
+
+    FFmpegPacket acquire();
+    void release(AVPacket *packet);
+
+    // av_packet_alloc calls, and acquires served from the idle list
+    size_t allocs();
+    size_t reuses();
+    size_t idle();
+
+    std::string stats(size_t frames);
+
+
+private:
+    size_t m_max_idle;
+
+    std::mutex m_mutex;
+    std::vector<AVPacket *> m_idle;
+
+    std::atomic<size_t> m_allocs;
+    std::atomic<size_t> m_reuses;
+};
+
+
+// recycles AVFrame shells, same as FFmpegPacketPool
+class FFmpegFramePool : public std::enable_shared_from_this<FFmpegFramePool> {
+public:
+    FFmpegFramePool(size_t max_idle = 64);
+    FFmpegFramePool(const FFmpegFramePool &other) = delete;
+    ~FFmpegFramePool();
+
+    FFmpegFrame acquire();
+    void release(AVFrame *frame);
+
+    // pooled av_frame_clone, a new reference to the same buffers
+    FFmpegFrame clone(FFmpegFrame &frame);
+
+    size_t allocs();
+    size_t reuses();
+    size_t idle();
+
+    std::string stats(size_t frames);
+
+
+private:
+    size_t m_max_idle;
+
+    std::mutex m_mutex;
+    std::vector<AVFrame *> m_idle;
+
+    std::atomic<size_t> m_allocs;
+    std::atomic<size_t> m_reuses;
 };
 
 
@@ -129,6 +209,9 @@ public:
     std::pair<int, int> pixel_aspect();
     std::pair<int, int> time_base();
 
+    // shared pool for pictures of this size, may be called from the decoder's frame threads
+    std::shared_ptr<FFmpegFrameBufferPool> frame_buffer_pool(int width, int height, int pixel_format);
+
 
 protected:
     FFmpegCodec *m_codec;
@@ -138,6 +221,9 @@ protected:
     int m_pixel_format;
     int m_hw_device_type;
     AVBufferRef *m_hw_device_context;
+
+    std::mutex m_frame_buffer_pool_mutex;
+    std::shared_ptr<FFmpegFrameBufferPool> m_frame_buffer_pool;
 };
 
 
@@ -0,0 +1,72 @@
+// self
+#include "frame_decimator.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/frame.h>
+}
+
+// fmt
+#include <fmt/format.h>
+
+
+
+FrameDecimator::FrameDecimator(double input_fps, double output_fps, std::pair<int, int> time_base)
+    : m_input_fps(input_fps > 0.0 ? input_fps : 25.0)
+    , m_output_fps(output_fps)
+    , m_interval(0.0)
+    , m_tolerance(0.0)
+    , m_started(false)
+    , m_next_pts(0.0)
+    , m_frames(0)
+    , m_dropped(0)
+{
+    if (m_output_fps > 0.0 && m_output_fps < m_input_fps && time_base.first > 0 && time_base.second > 0) {
+        double ticks_per_second = (double)time_base.second / time_base.first;
+        m_interval = ticks_per_second / m_output_fps;
+        m_tolerance = ticks_per_second / m_input_fps / 2.0;
+    }
+}
+
+
+bool FrameDecimator::keep(FFmpegFrame &frame)
+{
+    m_frames++;
+
+    int64_t pts = frame.raw_ptr()->pts;
+    if (m_interval <= 0.0 || AV_NOPTS_VALUE == pts) {
+        return true;
+    }
+
+    if (m_started && pts + m_tolerance < m_next_pts) {
+        m_dropped++;
+        return false;
+    }
+
+    // stay on the interval grid, unless the stream jumped past the next interval
+    if (!m_started || pts >= m_next_pts + m_interval) {
+        m_next_pts = (double)pts + m_interval;
+    }
+    else {
+        m_next_pts += m_interval;
+    }
+    m_started = true;
+
+    return true;
+}
+
+
+double FrameDecimator::fps()
+{
+    return m_interval > 0.0 ? m_output_fps : m_input_fps;
+}
+
+
+std::string FrameDecimator::stats()
+{
+    return fmt::format(
+        "frame decimator: {:.2f} -> {:.2f} fps, frames: {}, dropped: {} ({:.1f}%)",
+        m_input_fps, fps(), m_frames, m_dropped, m_frames > 0 ? 100.0 * m_dropped / m_frames : 0.0
+    );
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// c
+#include <stddef.h>
+#include <stdint.h>
+
+// c++
+#include <string>
+#include <utility>
+
+// project
+#include "ffmpeg_types.hpp"
+
+
+
+// lowers the frame rate of one output after decoding, keeping the first frame of every output frame interval by pts
+// works on any frame sequence, the gaps a dropper or a faster decimator left included
+class FrameDecimator {
+public:
+    // timestamps are in time_base, output_fps <= 0 or >= input_fps keeps every frame
+    FrameDecimator(double input_fps, double output_fps, std::pair<int, int> time_base);
+
+    // whether the frame goes on, frames without a pts always do
+    bool keep(FFmpegFrame &frame);
+
+    // frame rate coming out, input_fps when nothing is dropped
+    double fps();
+
+    std::string stats();
+
+
+private:
+    double m_input_fps;
+    double m_output_fps;
+
+    // one output frame, and half an input one of timestamp jitter, in time_base
+    double m_interval;
+    double m_tolerance;
+
+    // start of the next output frame interval
+    bool m_started;
+    double m_next_pts;
+
+    // statics
+    size_t m_frames;
+    size_t m_dropped;
+};
@@ -0,0 +1,60 @@
+// self
+#include "h26x_frame_dropper.hpp"
+
+// c++
+#include <algorithm>
+
+// project
+#include "h26x_utils.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// fmt
+#include <fmt/format.h>
+
+
+
+H26xFrameDropper::H26xFrameDropper(int codec_id, double input_fps, double output_fps)
+    : m_codec_id(codec_id)
+    , m_input_fps(input_fps > 0.0 ? input_fps : 25.0)
+    , m_output_fps(output_fps)
+    , m_credit(0.0)
+    , m_max_temporal_id(0)
+    , m_packets(0)
+    , m_dropped(0)
+{
+}
+
+
+bool H26xFrameDropper::drop(FFmpegPacket &packet)
+{
+    m_packets++;
+    if (m_output_fps <= 0.0 || m_output_fps >= m_input_fps) {
+        return false;
+    }
+
+    AVPacket *raw = packet.raw_ptr();
+    bool disposable = h26x_is_disposable(m_codec_id, raw->data, (size_t)raw->size, m_max_temporal_id);
+
+    m_credit += m_output_fps;
+    if (m_credit >= m_input_fps || !disposable) {
+        // at most one second of debt, a stream without disposable pictures never drops
+        m_credit = std::max(m_credit - m_input_fps, -m_input_fps);
+        return false;
+    }
+
+    m_dropped++;
+    return true;
+}
+
+
+std::string H26xFrameDropper::stats()
+{
+    return fmt::format(
+        "frame dropper: {:.2f} -> {:.2f} fps, packets: {}, dropped: {} ({:.1f}%)",
+        m_input_fps, m_output_fps, m_packets, m_dropped, m_packets > 0 ? 100.0 * m_dropped / m_packets : 0.0
+    );
+}
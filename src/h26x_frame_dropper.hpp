@@ -0,0 +1,39 @@
+#pragma once
+
+// c
+#include <stddef.h>
+
+// c++
+#include <string>
+
+// project
+#include "ffmpeg_types.hpp"
+
+
+
+// lowers the frame rate of a channel before decoding by discarding packets no other picture references
+// only non-reference pictures go, so a stream of reference frames only keeps its full rate
+class H26xFrameDropper {
+public:
+    // codec_id is AV_CODEC_ID_H264 or AV_CODEC_ID_HEVC, output_fps <= 0 or >= input_fps keeps every packet
+    H26xFrameDropper(int codec_id, double input_fps, double output_fps);
+
+    // whether the packet is left out instead of being sent to the decoder
+    bool drop(FFmpegPacket &packet);
+
+    std::string stats();
+
+
+private:
+    int m_codec_id;
+    double m_input_fps;
+    double m_output_fps;
+
+    // output frames owed, a kept reference frame the rate did not ask for is paid back by the next disposable ones
+    double m_credit;
+    int m_max_temporal_id;
+
+    // statics
+    size_t m_packets;
+    size_t m_dropped;
+};
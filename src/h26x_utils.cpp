@@ -0,0 +1,671 @@
+// self
+#include "h26x_utils.hpp"
+
+// c++
+#include <algorithm>
+#include <vector>
+
+// project
+#include "ffmpeg_annexb.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+
+
+// exp-golomb reader over a rbsp, reading past the end only sets the error flag
+class BitReader {
+public:
+    BitReader(const uint8_t *nal, size_t size)
+        : m_position(0)
+        , m_error(false)
+    {
+        // drop emulation prevention bytes, 00 00 03 -> 00 00
+        m_data.reserve(size);
+        int zeros = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (zeros >= 2 && 3 == nal[i]) {
+                zeros = 0;
+                continue;
+            }
+            zeros = 0 == nal[i] ? zeros + 1 : 0;
+            m_data.push_back(nal[i]);
+        }
+    }
+
+    uint32_t u(int bits)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++) {
+            if (m_position >= m_data.size() * 8) {
+                m_error = true;
+                return 0;
+            }
+            value = (value << 1) | ((m_data[m_position >> 3] >> (7 - (m_position & 7))) & 1);
+            m_position++;
+        }
+        return value;
+    }
+
+    void skip(size_t bits)
+    {
+        m_position += bits;
+        if (m_position > m_data.size() * 8) {
+            m_error = true;
+        }
+    }
+
+    uint32_t ue()
+    {
+        int leading_zeros = 0;
+        while (0 == u(1)) {
+            if (m_error || ++leading_zeros > 31) {
+                m_error = true;
+                return 0;
+            }
+        }
+        return (uint32_t)(((uint64_t)1 << leading_zeros) - 1 + u(leading_zeros));
+    }
+
+    int32_t se()
+    {
+        uint32_t value = ue();
+        return (value & 1) ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+    }
+
+    bool error()
+    {
+        return m_error;
+    }
+
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_position;
+    bool m_error;
+};
+
+
+static void h264_skip_scaling_list(BitReader &br, int size)
+{
+    int last_scale = 8;
+    int next_scale = 8;
+    for (int j = 0; j < size; j++) {
+        if (next_scale != 0) {
+            int delta_scale = br.se();
+            next_scale = (last_scale + delta_scale + 256) % 256;
+        }
+        last_scale = 0 == next_scale ? last_scale : next_scale;
+    }
+}
+
+
+// aspect ratio, overscan, video signal and chroma location, the part of the vui both codecs share
+static void skip_vui_head(BitReader &br)
+{
+    if (br.u(1)) {
+        // aspect_ratio_idc, extended sar
+        if (255 == br.u(8)) {
+            br.skip(32);
+        }
+    }
+    if (br.u(1)) {
+        // overscan_appropriate_flag
+        br.skip(1);
+    }
+    if (br.u(1)) {
+        // video_format, video_full_range_flag
+        br.skip(4);
+        if (br.u(1)) {
+            // colour primaries, transfer characteristics, matrix coefficients
+            br.skip(24);
+        }
+    }
+    if (br.u(1)) {
+        br.ue();
+        br.ue();
+    }
+}
+
+
+static void h264_skip_hrd_parameters(BitReader &br)
+{
+    uint32_t cpb_cnt_minus1 = br.ue();
+    br.skip(4 + 4);
+    for (uint32_t i = 0; i <= cpb_cnt_minus1 && i < 32 && !br.error(); i++) {
+        br.ue();
+        br.ue();
+        br.skip(1);
+    }
+    br.skip(5 * 4);
+}
+
+
+bool h264_parse_sps(const uint8_t *nal, size_t size, H26xStreamInfo &info)
+{
+    BitReader br(nal, size);
+
+    // nal header
+    br.skip(8);
+
+    int profile_idc = br.u(8);
+    br.skip(16);
+    br.ue();
+
+    int chroma_format_idc = 1;
+    if (100 == profile_idc || 110 == profile_idc || 122 == profile_idc || 244 == profile_idc || 44 == profile_idc || 83 == profile_idc
+        || 86 == profile_idc || 118 == profile_idc || 128 == profile_idc || 138 == profile_idc || 139 == profile_idc || 134 == profile_idc || 135 == profile_idc) {
+        chroma_format_idc = br.ue();
+        if (3 == chroma_format_idc) {
+            // separate_colour_plane_flag
+            if (br.u(1)) {
+                chroma_format_idc = 0;
+            }
+        }
+        br.ue();
+        br.ue();
+        br.skip(1);
+        if (br.u(1)) {
+            for (int i = 0; i < (3 == chroma_format_idc ? 12 : 8); i++) {
+                if (br.u(1)) {
+                    h264_skip_scaling_list(br, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    br.ue();
+    int pic_order_cnt_type = br.ue();
+    if (0 == pic_order_cnt_type) {
+        br.ue();
+    }
+    else if (1 == pic_order_cnt_type) {
+        br.skip(1);
+        br.se();
+        br.se();
+        uint32_t cycle = br.ue();
+        for (uint32_t i = 0; i < cycle && !br.error(); i++) {
+            br.se();
+        }
+    }
+
+    br.ue();
+    br.skip(1);
+    int width_in_mbs = br.ue() + 1;
+    int height_in_map_units = br.ue() + 1;
+    int frame_mbs_only_flag = br.u(1);
+    if (!frame_mbs_only_flag) {
+        br.skip(1);
+    }
+    br.skip(1);
+
+    int crop_left = 0;
+    int crop_right = 0;
+    int crop_top = 0;
+    int crop_bottom = 0;
+    if (br.u(1)) {
+        crop_left = br.ue();
+        crop_right = br.ue();
+        crop_top = br.ue();
+        crop_bottom = br.ue();
+    }
+    if (br.error()) {
+        return false;
+    }
+
+    int crop_unit_x = (1 == chroma_format_idc || 2 == chroma_format_idc) ? 2 : 1;
+    int crop_unit_y = (1 == chroma_format_idc ? 2 : 1) * (2 - frame_mbs_only_flag);
+    info.width = width_in_mbs * 16 - crop_unit_x * (crop_left + crop_right);
+    info.height = (2 - frame_mbs_only_flag) * height_in_map_units * 16 - crop_unit_y * (crop_top + crop_bottom);
+    info.fps = 0.0;
+
+    // baseline has no b slices, the other profiles only bound reordering in the vui
+    info.reorder_frames = 66 == profile_idc ? 0 : 1;
+
+    // vui timing, two fields per frame
+    if (br.u(1)) {
+        skip_vui_head(br);
+        if (br.u(1)) {
+            uint32_t num_units_in_tick = br.u(32);
+            uint32_t time_scale = br.u(32);
+            if (!br.error() && num_units_in_tick > 0) {
+                info.fps = time_scale / (2.0 * num_units_in_tick);
+            }
+            // fixed_frame_rate_flag
+            br.skip(1);
+        }
+
+        int nal_hrd_parameters_present_flag = br.u(1);
+        if (nal_hrd_parameters_present_flag) {
+            h264_skip_hrd_parameters(br);
+        }
+        int vcl_hrd_parameters_present_flag = br.u(1);
+        if (vcl_hrd_parameters_present_flag) {
+            h264_skip_hrd_parameters(br);
+        }
+        if (nal_hrd_parameters_present_flag || vcl_hrd_parameters_present_flag) {
+            // low_delay_hrd_flag
+            br.skip(1);
+        }
+        // pic_struct_present_flag
+        br.skip(1);
+
+        if (br.u(1)) {
+            // motion vectors over picture boundaries, max bytes per picture, max bits per mb, max mv lengths
+            br.skip(1);
+            br.ue();
+            br.ue();
+            br.ue();
+            br.ue();
+            uint32_t max_num_reorder_frames = br.ue();
+            if (!br.error() && max_num_reorder_frames <= 16) {
+                info.reorder_frames = (int)max_num_reorder_frames;
+            }
+        }
+    }
+
+    return info.width > 0 && info.height > 0;
+}
+
+
+static void hevc_skip_profile_tier_level(BitReader &br, int max_sub_layers_minus1)
+{
+    // general profile space, tier, idc, compatibility flags, constraint flags, level
+    br.skip(2 + 1 + 5 + 32 + 48 + 8);
+
+    std::vector<int> profile_present(max_sub_layers_minus1);
+    std::vector<int> level_present(max_sub_layers_minus1);
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+        profile_present[i] = br.u(1);
+        level_present[i] = br.u(1);
+    }
+    if (max_sub_layers_minus1 > 0) {
+        for (int i = max_sub_layers_minus1; i < 8; i++) {
+            br.skip(2);
+        }
+    }
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+        if (profile_present[i]) {
+            br.skip(88);
+        }
+        if (level_present[i]) {
+            br.skip(8);
+        }
+    }
+}
+
+
+static void hevc_skip_scaling_list_data(BitReader &br)
+{
+    for (int size_id = 0; size_id < 4; size_id++) {
+        for (int matrix_id = 0; matrix_id < 6; matrix_id += (3 == size_id) ? 3 : 1) {
+            if (!br.u(1)) {
+                br.ue();
+                continue;
+            }
+
+            int coef_num = std::min(64, 1 << (4 + (size_id << 1)));
+            if (size_id > 1) {
+                br.se();
+            }
+            for (int i = 0; i < coef_num && !br.error(); i++) {
+                br.se();
+            }
+        }
+    }
+}
+
+
+// returns NumDeltaPocs of the set, -1 on error
+static int hevc_skip_st_ref_pic_set(BitReader &br, int index, const std::vector<int> &num_delta_pocs)
+{
+    if (index != 0 && br.u(1)) {
+        // predicted from the previous set
+        br.skip(1);
+        br.ue();
+
+        int count = 0;
+        for (int j = 0; j <= num_delta_pocs[index - 1]; j++) {
+            int used_by_curr_pic_flag = br.u(1);
+            int use_delta_flag = used_by_curr_pic_flag ? 1 : br.u(1);
+            if (used_by_curr_pic_flag || use_delta_flag) {
+                count++;
+            }
+        }
+        return br.error() ? -1 : count;
+    }
+
+    uint32_t num_negative_pics = br.ue();
+    uint32_t num_positive_pics = br.ue();
+    if (br.error() || num_negative_pics > 16 || num_positive_pics > 16) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < num_negative_pics + num_positive_pics; i++) {
+        br.ue();
+        br.skip(1);
+    }
+    return br.error() ? -1 : (int)(num_negative_pics + num_positive_pics);
+}
+
+
+bool hevc_parse_sps(const uint8_t *nal, size_t size, H26xStreamInfo &info)
+{
+    BitReader br(nal, size);
+
+    // nal header
+    br.skip(16);
+
+    br.skip(4);
+    int max_sub_layers_minus1 = br.u(3);
+    br.skip(1);
+    hevc_skip_profile_tier_level(br, max_sub_layers_minus1);
+
+    br.ue();
+    int chroma_format_idc = br.ue();
+    if (3 == chroma_format_idc) {
+        br.skip(1);
+    }
+    int width = br.ue();
+    int height = br.ue();
+
+    if (br.u(1)) {
+        int sub_width = (1 == chroma_format_idc || 2 == chroma_format_idc) ? 2 : 1;
+        int sub_height = 1 == chroma_format_idc ? 2 : 1;
+        int left = br.ue();
+        int right = br.ue();
+        int top = br.ue();
+        int bottom = br.ue();
+        width -= sub_width * (left + right);
+        height -= sub_height * (top + bottom);
+    }
+    if (br.error() || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    info.width = width;
+    info.height = height;
+    info.fps = 0.0;
+    info.reorder_frames = 1;
+
+    // everything up to the vui only matters for its timing info, the size is already known on failure
+    br.ue();
+    br.ue();
+    int log2_max_poc_lsb = br.ue() + 4;
+    int sub_layer_ordering_info_present_flag = br.u(1);
+    for (int i = sub_layer_ordering_info_present_flag ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++) {
+        br.ue();
+        // the highest sub-layer's sps_max_num_reorder_pics is what the whole stream needs
+        uint32_t max_num_reorder_pics = br.ue();
+        br.ue();
+        info.reorder_frames = br.error() ? 1 : (int)std::min(max_num_reorder_pics, (uint32_t)16);
+    }
+    for (int i = 0; i < 6; i++) {
+        br.ue();
+    }
+    if (br.u(1) && br.u(1)) {
+        hevc_skip_scaling_list_data(br);
+    }
+    br.skip(2);
+    if (br.u(1)) {
+        // pcm
+        br.skip(8);
+        br.ue();
+        br.ue();
+        br.skip(1);
+    }
+
+    uint32_t num_short_term_ref_pic_sets = br.ue();
+    if (br.error() || num_short_term_ref_pic_sets > 64) {
+        return true;
+    }
+    std::vector<int> num_delta_pocs;
+    for (uint32_t i = 0; i < num_short_term_ref_pic_sets; i++) {
+        int count = hevc_skip_st_ref_pic_set(br, (int)i, num_delta_pocs);
+        if (count < 0) {
+            return true;
+        }
+        num_delta_pocs.push_back(count);
+    }
+
+    if (br.u(1)) {
+        uint32_t num_long_term_ref_pics = br.ue();
+        for (uint32_t i = 0; i < num_long_term_ref_pics && !br.error(); i++) {
+            br.skip(log2_max_poc_lsb + 1);
+        }
+    }
+    br.skip(2);
+
+    if (br.u(1)) {
+        skip_vui_head(br);
+        // neutral chroma, field seq, frame field info
+        br.skip(3);
+        if (br.u(1)) {
+            br.ue();
+            br.ue();
+            br.ue();
+            br.ue();
+        }
+        if (br.u(1)) {
+            uint32_t num_units_in_tick = br.u(32);
+            uint32_t time_scale = br.u(32);
+            if (!br.error() && num_units_in_tick > 0) {
+                info.fps = (double)time_scale / num_units_in_tick;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool hevc_parse_vps_fps(const uint8_t *nal, size_t size, double &fps)
+{
+    BitReader br(nal, size);
+
+    // nal header, id, base layer flags, max layers
+    br.skip(16 + 4 + 2 + 6);
+    int max_sub_layers_minus1 = br.u(3);
+    br.skip(1 + 16);
+    hevc_skip_profile_tier_level(br, max_sub_layers_minus1);
+
+    int sub_layer_ordering_info_present_flag = br.u(1);
+    for (int i = sub_layer_ordering_info_present_flag ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++) {
+        br.ue();
+        br.ue();
+        br.ue();
+    }
+
+    int max_layer_id = br.u(6);
+    uint32_t num_layer_sets_minus1 = br.ue();
+    if (br.error() || num_layer_sets_minus1 > 1023) {
+        return false;
+    }
+    br.skip((size_t)num_layer_sets_minus1 * (max_layer_id + 1));
+
+    if (!br.u(1)) {
+        return false;
+    }
+
+    uint32_t num_units_in_tick = br.u(32);
+    uint32_t time_scale = br.u(32);
+    if (br.error() || 0 == num_units_in_tick) {
+        return false;
+    }
+
+    fps = (double)time_scale / num_units_in_tick;
+    return true;
+}
+
+
+bool h26x_find_stream_info(int codec_id, const uint8_t *data, size_t size, H26xStreamInfo &info)
+{
+    const uint8_t *end = data + size;
+    double vps_fps = 0.0;
+
+    const uint8_t *p = find_start_code(data, end);
+    while (p < end) {
+        const uint8_t *nal = p + 3;
+        const uint8_t *next = find_start_code(nal, end);
+        if (nal >= end) {
+            break;
+        }
+
+        if (AV_CODEC_ID_H264 == codec_id) {
+            if (7 == (nal[0] & 0x1f) && h264_parse_sps(nal, next - nal, info)) {
+                return true;
+            }
+        }
+        else if (AV_CODEC_ID_HEVC == codec_id) {
+            int type = (nal[0] >> 1) & 0x3f;
+            if (32 == type) {
+                hevc_parse_vps_fps(nal, next - nal, vps_fps);
+            }
+            else if (33 == type && hevc_parse_sps(nal, next - nal, info)) {
+                if (info.fps <= 0.0) {
+                    info.fps = vps_fps;
+                }
+                return true;
+            }
+        }
+
+        p = next;
+    }
+
+    return false;
+}
+
+
+// nal units of an access unit, annex-b or length prefixed, fn returns false to stop
+template <typename Fn>
+static void for_each_nal(const uint8_t *data, size_t size, Fn fn)
+{
+    const uint8_t *end = data + size;
+    bool annexb = size >= 3 && 0 == data[0] && 0 == data[1] && (1 == data[2] || (size >= 4 && 0 == data[2] && 1 == data[3]));
+
+    if (annexb) {
+        const uint8_t *p = find_start_code(data, end);
+        while (p < end) {
+            const uint8_t *nal = p + 3;
+            const uint8_t *next = find_start_code(nal, end);
+            if (nal >= end) {
+                break;
+            }
+            if (!fn(nal, (size_t)(next - nal))) {
+                return;
+            }
+            p = next;
+        }
+        return;
+    }
+
+    const uint8_t *p = data;
+    while (end - p >= 4) {
+        size_t nal_size = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | (size_t)p[3];
+        p += 4;
+        if (0 == nal_size || nal_size > (size_t)(end - p)) {
+            break;
+        }
+        if (!fn(p, nal_size)) {
+            return;
+        }
+        p += nal_size;
+    }
+}
+
+
+bool h26x_is_disposable(int codec_id, const uint8_t *data, size_t size, int &max_temporal_id)
+{
+    int slices = 0;
+    bool disposable = true;
+
+    if (AV_CODEC_ID_H264 == codec_id) {
+        for_each_nal(data, size, [&](const uint8_t *nal, size_t nal_size) {
+            int type = nal[0] & 0x1f;
+            if (7 == type || 8 == type) {
+                disposable = false;
+            }
+            else if (type >= 1 && type <= 5) {
+                slices++;
+                disposable = disposable && 0 == ((nal[0] >> 5) & 0x03);
+            }
+            return disposable;
+        });
+    }
+    else if (AV_CODEC_ID_HEVC == codec_id) {
+        for_each_nal(data, size, [&](const uint8_t *nal, size_t nal_size) {
+            if (nal_size < 2) {
+                return true;
+            }
+
+            int type = (nal[0] >> 1) & 0x3f;
+            int temporal_id = (nal[1] & 0x07) - 1;
+            if (type >= 32 && type <= 34) {
+                disposable = false;
+            }
+            else if (type < 32) {
+                slices++;
+                max_temporal_id = std::max(max_temporal_id, temporal_id);
+
+                // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and the reserved RSV_VCL_N10/12/14, only higher sub-layers may reference them
+                bool sub_layer_non_reference = type <= 14 && 0 == type % 2;
+                disposable = disposable && sub_layer_non_reference && temporal_id == max_temporal_id;
+            }
+            return disposable;
+        });
+    }
+    else {
+        return false;
+    }
+
+    return disposable && slices > 0;
+}
+
+
+bool h26x_parameter_sets(int codec_id, const uint8_t *data, size_t size, std::vector<uint8_t> &extradata)
+{
+    if (AV_CODEC_ID_H264 != codec_id && AV_CODEC_ID_HEVC != codec_id) {
+        return false;
+    }
+
+    for_each_nal(data, size, [&](const uint8_t *nal, size_t nal_size) {
+        if (0 == nal_size) {
+            return true;
+        }
+
+        int type = AV_CODEC_ID_H264 == codec_id ? nal[0] & 0x1f : (nal[0] >> 1) & 0x3f;
+        bool parameter_set = AV_CODEC_ID_H264 == codec_id ? 7 == type || 8 == type : type >= 32 && type <= 34;
+        if (parameter_set) {
+            // the leading zero of a following 4 byte start code is not part of the nal
+            while (nal_size > 1 && 0 == nal[nal_size - 1]) {
+                nal_size--;
+            }
+
+            static const uint8_t start_code[] = { 0, 0, 0, 1 };
+            extradata.insert(extradata.end(), start_code, start_code + sizeof(start_code));
+            extradata.insert(extradata.end(), nal, nal + nal_size);
+        }
+        return true;
+    });
+
+    // which kinds are in extradata now
+    bool found[3] = { false, false, false };
+    for_each_nal(extradata.data(), extradata.size(), [&](const uint8_t *nal, size_t nal_size) {
+        if (AV_CODEC_ID_H264 == codec_id) {
+            int type = nal[0] & 0x1f;
+            found[0] = true;
+            found[1] = found[1] || 7 == type;
+            found[2] = found[2] || 8 == type;
+        }
+        else {
+            int type = (nal[0] >> 1) & 0x3f;
+            found[0] = found[0] || 32 == type;
+            found[1] = found[1] || 33 == type;
+            found[2] = found[2] || 34 == type;
+        }
+        return true;
+    });
+
+    return found[0] && found[1] && found[2];
+}
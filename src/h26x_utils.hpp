@@ -0,0 +1,38 @@
+#pragma once
+
+// c
+#include <stddef.h>
+#include <stdint.h>
+
+// c++
+#include <vector>
+
+
+
+// what the parameter sets tell about a stream, fps is 0 when the stream carries no timing info
+// reorder_frames is how many pictures may come out ahead of one in decode order, b-frames when > 0,
+// it is 1 for h264 profiles that allow b-frames but whose sps doesn't bound it
+struct H26xStreamInfo {
+    int width;
+    int height;
+    double fps;
+    int reorder_frames;
+};
+
+
+// nal points at the nal header, emulation prevention bytes are handled inside
+bool h264_parse_sps(const uint8_t *nal, size_t size, H26xStreamInfo &info);
+bool hevc_parse_sps(const uint8_t *nal, size_t size, H26xStreamInfo &info);
+bool hevc_parse_vps_fps(const uint8_t *nal, size_t size, double &fps);
+
+// find and parse the sequence parameter set in an annex-b buffer, codec_id is AV_CODEC_ID_H264 or AV_CODEC_ID_HEVC
+bool h26x_find_stream_info(int codec_id, const uint8_t *data, size_t size, H26xStreamInfo &info);
+
+// whether no other picture references the access unit: every slice is h264 nal_ref_idc 0, or a hevc sub-layer non-reference picture
+// of the highest temporal sub-layer seen so far, max_temporal_id carries that across calls. access units with parameter sets never are.
+// data is annex-b, or 4 byte length prefixed nal units as in mp4
+bool h26x_is_disposable(int codec_id, const uint8_t *data, size_t size, int &max_temporal_id);
+
+// append the parameter sets of an access unit to extradata as annex-b with 4 byte start codes, h264 sps and pps, hevc vps, sps and pps
+// data is annex-b, or 4 byte length prefixed nal units as in mp4, true once every kind the codec needs is in extradata
+bool h26x_parameter_sets(int codec_id, const uint8_t *data, size_t size, std::vector<uint8_t> &extradata);
@@ -0,0 +1,161 @@
+// self
+#include "job_spec.hpp"
+
+// c++
+#include <exception>
+#include <fstream>
+
+// project
+#include "ffmpeg_decode.hpp"
+
+// fmt
+#include <fmt/format.h>
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+// json
+#include <nlohmann/json.hpp>
+
+
+
+// bits per second, a number or a string with a K or M suffix, < 0 when it is neither
+static int64_t parse_bitrate(const nlohmann::json &value)
+{
+    if (value.is_number()) {
+        return value.get<int64_t>();
+    }
+    if (!value.is_string()) {
+        return -1;
+    }
+
+    std::string text = value.get<std::string>();
+    size_t end = 0;
+    double number = 0.0;
+    try {
+        number = std::stod(text, &end);
+    }
+    catch (const std::exception &) {
+        return -1;
+    }
+
+    std::string suffix = text.substr(end);
+    if (suffix.empty()) {
+        return (int64_t)number;
+    }
+    if (suffix == "k" || suffix == "K") {
+        return (int64_t)(number * 1000);
+    }
+    if (suffix == "m" || suffix == "M") {
+        return (int64_t)(number * 1000 * 1000);
+    }
+    return -1;
+}
+
+
+
+RenditionSpec::RenditionSpec()
+    : width(0)
+    , height(0)
+    , fps(0.0)
+    , bitrate(0)
+    , gop(0)
+{
+}
+
+
+
+JobSpec::JobSpec()
+    : intel_quick_sync_video(false)
+    , nvidia_video_codec(false)
+    , amd_advanced_media_framework(false)
+    , decode_tier("full")
+    , decode_fps(0.0)
+{
+}
+
+
+bool JobSpec::load(std::string path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        SPDLOG_ERROR("open job file error, path: {}", path);
+        return false;
+    }
+
+    try {
+        nlohmann::json job = nlohmann::json::parse(file);
+
+        name = job.value("name", path);
+
+        for (auto &input : job.at("inputs")) {
+            inputs.push_back(input.get<std::string>());
+        }
+        if (inputs.empty()) {
+            SPDLOG_ERROR("job has no inputs, path: {}", path);
+            return false;
+        }
+
+        std::string hardware = job.value("hardware", "software");
+        intel_quick_sync_video = hardware == "qsv";
+        nvidia_video_codec = hardware == "nvidia";
+        amd_advanced_media_framework = hardware == "amf";
+        if (hardware != "software" && !intel_quick_sync_video && !nvidia_video_codec && !amd_advanced_media_framework) {
+            SPDLOG_ERROR("unknown hardware: {}, support list: software, qsv, nvidia, amf, path: {}", hardware, path);
+            return false;
+        }
+
+        if (job.contains("decode")) {
+            const nlohmann::json &decode = job.at("decode");
+            decode_tier = decode.value("tier", decode_tier);
+            decode_fps = decode.value("fps", decode_fps);
+        }
+        if (DecodeTierCvt::from_string(decode_tier) == DecodeTier::Invalid) {
+            SPDLOG_ERROR("unknown decode tier: {}, support list: {}, path: {}", decode_tier, DecodeTierCvt::support_list(), path);
+            return false;
+        }
+
+        if (job.contains("renditions")) {
+            for (auto &item : job.at("renditions")) {
+                RenditionSpec rendition;
+                rendition.codec = item.at("codec").get<std::string>();
+                rendition.width = item.at("width").get<int>();
+                rendition.height = item.at("height").get<int>();
+                rendition.fps = item.value("fps", rendition.fps);
+                rendition.bitrate = parse_bitrate(item.at("bitrate"));
+                rendition.preset = item.value("preset", rendition.preset);
+                rendition.gop = item.value("gop", rendition.gop);
+
+                if (rendition.width <= 0 || rendition.height <= 0 || rendition.bitrate <= 0 || rendition.fps < 0.0 || rendition.gop < 0) {
+                    SPDLOG_ERROR("invalid rendition: {}, path: {}", item.dump(), path);
+                    return false;
+                }
+                renditions.push_back(rendition);
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        SPDLOG_ERROR("parse job file error, msg: {}, path: {}", e.what(), path);
+        return false;
+    }
+
+    return true;
+}
+
+
+std::string JobSpec::to_string()
+{
+    std::string ladder;
+    for (auto &rendition : renditions) {
+        ladder += fmt::format(
+            "{}{} {}x{}@{} {} bps{}{}", ladder.empty() ? "" : ", ", rendition.codec, rendition.width, rendition.height,
+            rendition.fps > 0.0 ? fmt::format("{:.2f}", rendition.fps) : "input", rendition.bitrate,
+            rendition.preset.empty() ? "" : " " + rendition.preset, rendition.gop > 0 ? fmt::format(" gop {}", rendition.gop) : ""
+        );
+    }
+
+    return fmt::format(
+        "job: {}, inputs: {}, decode tier: {}, decode fps: {}, renditions: {}",
+        name, inputs.size(), decode_tier, decode_fps, ladder.empty() ? "none" : ladder
+    );
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// c
+#include <stdint.h>
+
+// c++
+#include <string>
+#include <vector>
+
+
+
+// one output of a job's ladder
+struct RenditionSpec {
+    RenditionSpec();
+
+    // h264 and h265 pick the encoder of the job's hardware, anything else is a libavcodec encoder name
+    std::string codec;
+    int width;
+    int height;
+
+    // 0 keeps the decoded rate
+    double fps;
+    int64_t bitrate;
+
+    // empty keeps the encoder's default, gop 0 spans 2 seconds
+    std::string preset;
+    int gop;
+};
+
+
+// a transcode job read from a json file, every input runs the same ladder in turn
+//
+// {
+//     "name": "production",
+//     "inputs": ["./media/1080p.25fps.4M.264"],
+//     "hardware": "software",
+//     "decode": { "tier": "full", "fps": 0 },
+//     "renditions": [
+//         { "codec": "h264", "width": 1280, "height": 720, "fps": 25, "bitrate": "2M", "preset": "veryfast", "gop": 50 },
+//         { "codec": "h264", "width": 352, "height": 288, "fps": 12.5, "bitrate": "128K" }
+//     ]
+// }
+//
+// hardware is one of software, qsv, nvidia or amf, a job without renditions only decodes
+class JobSpec {
+public:
+    JobSpec();
+
+    bool load(std::string path);
+
+    // one line for the log
+    std::string to_string();
+
+    std::string name;
+    std::vector<std::string> inputs;
+
+    // hardware codecs for the decoder and the h264 and h265 encoders
+    bool intel_quick_sync_video;
+    bool nvidia_video_codec;
+    bool amd_advanced_media_framework;
+
+    // decode options, fps > 0 drops non-reference frames before decoding
+    std::string decode_tier;
+    double decode_fps;
+
+    std::vector<RenditionSpec> renditions;
+};
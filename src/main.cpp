@@ -1,18 +1,36 @@
 // project
+#include "codec_thread_budget.hpp"
+#include "decode_benchmark.hpp"
+#include "ffmpeg_annexb.hpp"
 #include "ffmpeg_demux.hpp"
+#include "ffmpeg_frame_buffer_pool.hpp"
+#include "ffmpeg_scale_templates.hpp"
+#include "ffmpeg_sink.hpp"
 #include "ffmpeg_transcode.hpp"
 #include "ffmpeg_utils.hpp"
+#include "job_spec.hpp"
 #include "math_utils.hpp"
+#include "scale_benchmark.hpp"
+#include "slice_thread_pool.hpp"
 #include "string_utils.hpp"
+#include "system_utils.hpp"
 
 // c
 #include <limits.h>
 
+// c++
+#include <algorithm>
+#include <thread>
+
 // ffmpeg
 extern "C" {
 #include <libavutil/log.h>
+#include <libavcodec/avcodec.h>
 }
 
+// fmt
+#include <fmt/ranges.h>
+
 // spdlog
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
@@ -31,11 +49,35 @@ public:
         , log_level((int)spdlog::level::info)
         , ffmpeg_log_level(AV_LOG_INFO)
         , threads(1)
+        , workers(0)
         , limit_input_frames(INT_MAX)
         , task("h264_to_cif_h264")
+        , job("")
         , intel_quick_sync_video(false)
         , nvidia_video_codec(false)
         , amd_advanced_media_framework(false)
+        , queue_depth(4)
+        , pipeline(false)
+        , streaming(false)
+        , packet_queue_depth(64)
+        , packet_arena(false)
+        , annexb_mmap(false)
+        , fast_probe(false)
+        , frame_buffer_pool(false)
+        , huge_pages(false)
+        , scale_cascade(false)
+        , scaler("auto")
+        , benchmark_scale(0)
+        , benchmark_decode(0)
+        , scale_slices({1})
+        , scale_threads(0)
+        , output_fps(0.0)
+        , rendition_fps({0.0})
+        , decode_tier("full")
+        , codec_threads(0)
+        , sink("null")
+        , sink_dir(".")
+        , sink_threads(1)
     {
     }
 
@@ -48,10 +90,34 @@ public:
         app.add_option("--ffmpeg_log_level", ffmpeg_log_level, "ffmpeg log level (default AV_LOG_INFO)");
         app.add_option("--limit_input_frames", limit_input_frames, "limit input frames (default INT_MAX)");
         app.add_option("--threads", threads, fmt::format("concurrent threads (default {})", threads));
+        app.add_option("--workers", workers, fmt::format("run all threads as channels on a scheduler with this many workers, 0 for one thread per channel (default {})", workers));
         app.add_option("--task", task, fmt::format("transcode task name (default {}, support list: {})", task, TranscodeTypeCvt::support_list()));
+        app.add_option("--job", job, "json job file with the inputs, decode options and renditions to run instead of --task, its hardware and decode options replace the ones here (default none)");
         app.add_option("--intel_quick_sync_video", intel_quick_sync_video, fmt::format("enable intel quick sync video (default {})", intel_quick_sync_video));
         app.add_option("--nvidia_video_codec", nvidia_video_codec, fmt::format("enable nvidia video codec (default {})", nvidia_video_codec));
         app.add_option("--amd_advanced_media_framework", amd_advanced_media_framework, fmt::format("enable amd advanced media framework (default {})", amd_advanced_media_framework));
+        app.add_option("--queue_depth", queue_depth, fmt::format("frames queued between decode and every output (default {})", queue_depth));
+        app.add_option("--pipeline", pipeline, fmt::format("run scale and encode of every output on their own threads (default {})", pipeline));
+        app.add_option("--streaming", streaming, fmt::format("demux while transcoding, every thread reads the input on its own demux thread instead of preloaded packets (default {})", streaming));
+        app.add_option("--packet_queue_depth", packet_queue_depth, fmt::format("packets queued between demux and decode with --streaming (default {})", packet_queue_depth));
+        app.add_option("--packet_arena", packet_arena, fmt::format("copy preloaded packets back to back into one large buffer (default {})", packet_arena));
+        app.add_option("--fast_probe", fast_probe, fmt::format("take size and fps from the first sps/vps instead of avformat_find_stream_info, falls back when that fails (default {})", fast_probe));
+        app.add_option("--annexb_mmap", annexb_mmap, fmt::format("memory map raw .264/.265 inputs and hand out packets pointing into the mapping, no avformat (default {})", annexb_mmap));
+        app.add_option("--frame_buffer_pool", frame_buffer_pool, fmt::format("software decoders of the same size and pixel format share one pool of picture buffers (default {})", frame_buffer_pool));
+        app.add_option("--scale_cascade", scale_cascade, fmt::format("scale every output from the nearest larger output instead of the decoded frame (default {})", scale_cascade));
+        app.add_option("--scaler", scaler, fmt::format("backend scaling software frames (default {}, support list: {})", scaler, ScaleBackendCvt::support_list()));
+        app.add_option("--scale_slices", scale_slices, fmt::format("horizontal slices every output frame is scaled in parallel, one value per output, the last one repeats (default {})", fmt::join(scale_slices, " ")));
+        app.add_option("--scale_threads", scale_threads, fmt::format("threads of the pool shared by every sliced scale, 0 for one less than the cores (default {})", scale_threads));
+        app.add_option("--benchmark_scale", benchmark_scale, fmt::format("decode this many frames of the task input and time swscale against the simd scaler on them instead of transcoding, 0 to disable (default {})", benchmark_scale));
+        app.add_option("--output_fps", output_fps, fmt::format("encode at this frame rate, non-reference frames are dropped before decoding and decoded frames after it to get there, 0 keeps the input rate (default {})", output_fps));
+        app.add_option("--rendition_fps", rendition_fps, fmt::format("encode each output at this frame rate, decoded frames are decimated before scaling, one value per output, the last one repeats, 0 keeps the decoded rate (default {})", fmt::join(rendition_fps, " ")));
+        app.add_option("--decode_tier", decode_tier, fmt::format("skip the loop filter and idct of non-reference or of all frames to decode faster at lower quality (default {}, support list: {})", decode_tier, DecodeTierCvt::support_list()));
+        app.add_option("--codec_threads", codec_threads, fmt::format("cores the decoders and encoders of all running channels share by their cost, -1 for all cores, 0 keeps every codec at 1 thread (default {})", codec_threads));
+        app.add_option("--sink", sink, fmt::format("where the packets of every output go, file sinks mux on io threads, null drops them (default {}, support list: {})", sink, SinkTypeCvt::support_list()));
+        app.add_option("--sink_dir", sink_dir, fmt::format("directory of the task<id>_output<index> files of the file sinks, and of the task<id>_snapshot<n> pictures, job files put input<k>_ in front (default {})", sink_dir));
+        app.add_option("--sink_threads", sink_threads, fmt::format("io threads muxing for the file sinks (default {})", sink_threads));
+        app.add_option("--benchmark_decode", benchmark_decode, fmt::format("decode this many packets of the task input at every decode tier next to a full decoder, time both and report the psnr drift instead of transcoding, 0 to disable (default {})", benchmark_decode));
+        app.add_option("--huge_pages", huge_pages, fmt::format("back --frame_buffer_pool buffers with transparent huge pages where supported (default {})", huge_pages));
     }
 
     std::string input_h264_url;
@@ -60,14 +126,194 @@ public:
     int log_level;
     int ffmpeg_log_level;
     int threads;
+    int workers;
     int limit_input_frames;
     std::string task;
+    std::string job;
     bool intel_quick_sync_video;
     bool nvidia_video_codec;
     bool amd_advanced_media_framework;
+    int queue_depth;
+    bool pipeline;
+    bool streaming;
+    int packet_queue_depth;
+    bool packet_arena;
+    bool annexb_mmap;
+    bool fast_probe;
+    bool frame_buffer_pool;
+    bool huge_pages;
+    bool scale_cascade;
+    std::string scaler;
+    int benchmark_scale;
+    int benchmark_decode;
+    std::vector<int> scale_slices;
+    int scale_threads;
+    double output_fps;
+    std::vector<double> rendition_fps;
+    std::string decode_tier;
+    int codec_threads;
+    std::string sink;
+    std::string sink_dir;
+    int sink_threads;
+};
+
+
+double to_mib(int64_t bytes) {
+    return bytes / 1024.0 / 1024.0;
+}
+
+
+// read packets before the timed run, optionally into a contiguous arena
+std::vector<FFmpegPacket> preload_packets(CommandArguments &args, FFmpegDemux &demux) {
+    int64_t rss_before = current_rss_bytes();
+
+    std::vector<FFmpegPacket> frames_queue;
+    if (args.packet_arena) {
+        // a single chunk for the whole input when its size is known
+        int64_t input_size = demux.input_size();
+        FFmpegPacketArena arena(input_size > 0 ? (size_t)(input_size + input_size / 16) : 64 * 1024 * 1024);
+        frames_queue = demux.read_some_frames(args.limit_input_frames, &arena);
+
+        SPDLOG_INFO("packet arena, packets: {}, bytes: {}, chunks: {}", arena.packets(), arena.bytes(), arena.chunks());
+    }
+    else {
+        frames_queue = demux.read_some_frames(args.limit_input_frames);
+    }
+
+    SPDLOG_INFO(
+        "preload packets: {}, packet_arena: {}, rss: {:.2f} -> {:.2f} MiB, peak_rss: {:.2f} MiB",
+        frames_queue.size(), args.packet_arena, to_mib(rss_before), to_mib(current_rss_bytes()), to_mib(peak_rss_bytes())
+    );
+
+    return frames_queue;
+}
+
+
+// preloaded packets shared by every thread, or a demux thread per thread when streaming
+FFmpegPacketSourceMaker packet_source_maker(
+    CommandArguments &args, std::string input_url, std::vector<FFmpegPacket> &frames_queue, double fps, std::pair<int, int> time_base,
+    const AVCodecParameters *codecpar, bool has_pts
+) {
+    if (args.streaming) {
+        int queue_depth = args.packet_queue_depth;
+        int limit_packets = args.limit_input_frames;
+        bool fast_probe = args.fast_probe;
+        return [input_url, queue_depth, limit_packets, fast_probe]() {
+            return std::make_shared<FFmpegDemuxStream>(input_url, queue_depth, limit_packets, fast_probe);
+        };
+    }
+
+    std::vector<FFmpegPacket> *packets = &frames_queue;
+    return [packets, fps, time_base, codecpar, has_pts]() {
+        return std::make_shared<FFmpegPacketVector>(*packets, fps, time_base, codecpar, has_pts);
+    };
+}
+
+
+// one input, probed once, and the packets every channel reads from it
+class TestInput {
+public:
+    TestInput()
+        : width(-1)
+        , height(-1)
+        , frames(0)
+        , codecpar(nullptr)
+    {
+    }
+    TestInput(const TestInput &other) = delete;
+    ~TestInput()
+    {
+        avcodec_parameters_free(&codecpar);
+    }
+
+    bool open(CommandArguments &args, std::string input_url)
+    {
+        // raw elementary streams skip avformat entirely
+        if (args.annexb_mmap && FFmpegAnnexBFile::is_annexb(input_url)) {
+            std::shared_ptr<FFmpegAnnexBFile> file = std::make_shared<FFmpegAnnexBFile>(input_url, args.limit_input_frames);
+            if (file->setup()) {
+                codec = file->codec_name();
+                width = file->width();
+                height = file->height();
+                frames = file->size();
+                make_packets = [file]() {
+                    return std::make_shared<FFmpegAnnexBSource>(file);
+                };
+                return true;
+            }
+            SPDLOG_WARN("annex-b reader failed, fall back to avformat, input_url: {}", input_url);
+        }
+
+        FFmpegDemux demux(input_url, args.fast_probe);
+        if (!demux.setup()) {
+            return false;
+        }
+
+        codec = demux.codec_name();
+        width = demux.width();
+        height = demux.height();
+        if (!args.streaming) {
+            frames_queue = preload_packets(args, demux);
+        }
+        frames = frames_queue.size();
+
+        // the demux is gone before the channels run, preloaded packets keep a copy of its parameters
+        codecpar = avcodec_parameters_alloc();
+        if (nullptr == codecpar || avcodec_parameters_copy(codecpar, demux.codec_parameters()) < 0) {
+            return false;
+        }
+        make_packets = packet_source_maker(args, input_url, frames_queue, demux.fps(), demux.time_base(), codecpar, demux.has_pts());
+
+        return true;
+    }
+
+    std::string codec;
+    int width;
+    int height;
+    size_t frames;
+
+    std::vector<FFmpegPacket> frames_queue;
+    AVCodecParameters *codecpar;
+    FFmpegPacketSourceMaker make_packets;
 };
 
 
+// the ladder sizes of the transcode tasks, scaled from the same decoded frames by every backend
+int benchmark_scale(CommandArguments args) {
+    std::string input_url = startswith(args.task, "h265_") ? args.input_h265_url : args.input_h264_url;
+
+    ScaleBenchmark benchmark(input_url, args.benchmark_scale, args.fast_probe);
+    if (!benchmark.setup()) {
+        return -1;
+    }
+
+    if (!benchmark.run(720, 480) || !benchmark.run(352, 288)) {
+        return -2;
+    }
+
+    return 0;
+}
+
+
+// every decode tier on the task input, against the full decode
+int benchmark_decode(CommandArguments args) {
+    std::string input_url = startswith(args.task, "h265_") ? args.input_h265_url : args.input_h264_url;
+
+    DecodeBenchmark benchmark(input_url, args.benchmark_decode, args.fast_probe);
+    if (!benchmark.setup()) {
+        return -1;
+    }
+
+    for (auto e = (uint8_t)DecodeTier::Full; e <= (uint8_t)DecodeTier::FastAll; e++) {
+        if (!benchmark.run((DecodeTier)e)) {
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+
 int transcode(CommandArguments args) {
     TimeIt ti;
     TranscodeType task_type = TranscodeTypeCvt::from_string(args.task);
@@ -79,68 +325,69 @@ int transcode(CommandArguments args) {
         std::vector<int64_t> output_bitrate;
 
         if (task_type != TranscodeType::AllTasks) {
-            FFmpegDemux demux = startswith(TranscodeTypeCvt::to_string(task_type), "h264_") ? FFmpegDemux(args.input_h264_url) : FFmpegDemux(args.input_h265_url);
-            if (!demux.setup()) {
+            std::string input_url = startswith(TranscodeTypeCvt::to_string(task_type), "h264_") ? args.input_h264_url : args.input_h265_url;
+            TestInput input;
+            if (!input.open(args, input_url)) {
                 return -1;
             }
-
-            int width = demux.width();
-            int height = demux.height();
-            input_codec = demux.codec_name();
-            std::vector<FFmpegPacket> frames_queue = demux.read_some_frames(args.limit_input_frames);
+            input_codec = input.codec;
 
             ti.reset();
-            SPDLOG_INFO("========== threads: {}, frames: {}, {} begin ==========", args.threads, frames_queue.size(), args.task);
+            SPDLOG_INFO("========== threads: {}, frames: {}, streaming: {}, {} begin ==========", args.threads, input.frames, args.streaming, args.task);
 
             FFmpegTranscodeFactory factory;
             FFmpegTranscode *transcode = factory.create(
                 task_type, input_codec, output_codec, output_width, output_height, output_bitrate,
-                args.intel_quick_sync_video, args.nvidia_video_codec, args.amd_advanced_media_framework
+                args.intel_quick_sync_video, args.nvidia_video_codec, args.amd_advanced_media_framework, args.queue_depth, args.pipeline, args.scale_cascade,
+                ScaleBackendCvt::from_string(args.scaler), args.scale_slices, args.output_fps, args.rendition_fps,
+                DecodeTierCvt::from_string(args.decode_tier), SinkTypeCvt::from_string(args.sink), args.sink_dir
+            );
+            transcode->multi_threading_test(
+                args.threads, input.make_packets, input_codec, input.width, input.height,
+                output_codec, output_width, output_height, output_bitrate, args.workers
             );
-            transcode->multi_threading_test(args.threads, frames_queue, input_codec, width, height, output_codec, output_width, output_height, output_bitrate);
 
-            SPDLOG_INFO("========== threads: {}, frames: {}, {} end with {:.2f}s ==========", args.threads, frames_queue.size(), args.task, ti.elapsed_seconds());
+            SPDLOG_INFO("========== threads: {}, frames: {}, streaming: {}, {} end with {:.2f}s ==========", args.threads, input.frames, args.streaming, args.task, ti.elapsed_seconds());
         }
         else {
-            FFmpegDemux demux_h264(args.input_h264_url);
-            if (!demux_h264.setup()) {
+            TestInput input_h264;
+            if (!input_h264.open(args, args.input_h264_url)) {
                 return -2;
             }
-            std::vector<FFmpegPacket> frames_queue_h264 = demux_h264.read_some_frames(args.limit_input_frames);
-            int width_h264 = demux_h264.width();
-            int height_h264 = demux_h264.height();
 
-            FFmpegDemux demux_h265(args.input_h265_url);
-            if (!demux_h265.setup()) {
+            TestInput input_h265;
+            if (!input_h265.open(args, args.input_h265_url)) {
                 return -3;
             }
-            std::vector<FFmpegPacket> frames_queue_h265 = demux_h265.read_some_frames(args.limit_input_frames);
-            int width_h265 = demux_h265.width();
-            int height_h265 = demux_h265.height();
 
             ti.reset();
             SPDLOG_INFO(
                 "========== threads: {}, h264 frames: {}, h265 frames: {}, {} begin ==========",
-                args.threads, frames_queue_h264.size(), frames_queue_h265.size(), args.task
+                args.threads, input_h264.frames, input_h265.frames, args.task
             );
 
             for (auto e = (int)TranscodeType::H264DecodeOnly; e < (int)TranscodeType::AllTasks; e++) {
+                bool is_h264 = startswith(TranscodeTypeCvt::to_string((TranscodeType)e), "h264_");
+                TestInput &input = is_h264 ? input_h264 : input_h265;
+                input_codec = input.codec;
+
                 FFmpegTranscodeFactory factory;
                 FFmpegTranscode *transcode = factory.create(
                     (TranscodeType)e, input_codec, output_codec, output_width,
-                    output_height, output_bitrate, args.intel_quick_sync_video, args.nvidia_video_codec, args.amd_advanced_media_framework
+                    output_height, output_bitrate, args.intel_quick_sync_video, args.nvidia_video_codec, args.amd_advanced_media_framework,
+                    args.queue_depth, args.pipeline, args.scale_cascade, ScaleBackendCvt::from_string(args.scaler), args.scale_slices, args.output_fps,
+                    args.rendition_fps, DecodeTierCvt::from_string(args.decode_tier), SinkTypeCvt::from_string(args.sink), args.sink_dir
                 );
 
-                bool is_h264 = startswith(TranscodeTypeCvt::to_string((TranscodeType)e), "h264_");
                 transcode->multi_threading_test(
-                    args.threads, is_h264 ? frames_queue_h264 : frames_queue_h265, input_codec, is_h264 ? width_h264 : width_h265, is_h264 ? height_h264 : height_h265,
-                    output_codec, output_width, output_height, output_bitrate
+                    args.threads, input.make_packets, input_codec, input.width, input.height,
+                    output_codec, output_width, output_height, output_bitrate, args.workers
                 );
             }
 
             SPDLOG_INFO(
                 "========== threads: {}, h264 frames: {}, h265 frames: {}, {} end with {}s ==========",
-                args.threads, frames_queue_h264.size(), frames_queue_h265.size(), args.task, ti.elapsed_seconds()
+                args.threads, input_h264.frames, input_h265.frames, args.task, ti.elapsed_seconds()
             );
         }
     }
@@ -149,6 +396,48 @@ int transcode(CommandArguments args) {
 }
 
 
+// the ladder of a job file on each of its inputs in turn
+int transcode_job(CommandArguments args) {
+    JobSpec job;
+    if (!job.load(args.job)) {
+        return -1;
+    }
+    SPDLOG_INFO("{}", job.to_string());
+
+    for (size_t k = 0; k < job.inputs.size(); k++) {
+        std::string &input_url = job.inputs[k];
+        TestInput input;
+        if (!input.open(args, input_url)) {
+            return -2;
+        }
+
+        TimeIt ti;
+        SPDLOG_INFO("========== threads: {}, frames: {}, streaming: {}, job: {}, input: {} begin ==========", args.threads, input.frames, args.streaming, job.name, input_url);
+
+        std::string input_codec = input.codec;
+        std::vector<std::string> output_codec;
+        std::vector<int> output_width;
+        std::vector<int> output_height;
+        std::vector<int64_t> output_bitrate;
+
+        FFmpegTranscodeFactory factory;
+        FFmpegTranscode *transcode = factory.create(
+            job, input_codec, output_codec, output_width, output_height, output_bitrate, args.queue_depth, args.pipeline, args.scale_cascade,
+            ScaleBackendCvt::from_string(args.scaler), args.scale_slices, SinkTypeCvt::from_string(args.sink), args.sink_dir,
+            fmt::format("input{}", k)
+        );
+        transcode->multi_threading_test(
+            args.threads, input.make_packets, input_codec, input.width, input.height,
+            output_codec, output_width, output_height, output_bitrate, args.workers
+        );
+
+        SPDLOG_INFO("========== threads: {}, frames: {}, streaming: {}, job: {}, input: {} end with {:.2f}s ==========", args.threads, input.frames, args.streaming, job.name, input_url, ti.elapsed_seconds());
+    }
+
+    return 0;
+}
+
+
 int main(int argc, char **argv) {
     // parse cli
     CLI::App app("ffmpeg transcode");
@@ -164,8 +453,73 @@ int main(int argc, char **argv) {
     spdlog::set_level((spdlog::level::level_enum)args.log_level);
     spdlog::flush_on((spdlog::level::level_enum)args.log_level);
 
+    if (args.frame_buffer_pool) {
+        FFmpegFrameBufferPools::instance().enable(args.huge_pages);
+    }
+
+    if (ScaleBackendCvt::from_string(args.scaler) == ScaleBackend::Invalid) {
+        SPDLOG_ERROR("unknown scaler: {}, support list: {}", args.scaler, ScaleBackendCvt::support_list());
+        return -1;
+    }
+
+    if (DecodeTierCvt::from_string(args.decode_tier) == DecodeTier::Invalid) {
+        SPDLOG_ERROR("unknown decode tier: {}, support list: {}", args.decode_tier, DecodeTierCvt::support_list());
+        return -1;
+    }
+
+    SinkType sink_type = SinkTypeCvt::from_string(args.sink);
+    if (sink_type == SinkType::Invalid) {
+        SPDLOG_ERROR("unknown sink: {}, support list: {}", args.sink, SinkTypeCvt::support_list());
+        return -1;
+    }
+
+    if (args.benchmark_scale > 0) {
+        return benchmark_scale(args);
+    }
+
+    if (args.benchmark_decode > 0) {
+        return benchmark_decode(args);
+    }
+
+    // the calling thread takes a slice as well
+    bool sliced = std::any_of(args.scale_slices.begin(), args.scale_slices.end(), [](int slices) { return slices > 1; });
+    if (sliced) {
+        int cores = (int)std::thread::hardware_concurrency();
+        SliceThreadPool::instance().start(args.scale_threads > 0 ? args.scale_threads : std::max(cores - 1, 1));
+    }
+
+    if (args.codec_threads != 0) {
+        CodecThreadBudget::instance().set_cores(args.codec_threads > 0 ? args.codec_threads : (int)std::thread::hardware_concurrency());
+    }
+
+    if (sink_type != SinkType::Null) {
+        FFmpegSinkIo::instance().start(args.sink_threads);
+    }
+
     // transcode
-    transcode(args);
+    if (args.job.empty()) {
+        transcode(args);
+    }
+    else {
+        transcode_job(args);
+    }
+
+    if (args.frame_buffer_pool) {
+        SPDLOG_INFO("{}", FFmpegFrameBufferPools::instance().stats());
+    }
+    SPDLOG_INFO("{}", FFmpegScaleTemplates::instance().stats());
+    if (args.codec_threads != 0) {
+        SPDLOG_INFO("{}", CodecThreadBudget::instance().stats());
+    }
+    if (sink_type != SinkType::Null) {
+        SPDLOG_INFO("{}", FFmpegSinkIo::instance().stats());
+        FFmpegSinkIo::instance().stop();
+    }
+    if (sliced) {
+        SPDLOG_INFO("{}", SliceThreadPool::instance().stats());
+        SliceThreadPool::instance().stop();
+    }
+    SPDLOG_INFO("rss: {:.2f} MiB, peak_rss: {:.2f} MiB", to_mib(current_rss_bytes()), to_mib(peak_rss_bytes()));
 
     return 0;
 }
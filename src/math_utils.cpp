@@ -3,6 +3,7 @@
 
 // c
 #include <math.h>
+#include <stddef.h>
 
 // c++
 #include <algorithm>
@@ -61,6 +62,13 @@ double TimeIt::elapsed_milliseconds() const {
 }
 
 
+double TimeIt::elapsed_microseconds() const {
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - m_begin_time);
+    return duration.count();
+}
+
+
 double TimeIt::elapsed_seconds() const {
     return elapsed_milliseconds() / 1000.0;
 }
@@ -106,3 +114,24 @@ void Percentile::reset()
 {
     m_values.clear();
 }
+
+
+
+double psnr_u8(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride, int width, int height)
+{
+    uint64_t sse = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t *pa = a + (ptrdiff_t)y * a_stride;
+        const uint8_t *pb = b + (ptrdiff_t)y * b_stride;
+        for (int x = 0; x < width; x++) {
+            int d = pa[x] - pb[x];
+            sse += d * d;
+        }
+    }
+
+    if (0 == sse) {
+        return INFINITY;
+    }
+    double mse = (double)sse / ((double)width * height);
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
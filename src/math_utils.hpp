@@ -1,5 +1,8 @@
 #pragma once
 
+// c
+#include <stdint.h>
+
 // c++
 #include <chrono>
 #include <list>
@@ -34,6 +37,8 @@ public:
 
     double elapsed_milliseconds() const;
 
+    double elapsed_microseconds() const;
+
     double elapsed_seconds() const;
 
 
@@ -59,3 +64,7 @@ private:
 };
 
 
+
+
+// psnr in db of two 8-bit planes, INFINITY when they are identical
+double psnr_u8(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride, int width, int height);
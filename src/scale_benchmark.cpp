@@ -0,0 +1,221 @@
+// self
+#include "scale_benchmark.hpp"
+
+// c
+#include <math.h>
+
+// c++
+#include <memory>
+
+// project
+#include "ffmpeg_decode.hpp"
+#include "ffmpeg_demux.hpp"
+#include "ffmpeg_utils.hpp"
+#include "math_utils.hpp"
+#include "simd_scale.hpp"
+
+// ffmpeg
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+struct ScaleCandidate {
+    const char *name;
+    bool simd;
+    int sws_flags;
+    SimdScaleFilter filter;
+};
+
+
+// the first one is the reference the others are compared with
+static const ScaleCandidate k_candidates[] = {
+    { "sws_bicubic", false, SWS_BICUBIC, SimdScaleFilter::Bilinear },
+    { "sws_bilinear", false, SWS_BILINEAR, SimdScaleFilter::Bilinear },
+    { "sws_area", false, SWS_AREA, SimdScaleFilter::Area },
+    { "simd_bilinear", true, 0, SimdScaleFilter::Bilinear },
+    { "simd_area", true, 0, SimdScaleFilter::Area },
+};
+
+
+static FFmpegFrame alloc_picture(int width, int height, int pixel_format)
+{
+    FFmpegFrame frame;
+    if (frame.is_null()) {
+        return frame;
+    }
+
+    frame.raw_ptr()->format = pixel_format;
+    frame.raw_ptr()->width = width;
+    frame.raw_ptr()->height = height;
+
+    int code = av_frame_get_buffer(frame.raw_ptr(), 0);
+    if (code < 0) {
+        SPDLOG_ERROR("av_frame_get_buffer error, code: {}, msg: {}", code, ffmpeg_error_str(code));
+        frame.free();
+    }
+
+    return frame;
+}
+
+
+
+ScaleBenchmark::ScaleBenchmark(std::string input_url, int frames, bool fast_probe)
+    : m_input_url(input_url)
+    , m_limit_frames(frames)
+    , m_fast_probe(fast_probe)
+{
+}
+
+
+bool ScaleBenchmark::setup()
+{
+    FFmpegDemux demux(m_input_url, m_fast_probe);
+    if (!demux.setup()) {
+        return false;
+    }
+
+    FFmpegDecode decoder(demux.codec_name());
+    if (!decoder.setup()) {
+        return false;
+    }
+
+    while ((int)m_frames.size() < m_limit_frames) {
+        FFmpegPacket packet = demux.read_frame();
+        if (packet.is_null()) {
+            break;
+        }
+
+        if (!decoder.send_packet(packet)) {
+            return false;
+        }
+
+        while ((int)m_frames.size() < m_limit_frames) {
+            FFmpegFrame frame = decoder.receive_frame();
+            if (frame.does_need_more()) {
+                break;
+            }
+            if (frame.is_null()) {
+                return false;
+            }
+            m_frames.push_back(std::move(frame));
+        }
+    }
+
+    if (m_frames.empty()) {
+        SPDLOG_ERROR("scale benchmark, no frames decoded from {}", m_input_url);
+        return false;
+    }
+
+    AVFrame *first = m_frames[0].raw_ptr();
+    SPDLOG_INFO(
+        "scale benchmark, frames: {}, {}x{} {}, simd isa: {}",
+        m_frames.size(), first->width, first->height, av_get_pix_fmt_name((enum AVPixelFormat)first->format), SimdScaler::isa()
+    );
+
+    return true;
+}
+
+
+bool ScaleBenchmark::run(int width, int height)
+{
+    AVFrame *first = m_frames[0].raw_ptr();
+    int src_width = first->width;
+    int src_height = first->height;
+    int pixel_format = first->format;
+    bool simd_supported = (pixel_format == AV_PIX_FMT_YUV420P || pixel_format == AV_PIX_FMT_YUVJ420P) && width <= src_width && height <= src_height;
+
+    int plane_width[3] = { width, (width + 1) / 2, (width + 1) / 2 };
+    int plane_height[3] = { height, (height + 1) / 2, (height + 1) / 2 };
+
+    std::vector<FFmpegFrame> references;
+    for (const ScaleCandidate &candidate : k_candidates) {
+        if (candidate.simd && !simd_supported) {
+            SPDLOG_WARN(
+                "scale benchmark, {} skipped, {}x{} {} -> {}x{} is not a yuv420p downscale",
+                candidate.name, src_width, src_height, av_get_pix_fmt_name((enum AVPixelFormat)pixel_format), width, height
+            );
+            continue;
+        }
+
+        SwsContext *sws_context = nullptr;
+        std::unique_ptr<SimdScaler> simd_scaler;
+        if (candidate.simd) {
+            simd_scaler.reset(new SimdScaler(src_width, src_height, width, height, candidate.filter));
+        }
+        else {
+            sws_context = sws_getContext(
+                src_width, src_height, (enum AVPixelFormat)pixel_format, width, height, (enum AVPixelFormat)pixel_format,
+                candidate.sws_flags, nullptr, nullptr, nullptr
+            );
+            if (nullptr == sws_context) {
+                SPDLOG_ERROR("sws_getContext error, {}x{} -> {}x{}, flags: {}", src_width, src_height, width, height, candidate.sws_flags);
+                return false;
+            }
+        }
+
+        // the reference keeps every output, the others reuse one picture
+        bool reference = references.empty();
+        FFmpegFrame output = reference ? FFmpegFrame(nullptr) : alloc_picture(width, height, pixel_format);
+
+        Percentile percentile_scale;
+        double total_ms = 0.0;
+        double psnr[3] = { 0.0, 0.0, 0.0 };
+        bool ok = reference || !output.is_null();
+        for (size_t i = 0; ok && i < m_frames.size(); i++) {
+            if (reference) {
+                references.push_back(alloc_picture(width, height, pixel_format));
+                ok = !references.back().is_null();
+                if (!ok) {
+                    break;
+                }
+            }
+
+            AVFrame *src = m_frames[i].raw_ptr();
+            AVFrame *dst = reference ? references[i].raw_ptr() : output.raw_ptr();
+
+            TimeIt ti_step;
+            if (simd_scaler != nullptr) {
+                simd_scaler->scale(src->data, src->linesize, dst->data, dst->linesize);
+            }
+            else {
+                sws_scale(sws_context, src->data, src->linesize, 0, src_height, dst->data, dst->linesize);
+            }
+            // a 352x288 scale takes well under a millisecond
+            double scale_elapsed_ms = ti_step.elapsed_microseconds() / 1000.0;
+            total_ms += scale_elapsed_ms;
+            percentile_scale.add(scale_elapsed_ms);
+
+            if (!reference) {
+                AVFrame *ref = references[i].raw_ptr();
+                for (int p = 0; p < 3; p++) {
+                    psnr[p] += psnr_u8(dst->data[p], dst->linesize[p], ref->data[p], ref->linesize[p], plane_width[p], plane_height[p]);
+                }
+            }
+        }
+
+        if (sws_context != nullptr) {
+            sws_freeContext(sws_context);
+        }
+
+        if (!ok) {
+            SPDLOG_ERROR("scale benchmark, {} output frame error", candidate.name);
+            return false;
+        }
+
+        size_t frames = m_frames.size();
+        SPDLOG_INFO(
+            "scale benchmark {}x{} -> {}x{}, {:<13} avg: {:.3f} ms, p99: {:.3f} ms, fps: {:.1f}, psnr vs sws_bicubic y: {:.2f}, u: {:.2f}, v: {:.2f} dB",
+            src_width, src_height, width, height, candidate.name, total_ms / frames, percentile_scale.calc(0.99), frames * 1000.0 / total_ms,
+            reference ? INFINITY : psnr[0] / frames, reference ? INFINITY : psnr[1] / frames, reference ? INFINITY : psnr[2] / frames
+        );
+    }
+
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// c++
+#include <string>
+#include <vector>
+
+// project
+#include "ffmpeg_types.hpp"
+
+
+
+// swscale against the simd scaler on the same decoded frames, single threaded
+// quality is psnr against the swscale bicubic output, the default of the scale filter
+class ScaleBenchmark {
+public:
+    ScaleBenchmark(std::string input_url, int frames, bool fast_probe = false);
+    ScaleBenchmark(const ScaleBenchmark &other) = delete;
+
+    // decode the frames every run scales
+    bool setup();
+
+    bool run(int width, int height);
+
+
+private:
+    std::string m_input_url;
+    int m_limit_frames;
+    bool m_fast_probe;
+
+    std::vector<FFmpegFrame> m_frames;
+};
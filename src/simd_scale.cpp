@@ -0,0 +1,339 @@
+// self
+#include "simd_scale.hpp"
+
+// c
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define SIMD_SCALE_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_SCALE_NEON 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_SCALE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_SCALE_TARGET_AVX2
+#endif
+
+// c++
+#include <algorithm>
+
+// ffmpeg
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+
+
+static const int k_weight_bits = 14;
+static const int k_weight_one = 1 << k_weight_bits;
+
+// horizontal taps are processed 4 at a time, one 32-bit gather per output
+static const int k_horizontal_chunk = 4;
+
+
+typedef void (*VerticalKernel)(const uint8_t *const *rows, const int16_t *weights, int taps, uint8_t *out, int width);
+
+// weights are chunk major, 4 taps of output x of chunk c at ((c * width + x) * 4)
+typedef void (*HorizontalKernel)(const uint8_t *row, const int32_t *starts, const int16_t *weights, int chunks, uint8_t *out, int width, int x);
+
+
+
+static void vertical_c(const uint8_t *const *rows, const int16_t *weights, int taps, uint8_t *out, int width, int x)
+{
+    for (; x < width; x++) {
+        int sum = 1 << (k_weight_bits - 1);
+        for (int k = 0; k < taps; k++) {
+            sum += rows[k][x] * weights[k];
+        }
+        out[x] = (uint8_t)std::min(sum >> k_weight_bits, 255);
+    }
+}
+
+
+static void vertical_c(const uint8_t *const *rows, const int16_t *weights, int taps, uint8_t *out, int width)
+{
+    vertical_c(rows, weights, taps, out, width, 0);
+}
+
+
+static void horizontal_c(const uint8_t *row, const int32_t *starts, const int16_t *weights, int chunks, uint8_t *out, int width, int x)
+{
+    for (; x < width; x++) {
+        const uint8_t *p = row + starts[x];
+        int sum = 1 << (k_weight_bits - 1);
+        for (int c = 0; c < chunks; c++) {
+            const int16_t *w = weights + ((size_t)c * width + x) * k_horizontal_chunk;
+            for (int k = 0; k < k_horizontal_chunk; k++) {
+                sum += p[c * k_horizontal_chunk + k] * w[k];
+            }
+        }
+        out[x] = (uint8_t)std::min(sum >> k_weight_bits, 255);
+    }
+}
+
+
+#if SIMD_SCALE_X86
+// 16 pixels per step, two source rows interleaved so one madd applies a pair of taps
+SIMD_SCALE_TARGET_AVX2 static void vertical_avx2(const uint8_t *const *rows, const int16_t *weights, int taps, uint8_t *out, int width)
+{
+    const __m256i round = _mm256_set1_epi32(1 << (k_weight_bits - 1));
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i lo = round;
+        __m256i hi = round;
+        for (int k = 0; k < taps; k += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k] + x)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k + 1] + x)));
+            __m256i w = _mm256_set1_epi32((int32_t)(uint16_t)weights[k] | ((int32_t)weights[k + 1] << 16));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+
+        // unpack works per 128-bit lane, packing in the same order restores pixel order within each lane
+        __m256i p16 = _mm256_packs_epi32(_mm256_srai_epi32(lo, k_weight_bits), _mm256_srai_epi32(hi, k_weight_bits));
+        __m256i p8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(p16, p16), 0xD8);
+        _mm_storeu_si128((__m128i *)(out + x), _mm256_castsi256_si128(p8));
+    }
+
+    vertical_c(rows, weights, taps, out, width, x);
+}
+
+
+// 8 outputs per step, each gathers 4 consecutive source bytes per chunk of taps
+SIMD_SCALE_TARGET_AVX2 static void horizontal_avx2(const uint8_t *row, const int32_t *starts, const int16_t *weights, int chunks, uint8_t *out, int width, int x)
+{
+    const __m256i round = _mm256_set1_epi32(1 << (k_weight_bits - 1));
+    const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+
+    for (; x + 8 <= width; x += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i *)(starts + x));
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int c = 0; c < chunks; c++) {
+            __m256i g = _mm256_i32gather_epi32((const int *)(row + c * k_horizontal_chunk), index, 1);
+            const int16_t *w = weights + ((size_t)c * width + x) * k_horizontal_chunk;
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(g)), _mm256_loadu_si256((const __m256i *)w)));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(g, 1)), _mm256_loadu_si256((const __m256i *)(w + 16))));
+        }
+
+        // pairwise sums come out as 0 1 4 5 | 2 3 6 7
+        __m256i sum = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(lo, hi), order);
+        sum = _mm256_srai_epi32(_mm256_add_epi32(sum, round), k_weight_bits);
+
+        __m256i p16 = _mm256_packs_epi32(sum, sum);
+        __m256i p8 = _mm256_packus_epi16(p16, p16);
+        int32_t lo4 = _mm_cvtsi128_si32(_mm256_castsi256_si128(p8));
+        int32_t hi4 = _mm_cvtsi128_si32(_mm256_extracti128_si256(p8, 1));
+        memcpy(out + x, &lo4, 4);
+        memcpy(out + x + 4, &hi4, 4);
+    }
+
+    horizontal_c(row, starts, weights, chunks, out, width, x);
+}
+#endif
+
+
+#if SIMD_SCALE_NEON
+// 8 pixels per step, weights are never negative so unsigned widening multiply-accumulate is enough
+static void vertical_neon(const uint8_t *const *rows, const int16_t *weights, int taps, uint8_t *out, int width)
+{
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint32x4_t lo = vdupq_n_u32(1 << (k_weight_bits - 1));
+        uint32x4_t hi = lo;
+        for (int k = 0; k < taps; k++) {
+            uint16x8_t v = vmovl_u8(vld1_u8(rows[k] + x));
+            lo = vmlal_n_u16(lo, vget_low_u16(v), (uint16_t)weights[k]);
+            hi = vmlal_n_u16(hi, vget_high_u16(v), (uint16_t)weights[k]);
+        }
+        uint16x8_t r = vcombine_u16(vshrn_n_u32(lo, k_weight_bits), vshrn_n_u32(hi, k_weight_bits));
+        vst1_u8(out + x, vqmovn_u16(r));
+    }
+
+    vertical_c(rows, weights, taps, out, width, x);
+}
+#endif
+
+
+struct SimdKernels {
+    VerticalKernel vertical;
+    HorizontalKernel horizontal;
+    const char *isa;
+};
+
+
+static SimdKernels pick_kernels()
+{
+#if SIMD_SCALE_X86
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+        return SimdKernels{vertical_avx2, horizontal_avx2, "avx2"};
+    }
+#elif SIMD_SCALE_NEON
+    return SimdKernels{vertical_neon, horizontal_c, "neon"};
+#endif
+    return SimdKernels{vertical_c, horizontal_c, "c"};
+}
+
+
+static const SimdKernels &simd_kernels()
+{
+    static const SimdKernels kernels = pick_kernels();
+    return kernels;
+}
+
+
+
+SimdPlaneScaler::SimdPlaneScaler(int src_width, int src_height, int dst_width, int dst_height, SimdScaleFilter filter, int slices)
+    : m_src_width(src_width)
+    , m_src_height(src_height)
+    , m_dst_width(dst_width)
+    , m_dst_height(dst_height)
+    , m_slices(std::max(1, std::min(slices, dst_height)))
+    , m_horizontal(make_taps(src_width, dst_width, filter, k_horizontal_chunk))
+    , m_vertical(make_taps(src_height, dst_height, filter, 2))
+{
+    // chunk major, so the 4 taps of 8 neighbouring outputs load as two vectors
+    int chunks = m_horizontal.taps / k_horizontal_chunk;
+    std::vector<int16_t> weights(m_horizontal.weights.size());
+    for (int x = 0; x < m_dst_width; x++) {
+        for (int t = 0; t < m_horizontal.taps; t++) {
+            int c = t / k_horizontal_chunk;
+            weights[((size_t)c * m_dst_width + x) * k_horizontal_chunk + t % k_horizontal_chunk] = m_horizontal.weights[(size_t)x * m_horizontal.taps + t];
+        }
+    }
+    m_horizontal.weights.swap(weights);
+
+    // the last start plus all padded taps and the width of one gather stay inside the buffer
+    m_row.assign(m_slices, std::vector<uint8_t>(m_src_width + chunks * k_horizontal_chunk + 64, 0));
+    m_rows.assign(m_slices, std::vector<const uint8_t *>(m_vertical.taps, nullptr));
+}
+
+
+void SimdPlaneScaler::scale(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int slice)
+{
+    const SimdKernels &kernels = simd_kernels();
+    int chunks = m_horizontal.taps / k_horizontal_chunk;
+
+    std::vector<uint8_t> &row = m_row[slice];
+    std::vector<const uint8_t *> &rows = m_rows[slice];
+
+    int y_end = (int)((int64_t)m_dst_height * (slice + 1) / m_slices);
+    for (int y = (int)((int64_t)m_dst_height * slice / m_slices); y < y_end; y++) {
+        // padded taps carry zero weights, clamp them to the last row instead of reading past the plane
+        int start = m_vertical.starts[y];
+        for (int k = 0; k < m_vertical.taps; k++) {
+            rows[k] = src + (ptrdiff_t)std::min(start + k, m_src_height - 1) * src_stride;
+        }
+
+        kernels.vertical(rows.data(), &m_vertical.weights[(size_t)y * m_vertical.taps], m_vertical.taps, row.data(), m_src_width);
+        kernels.horizontal(row.data(), m_horizontal.starts.data(), m_horizontal.weights.data(), chunks, dst + (ptrdiff_t)y * dst_stride, m_dst_width, 0);
+    }
+}
+
+
+int SimdPlaneScaler::slices()
+{
+    return m_slices;
+}
+
+
+SimdPlaneScaler::Taps SimdPlaneScaler::make_taps(int src_size, int dst_size, SimdScaleFilter filter, int tap_multiple)
+{
+    double ratio = (double)src_size / dst_size;
+
+    Taps result;
+    result.taps = filter == SimdScaleFilter::Bilinear ? 2 : (int)ceil(ratio) + 1;
+    result.taps = (result.taps + tap_multiple - 1) / tap_multiple * tap_multiple;
+    result.starts.resize(dst_size);
+    result.weights.assign((size_t)dst_size * result.taps, 0);
+
+    std::vector<double> weights(result.taps);
+    for (int i = 0; i < dst_size; i++) {
+        std::fill(weights.begin(), weights.end(), 0.0);
+
+        int start = 0;
+        if (filter == SimdScaleFilter::Bilinear) {
+            // sample centers line up, as in swscale and the scale filter
+            double center = (i + 0.5) * ratio - 0.5;
+            start = (int)floor(center);
+            double frac = center - start;
+            if (start < 0) {
+                start = 0;
+                frac = 0.0;
+            }
+            if (start >= src_size - 1) {
+                start = src_size - 1;
+                frac = 0.0;
+            }
+            weights[0] = 1.0 - frac;
+            weights[1] = frac;
+        }
+        else {
+            // every source pixel weighted by how much of it the output pixel covers
+            double begin = i * ratio;
+            double end = std::min((i + 1) * ratio, (double)src_size);
+            start = (int)floor(begin);
+            for (int k = 0; k < result.taps; k++) {
+                double overlap = std::min(end, (double)(start + k + 1)) - std::max(begin, (double)(start + k));
+                if (overlap > 0.0) {
+                    weights[k] = overlap / (end - begin);
+                }
+            }
+        }
+
+        // rounding error goes to the largest tap so every output sums to exactly one
+        int16_t *w = &result.weights[(size_t)i * result.taps];
+        int sum = 0;
+        int largest = 0;
+        for (int k = 0; k < result.taps; k++) {
+            w[k] = (int16_t)lround(weights[k] * k_weight_one);
+            sum += w[k];
+            if (w[k] > w[largest]) {
+                largest = k;
+            }
+        }
+        w[largest] = (int16_t)(w[largest] + k_weight_one - sum);
+
+        result.starts[i] = start;
+    }
+
+    return result;
+}
+
+
+
+SimdScaler::SimdScaler(int src_width, int src_height, int dst_width, int dst_height, SimdScaleFilter filter, int slices)
+    : m_luma(src_width, src_height, dst_width, dst_height, filter, slices)
+    , m_chroma((src_width + 1) / 2, (src_height + 1) / 2, (dst_width + 1) / 2, (dst_height + 1) / 2, filter, m_luma.slices())
+{
+}
+
+
+void SimdScaler::scale(const uint8_t *const src[3], const int src_stride[3], uint8_t *const dst[3], const int dst_stride[3], int slice)
+{
+    m_luma.scale(src[0], src_stride[0], dst[0], dst_stride[0], slice);
+
+    // a chroma plane too short for every slice leaves the last slices without chroma rows
+    if (slice < m_chroma.slices()) {
+        m_chroma.scale(src[1], src_stride[1], dst[1], dst_stride[1], slice);
+        m_chroma.scale(src[2], src_stride[2], dst[2], dst_stride[2], slice);
+    }
+}
+
+
+int SimdScaler::slices()
+{
+    return m_luma.slices();
+}
+
+
+std::string SimdScaler::isa()
+{
+    return simd_kernels().isa;
+}
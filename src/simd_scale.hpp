@@ -0,0 +1,75 @@
+#pragma once
+
+// c
+#include <stdint.h>
+
+// c++
+#include <string>
+#include <vector>
+
+
+
+enum class SimdScaleFilter : uint8_t {
+    Bilinear,
+    Area,
+};
+
+
+// separable downscale of one 8-bit plane with filter tables computed once for a fixed size pair
+// every output row is a vertical pass over the source rows into a row buffer, then a horizontal pass
+// kernels are picked at runtime, avx2 or neon, plain c otherwise
+// output rows are independent, so horizontal slices of the output can be scaled concurrently
+class SimdPlaneScaler {
+public:
+    SimdPlaneScaler(int src_width, int src_height, int dst_width, int dst_height, SimdScaleFilter filter, int slices = 1);
+    SimdPlaneScaler(const SimdPlaneScaler &other) = delete;
+
+    // output rows of the given slice only, each slice has its own scratch buffers
+    void scale(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int slice = 0);
+
+    int slices();
+
+
+private:
+    // fixed point taps, 14 fractional bits, weights of one output sum to 1 << 14
+    struct Taps {
+        int taps;
+        std::vector<int32_t> starts;
+        std::vector<int16_t> weights;
+    };
+
+    static Taps make_taps(int src_size, int dst_size, SimdScaleFilter filter, int tap_multiple);
+
+    int m_src_width;
+    int m_src_height;
+    int m_dst_width;
+    int m_dst_height;
+    int m_slices;
+
+    Taps m_horizontal;
+    Taps m_vertical;
+
+    // per slice, one vertically filtered source row, padded for kernels reading past the last pixel
+    std::vector<std::vector<uint8_t>> m_row;
+    std::vector<std::vector<const uint8_t *>> m_rows;
+};
+
+
+// yuv420p frames, luma and both chroma planes
+class SimdScaler {
+public:
+    SimdScaler(int src_width, int src_height, int dst_width, int dst_height, SimdScaleFilter filter, int slices = 1);
+    SimdScaler(const SimdScaler &other) = delete;
+
+    void scale(const uint8_t *const src[3], const int src_stride[3], uint8_t *const dst[3], const int dst_stride[3], int slice = 0);
+
+    int slices();
+
+    // kernels used on this cpu
+    static std::string isa();
+
+
+private:
+    SimdPlaneScaler m_luma;
+    SimdPlaneScaler m_chroma;
+};
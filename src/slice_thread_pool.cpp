@@ -0,0 +1,153 @@
+// self
+#include "slice_thread_pool.hpp"
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+SliceThreadPool &SliceThreadPool::instance()
+{
+    static SliceThreadPool pool;
+    return pool;
+}
+
+
+SliceThreadPool::SliceThreadPool()
+    : m_stop(false)
+    , m_runs(0)
+    , m_slices(0)
+    , m_worker_slices(0)
+{
+}
+
+
+SliceThreadPool::~SliceThreadPool()
+{
+    stop();
+}
+
+
+void SliceThreadPool::start(int threads)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_threads.empty() || threads <= 0) {
+        return;
+    }
+
+    m_stop = false;
+    for (int i = 0; i < threads; i++) {
+        m_threads.emplace_back(&SliceThreadPool::work, this);
+    }
+
+    SPDLOG_INFO("slice thread pool started, threads: {}", threads);
+}
+
+
+void SliceThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+
+int SliceThreadPool::threads()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int)m_threads.size();
+}
+
+
+void SliceThreadPool::run(int slices, const std::function<void(int)> &fn)
+{
+    m_runs.fetch_add(1);
+    m_slices.fetch_add(slices > 0 ? slices : 0);
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->slices = slices;
+    job->next.store(0);
+    job->done.store(0);
+
+    bool queued = false;
+    if (slices > 1) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_threads.empty() && !m_stop) {
+            m_jobs.push_back(job);
+            queued = true;
+        }
+    }
+    if (queued) {
+        m_cv.notify_all();
+    }
+
+    while (run_slice(*job, false)) {
+    }
+
+    // slices taken by workers may still be running, fn has to outlive them
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->cv.wait(lock, [&job]() { return job->done.load() >= job->slices; });
+}
+
+
+bool SliceThreadPool::run_slice(Job &job, bool worker)
+{
+    int slice = job.next.fetch_add(1);
+    if (slice >= job.slices) {
+        return false;
+    }
+
+    (*job.fn)(slice);
+    if (worker) {
+        m_worker_slices.fetch_add(1);
+    }
+
+    if (job.done.fetch_add(1) + 1 == job.slices) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.cv.notify_all();
+    }
+
+    return true;
+}
+
+
+void SliceThreadPool::work()
+{
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+            if (m_stop) {
+                return;
+            }
+
+            // fully claimed jobs leave the queue, their last slices finish on whoever claimed them
+            job = m_jobs.front();
+            if (job->next.load() >= job->slices) {
+                m_jobs.pop_front();
+                continue;
+            }
+        }
+
+        run_slice(*job, true);
+    }
+}
+
+
+std::string SliceThreadPool::stats()
+{
+    size_t slices = m_slices.load();
+    return fmt::format(
+        "slice thread pool threads: {}, runs: {}, slices: {}, on workers: {:.1f}%",
+        threads(), m_runs.load(), slices, slices > 0 ? 100.0 * m_worker_slices.load() / slices : 0.0
+    );
+}
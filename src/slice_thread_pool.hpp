@@ -0,0 +1,65 @@
+#pragma once
+
+// c++
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+// process wide workers running the slices of one frame in parallel, shared by every channel and output
+// the calling thread takes slices too, a busy pool only costs parallelism and never blocks a frame
+class SliceThreadPool {
+public:
+    static SliceThreadPool &instance();
+
+    // no workers until started, run then executes every slice on the calling thread
+    void start(int threads);
+    void stop();
+
+    int threads();
+
+    // fn(slice) for every slice in [0, slices), returns once all of them are done
+    void run(int slices, const std::function<void(int)> &fn);
+
+    std::string stats();
+
+
+private:
+    struct Job {
+        const std::function<void(int)> *fn;
+        int slices;
+        std::atomic<int> next;
+        std::atomic<int> done;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    SliceThreadPool();
+    SliceThreadPool(const SliceThreadPool &other) = delete;
+    ~SliceThreadPool();
+
+    void work();
+
+    // false once every slice of job has been claimed
+    bool run_slice(Job &job, bool worker);
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::shared_ptr<Job>> m_jobs;
+    bool m_stop;
+
+    // statics
+    std::atomic<size_t> m_runs;
+    std::atomic<size_t> m_slices;
+    std::atomic<size_t> m_worker_slices;
+};
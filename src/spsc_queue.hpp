@@ -0,0 +1,236 @@
+#pragma once
+
+// c
+#include <stddef.h>
+
+// c++
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+
+
+// bounded single-producer/single-consumer lock-free ring buffer
+// T only needs to be move constructible and move assignable
+template <typename T>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity);
+    SpscQueue(const SpscQueue &other) = delete;
+    ~SpscQueue();
+
+    // non-blocking, value is moved into the queue only on success
+    bool try_push(T &value);
+    bool try_pop(T &value);
+
+    // blocking with backoff, return false once the queue is closed
+    bool push(T &value);
+    bool pop(T &value);
+
+    // wake up both sides, pop still drains what is left
+    void close();
+    bool is_closed();
+
+    size_t size();
+    size_t capacity();
+
+    // how many times push found the queue full / pop found it empty
+    size_t full_waits();
+    size_t empty_waits();
+
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+    T *slot(size_t index);
+    static void backoff(int spins);
+
+    size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+
+    alignas(64) std::atomic<size_t> m_head;
+    size_t m_cached_tail;
+    std::atomic<size_t> m_empty_waits;
+
+    alignas(64) std::atomic<size_t> m_tail;
+    size_t m_cached_head;
+    std::atomic<size_t> m_full_waits;
+
+    alignas(64) std::atomic<bool> m_closed;
+};
+
+
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+    , m_slots(new Slot[capacity > 0 ? capacity : 1])
+    , m_head(0)
+    , m_cached_tail(0)
+    , m_empty_waits(0)
+    , m_tail(0)
+    , m_cached_head(0)
+    , m_full_waits(0)
+    , m_closed(false)
+{
+}
+
+
+template <typename T>
+SpscQueue<T>::~SpscQueue()
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    for (; head != tail; head++) {
+        slot(head)->~T();
+    }
+}
+
+
+template <typename T>
+bool SpscQueue<T>::try_push(T &value)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cached_head >= m_capacity) {
+        m_cached_head = m_head.load(std::memory_order_acquire);
+        if (tail - m_cached_head >= m_capacity) {
+            return false;
+        }
+    }
+
+    new (slot(tail)) T(std::move(value));
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+template <typename T>
+bool SpscQueue<T>::try_pop(T &value)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cached_tail) {
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+        if (head == m_cached_tail) {
+            return false;
+        }
+    }
+
+    T *item = slot(head);
+    value = std::move(*item);
+    item->~T();
+    m_head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+template <typename T>
+bool SpscQueue<T>::push(T &value)
+{
+    for (int spins = 0;; spins++) {
+        if (is_closed()) {
+            return false;
+        }
+
+        if (try_push(value)) {
+            return true;
+        }
+
+        if (0 == spins) {
+            m_full_waits.fetch_add(1, std::memory_order_relaxed);
+        }
+        backoff(spins);
+    }
+}
+
+
+template <typename T>
+bool SpscQueue<T>::pop(T &value)
+{
+    for (int spins = 0;; spins++) {
+        if (try_pop(value)) {
+            return true;
+        }
+
+        if (is_closed()) {
+            // the producer may have pushed right before closing
+            return try_pop(value);
+        }
+
+        if (0 == spins) {
+            m_empty_waits.fetch_add(1, std::memory_order_relaxed);
+        }
+        backoff(spins);
+    }
+}
+
+
+template <typename T>
+void SpscQueue<T>::close()
+{
+    m_closed.store(true, std::memory_order_release);
+}
+
+
+template <typename T>
+bool SpscQueue<T>::is_closed()
+{
+    return m_closed.load(std::memory_order_acquire);
+}
+
+
+template <typename T>
+size_t SpscQueue<T>::size()
+{
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    size_t head = m_head.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
+
+
+template <typename T>
+size_t SpscQueue<T>::capacity()
+{
+    return m_capacity;
+}
+
+
+template <typename T>
+size_t SpscQueue<T>::full_waits()
+{
+    return m_full_waits.load(std::memory_order_relaxed);
+}
+
+
+template <typename T>
+size_t SpscQueue<T>::empty_waits()
+{
+    return m_empty_waits.load(std::memory_order_relaxed);
+}
+
+
+template <typename T>
+T *SpscQueue<T>::slot(size_t index)
+{
+    return reinterpret_cast<T *>(&m_slots[index % m_capacity]);
+}
+
+
+template <typename T>
+void SpscQueue<T>::backoff(int spins)
+{
+    if (spins < 64) {
+        return;
+    }
+    else if (spins < 256) {
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
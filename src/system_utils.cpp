@@ -0,0 +1,257 @@
+// self
+#include "system_utils.hpp"
+
+// c
+#if defined(_WIN32)
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#endif
+
+// spdlog
+#include <spdlog/spdlog.h>
+
+
+
+int64_t current_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return (int64_t)counters.WorkingSetSize;
+#elif defined(__linux__)
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (nullptr == fp) {
+        return -1;
+    }
+
+    long pages = 0;
+    long resident_pages = 0;
+    int fields = fscanf(fp, "%ld %ld", &pages, &resident_pages);
+    fclose(fp);
+    if (fields != 2) {
+        return -1;
+    }
+    return (int64_t)resident_pages * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+
+int64_t peak_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return (int64_t)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    // bytes on macos
+    return (int64_t)usage.ru_maxrss;
+#else
+    // kilobytes on linux
+    return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+
+double thread_cpu_seconds() {
+#if defined(_WIN32)
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        return -1.0;
+    }
+    // 100 ns units
+    uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+    uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+    return (kernel + user) / 1e7;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return -1.0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return -1.0;
+#endif
+}
+
+
+
+// transparent huge page size on x86-64 and most arm64 kernels
+static const size_t k_huge_page_size = 2 * 1024 * 1024;
+
+
+void *aligned_malloc(size_t size, size_t alignment, bool huge_pages) {
+#if defined(_WIN32)
+    // large pages need SeLockMemoryPrivilege on windows, stay with normal pages
+    return _aligned_malloc(size, alignment);
+#else
+    // only the alignment grows, rounding the size up would waste most of a huge page per block
+    if (huge_pages && size >= k_huge_page_size) {
+        alignment = k_huge_page_size;
+    }
+
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return nullptr;
+    }
+
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages && size >= k_huge_page_size) {
+        madvise(ptr, size - size % k_huge_page_size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return ptr;
+#endif
+}
+
+
+void aligned_free(void *ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+
+
+MappedFile::MappedFile()
+    : m_data(nullptr)
+    , m_size(0)
+#if defined(_WIN32)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+    do {
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (INVALID_HANDLE_VALUE == m_file) {
+            SPDLOG_ERROR("CreateFileA error, code: {}, path: {}", GetLastError(), path);
+            break;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart <= 0) {
+            SPDLOG_ERROR("GetFileSizeEx error or empty file, path: {}", path);
+            break;
+        }
+        m_size = (size_t)size.QuadPart;
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (nullptr == m_mapping) {
+            SPDLOG_ERROR("CreateFileMappingA error, code: {}, path: {}", GetLastError(), path);
+            break;
+        }
+
+        m_data = (const uint8_t *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (nullptr == m_data) {
+            SPDLOG_ERROR("MapViewOfFile error, code: {}, path: {}", GetLastError(), path);
+            break;
+        }
+#else
+        m_fd = ::open(path.c_str(), O_RDONLY);
+        if (m_fd < 0) {
+            SPDLOG_ERROR("open error, path: {}", path);
+            break;
+        }
+
+        struct stat st;
+        if (fstat(m_fd, &st) != 0 || st.st_size <= 0) {
+            SPDLOG_ERROR("fstat error or empty file, path: {}", path);
+            break;
+        }
+        m_size = (size_t)st.st_size;
+
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (MAP_FAILED == data) {
+            SPDLOG_ERROR("mmap error, path: {}", path);
+            break;
+        }
+        m_data = (const uint8_t *)data;
+#endif
+
+        return true;
+    } while (false);
+
+    close();
+
+    return false;
+}
+
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data != nullptr) {
+        munmap((void *)m_data, m_size);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+
+const uint8_t *MappedFile::data()
+{
+    return m_data;
+}
+
+
+size_t MappedFile::size()
+{
+    return m_size;
+}
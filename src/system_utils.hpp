@@ -0,0 +1,53 @@
+#pragma once
+
+// c
+#include <stddef.h>
+#include <stdint.h>
+
+// c++
+#include <string>
+
+
+
+// resident set size of this process in bytes, -1 when the platform can't tell
+int64_t current_rss_bytes();
+
+// high water mark of the resident set size in bytes, -1 when the platform can't tell
+int64_t peak_rss_bytes();
+
+// cpu time consumed by the calling thread in seconds, -1 when the platform can't tell
+double thread_cpu_seconds();
+
+
+
+// aligned heap block, huge_pages asks the kernel to back it with transparent huge pages where supported
+void *aligned_malloc(size_t size, size_t alignment, bool huge_pages = false);
+void aligned_free(void *ptr);
+
+
+
+// read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    MappedFile(const MappedFile &other) = delete;
+    ~MappedFile();
+
+    bool open(const std::string &path);
+    void close();
+
+    const uint8_t *data();
+    size_t size();
+
+
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+
+#if defined(_WIN32)
+    void *m_file;
+    void *m_mapping;
+#else
+    int m_fd;
+#endif
+};